@@ -20,6 +20,10 @@
 #include <unistd.h>
 #include <stdbool.h>
 #include <math.h>
+#ifdef THREADS
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 #include "mm.h"
 #include "memlib.h"
@@ -34,6 +38,8 @@
 /* Misc */
 #define MAXLINE     1024          /* max string size */
 #define HDRLINES       4          /* number of header lines in a trace file */
+#define RSS_SAMPLES  256          /* resident size samples per trace with -R */
+#define RSS_MAX_DATA (1ul << 30)  /* -R skips traces with more live data than this */
 #define LINENUM(i) (i+HDRLINES+1) /* cnvt trace request nums to linenums (origin 1) */
 
 #ifndef REF_ONLY
@@ -121,6 +127,12 @@ typedef struct {
     /* defined only for the student malloc package */
     double util;       /* space utilization for this trace (always 0 for libc) */
 
+    /* set by -R, for the student malloc package only */
+    double rss_util;   /* live payload bytes / resident bytes, averaged over samples */
+    size_t live_peak;  /* most payload bytes live at once */
+    size_t rss_peak;   /* most resident bytes at any sample */
+    size_t rss_end;    /* resident bytes once the trace is done */
+
     /* Note: secs and util are only defined if valid is true */
 } stats_t;
 
@@ -161,6 +173,18 @@ static bool onetime_flag = false;
 static bool tab_mode = false;     /* Print output as tab-separated fields */
 static size_t maxfill = MAXFILL;
 
+/* -p: number of threads replaying each trace (0 = usual single-threaded run) */
+static int num_threads = 0;
+
+/* -x: with -p, free and realloc each block on the thread after its allocator */
+static bool handoff_mode = false;
+
+/* -R: also measure how much of the heap stays resident over each trace */
+static bool rss_mode = false;
+
+/* -L: check that oversized requests fail before running the traces */
+static bool limits_mode = false;
+
 /* by default, no timeouts */
 static int set_timeout = 0;
 
@@ -216,11 +240,20 @@ static void eval_libc_speed(void *ptr);
 /* Routines for evaluating correctnes, space utilization, and speed
    of the student's malloc package in mm.c */
 static bool eval_mm_valid(trace_t *trace, range_set_t *ranges);
+static void eval_mm_limits(void);
 static double eval_mm_util(trace_t *trace, int tracenum);
+static void eval_mm_rss(trace_t *trace, int tracenum, stats_t *stats);
 static void eval_mm_speed(void *ptr);
 
+#ifdef THREADS
+/* Replays the traces concurrently against the thread-safe mm.c (-p) */
+static void run_parallel(int num_tracefiles, const char *tracedir,
+                         char **tracefiles);
+#endif
+
 /* Various helper routines */
 static void printresults(int n, stats_t *stats, sum_stats_t *sumstats);
+static void printrss(int n, stats_t *stats);
 static void usage(char *prog);
 static void malloc_error(const trace_t *trace, int opnum, const char *fmt, ...)
     __attribute__((format(printf, 3,4)));
@@ -286,6 +319,8 @@ static void run_tests(int num_tracefiles, const char *tracedir,
             if (verbose > 1)
                 printf("efficiency, ");
             mm_stats[i].util = eval_mm_util(trace, i);
+            if (rss_mode)
+                eval_mm_rss(trace, i, &mm_stats[i]);
             speed_params->trace = trace;
             if (verbose > 1)
                 printf("and performance.\n");
@@ -359,7 +394,7 @@ int main(int argc, char **argv)
     /*
      * Read and interpret the command line arguments
      */
-    while ((c = getopt(argc, argv, "d:f:c:s:t:v:hOVlDT")) != EOF) {
+    while ((c = getopt(argc, argv, "d:f:c:s:t:v:p:hOVlDTRxL")) != EOF) {
         switch (c) {
 
             case 'f': /* Use one specific trace file only (relative to curr dir) */
@@ -409,6 +444,27 @@ int main(int argc, char **argv)
                 tab_mode = true;
                 break;
 
+            case 'R':
+                rss_mode = true;
+                break;
+
+            case 'L':
+                limits_mode = true;
+                break;
+
+            case 'p': /* Replay each trace on this many threads */
+                num_threads = atoi(optarg);
+                if (num_threads < 1)
+                    app_error("-p needs a positive thread count\n");
+#ifndef THREADS
+                app_error("-p needs the thread-safe build (make mt)\n");
+#endif
+                break;
+
+            case 'x': /* Hand each block's frees and reallocs to another thread */
+                handoff_mode = true;
+                break;
+
             case 'h': /* Print this message */
                 usage(argv[0]);
                 exit(0);
@@ -435,6 +491,14 @@ int main(int argc, char **argv)
         signal(SIGALRM, timeout_handler);
     }
 
+#ifdef THREADS
+    /* The parallel replay only measures throughput; it is not graded */
+    if (num_threads > 0) {
+        run_parallel(num_global_tracefiles, tracedir, global_tracefiles);
+        exit(errors > 0);
+    }
+#endif
+
     /*
      * Optionally run and evaluate the libc malloc package
      */
@@ -502,6 +566,8 @@ int main(int argc, char **argv)
     if (mm_stats == NULL)
         unix_error("mm_stats calloc in main failed");
 
+    if (limits_mode)
+        eval_mm_limits();
     run_tests(num_global_tracefiles, tracedir, global_tracefiles, mm_stats,
               &speed_params);
 
@@ -520,6 +586,10 @@ int main(int argc, char **argv)
             printf("\nResults for mm malloc:\n");
             printresults(num_global_tracefiles, mm_stats, &global_mm_sum_stats);
             printf("\n");
+            if (rss_mode) {
+                printrss(num_global_tracefiles, mm_stats);
+                printf("\n");
+            }
         }
     }
 
@@ -715,9 +785,11 @@ static bool add_range(range_set_t *ranges, char *lo, size_t size,
         return false;
     }
 
-    /* The payload must lie within the extent of the heap */
-    if ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) ||
-        (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) {
+    /* The payload must lie within the extent of the heap, or in a
+       mapping made with mm_map */
+    if (((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) ||
+         (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) &&
+        !mem_in_mapping(lo, hi)) {
         malloc_error(trace, opnum,
                      "Payload (%p:%p) lies outside heap (%p:%p)",
                      lo, hi, mem_heap_lo(), mem_heap_hi());
@@ -1194,15 +1266,51 @@ static bool eval_mm_valid(trace_t *trace, range_set_t *ranges)
     return true;
 }
 
+/*
+ * eval_mm_limits - Check that a request too large to satisfy fails and
+ *   leaves the block alone (-L). A 1 MiB block gets a mapping of its own
+ *   on a fresh heap, unless mappings are turned off; resizing it to nearly
+ *   SIZE_MAX must return NULL rather than a mapping whose page-rounded
+ *   length wrapped around.
+ */
+static void eval_mm_limits(void)
+{
+    size_t size = 1 << 20;
+    char *p;
+
+    mem_init();
+    if (!mm_init())
+        app_error("mm_init failed in eval_mm_limits\n");
+    if ((p = mm_malloc(size)) == NULL)
+        app_error("mm_malloc failed in eval_mm_limits\n");
+    if (!mem_in_mapping(p, p + size - 1)) {  /* MM_MMAP_THRESHOLD=0 */
+        mem_deinit();
+        return;
+    }
+    mem_write(p, 0x5a, 1);
+    mem_write(p + size - 1, 0xa5, 1);
+
+    if (mm_realloc(p, SIZE_MAX - 4) != NULL) {
+        printf("ERROR: mm_realloc of a %zu-byte block to %zu bytes succeeded\n",
+               size, SIZE_MAX - 4);
+        errors++;
+    } else if (mem_read(p, 1) != 0x5a || mem_read(p + size - 1, 1) != 0xa5) {
+        printf("ERROR: failed mm_realloc changed the block it was given\n");
+        errors++;
+    } else {
+        mm_free(p);
+    }
+    mem_deinit();
+}
+
 /*
  * eval_mm_util - Evaluate the space utilization of the student's package
  *   The idea is to remember the high water mark "hwm" of the heap for
  *   an optimal allocator, i.e., no gaps and no internal fragmentation.
  *   Utilization is the ratio hwm/heapsize, where heapsize is the
- *   size of the heap in bytes after running the student's malloc
- *   package on the trace. Note that our implementation of mem_sbrk()
- *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap.
+ *   largest size in bytes the heap reached while running the student's
+ *   malloc package on the trace (the heap can shrink, so its final size
+ *   may be smaller). Memory in live mm_map mappings counts as heap.
  *
  *   A higher number is better: 1 is optimal.
  */
@@ -1285,7 +1393,7 @@ static double eval_mm_util(trace_t *trace, int tracenum)
         /* update the high-water mark */
         max_total_size = (total_size > max_total_size) ?
             total_size : max_total_size;
-        heap_size = mem_heapsize();
+        heap_size = mem_heapsize() + mem_mapsize();
         max_heap_size = (heap_size > max_heap_size) ?
             heap_size : max_heap_size;
     }
@@ -1297,6 +1405,116 @@ static double eval_mm_util(trace_t *trace, int tracenum)
     return ((double)max_total_size / (double)max_heap_size);
 }
 
+/* Writes to every page of the payload p..p+size-1 */
+static void touch_pages(char *p, size_t size)
+{
+    size_t page = mem_pagesize();
+    size_t off = 0;
+    while (off < size) {
+        mem_write(p + off, 1, 1);
+        off += page - ((uintptr_t)(p + off) % page);
+    }
+}
+
+/*
+ * eval_mm_rss - Measure how closely resident memory follows live data (-R)
+ *   The trace is run as in eval_mm_util, starting from a heap with no
+ *   resident pages, but every page of each payload is written, the way a
+ *   program fills what it allocates. Every num_ops/RSS_SAMPLES requests,
+ *   the resident part of the heap and the mappings (mem_resident) is
+ *   compared with the payload bytes live then. Unlike utilization, this
+ *   credits an allocator for memory it gives back. Traces whose peak live
+ *   data exceeds RSS_MAX_DATA would need that much real memory and are
+ *   skipped (rss_peak stays 0).
+ */
+static void eval_mm_rss(trace_t *trace, int tracenum, stats_t *stats)
+{
+    int i;
+    int index;
+    int every = trace->num_ops / RSS_SAMPLES + 1;
+    int samples = 0;
+    size_t size, newsize, oldsize;
+    size_t live = 0;
+    size_t resident;
+    double ratio_sum = 0;
+    char *p;
+
+    reinit_trace(trace);
+    stats->live_peak = 0;
+    stats->rss_peak = 0;
+    if (trace->data_bytes > RSS_MAX_DATA)
+        return;
+
+    /* start from an empty heap whose pages are all back with the OS */
+    mem_reset_brk();
+    mem_track_resident(true);
+    if (!mm_init())
+        app_error("trace %d: mm_init failed in eval_mm_rss", tracenum);
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+        switch (trace->ops[i].type) {
+
+            case ALLOC: /* mm_alloc */
+                index = trace->ops[i].index;
+                size = trace->ops[i].size;
+
+                if ((p = mm_malloc(size)) == NULL)
+                    app_error("trace %d: mm_malloc failed in eval_mm_rss",
+                              tracenum);
+                touch_pages(p, size);
+
+                trace->blocks[index] = p;
+                trace->block_sizes[index] = size;
+                live += size;
+                break;
+
+            case REALLOC: /* mm_realloc */
+                index = trace->ops[i].index;
+                newsize = trace->ops[i].size;
+                oldsize = trace->block_sizes[index];
+
+                if ((p = mm_realloc(trace->blocks[index], newsize)) == NULL &&
+                    newsize != 0)
+                    app_error("trace %d: mm_realloc failed in eval_mm_rss",
+                              tracenum);
+                touch_pages(p, newsize);
+
+                trace->blocks[index] = p;
+                trace->block_sizes[index] = newsize;
+                live += newsize - oldsize;
+                break;
+
+            case FREE: /* mm_free */
+                index = trace->ops[i].index;
+                if (index < 0) {
+                    mm_free(NULL);
+                    break;
+                }
+                mm_free(trace->blocks[index]);
+                live -= trace->block_sizes[index];
+                break;
+
+            default:
+                app_error("trace %d: Nonexistent request type in eval_mm_rss",
+                          tracenum);
+        }
+
+        stats->live_peak = (live > stats->live_peak) ? live : stats->live_peak;
+        if (i % every == every - 1 || i == trace->num_ops - 1) {
+            resident = mem_resident();
+            stats->rss_peak = (resident > stats->rss_peak) ? resident : stats->rss_peak;
+            if (resident > 0) {
+                ratio_sum += (double)live / (double)resident;
+                samples++;
+            }
+        }
+    }
+
+    stats->rss_end = mem_resident();
+    stats->rss_util = (samples > 0) ? ratio_sum / samples : 0;
+    mem_track_resident(false);
+}
+
 
 /*
  * eval_mm_speed - This is the function that is used by fcyc()
@@ -1351,6 +1569,257 @@ static void eval_mm_speed(void *ptr)
         }
 }
 
+#ifdef THREADS
+/*
+ * Parallel replay (-p). Each trace is split by block id: thread t gets
+ * every request on the ids congruent to t mod num_threads, in trace
+ * order, so each thread's requests are a valid trace of their own. The
+ * threads are pinned round-robin to the CPUs the driver may run on and
+ * released together; the best of PARALLEL_REPS runs is reported.
+ *
+ * With -x, the frees and reallocs of id i go to thread (i + 1) mod
+ * num_threads instead, so blocks are released by a thread other than the
+ * one that allocated them, exercising the allocator's remote frees. The
+ * requests on one id then span two threads; each carries its position
+ * among its id's requests, and a thread waits for the id's turn to reach
+ * it. A request only waits on earlier ones, so the replay cannot
+ * deadlock.
+ */
+#define PARALLEL_REPS 5
+
+typedef struct {
+    trace_t *trace;
+    int *ops;                   /* indices of this thread's requests */
+    int num_ops;
+    int *op_turn;               /* -x: position of each request among its id's */
+    int *id_turn;               /* -x: next position due on each id */
+    int cpu;                    /* CPU the thread is pinned to */
+    pthread_barrier_t *start;
+    double begin, end;          /* when this thread's requests started and ended */
+} replay_t;
+
+static double now_secs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * replay_thread - Run one thread's share of a trace, the same way
+ *    eval_mm_speed runs a whole one
+ */
+static void *replay_thread(void *ptr)
+{
+    replay_t *replay = ptr;
+    trace_t *trace = replay->trace;
+    int i, index;
+    char *p;
+
+    pthread_barrier_wait(replay->start);
+    replay->begin = now_secs();
+
+    for (i = 0; i < replay->num_ops; i++) {
+        traceop_t *op = &trace->ops[replay->ops[i]];
+        index = op->index;
+        if (replay->id_turn != NULL && index >= 0) {
+            int turn = replay->op_turn[replay->ops[i]];
+            while (__atomic_load_n(&replay->id_turn[index], __ATOMIC_ACQUIRE) != turn)
+                sched_yield();
+        }
+        switch (op->type) {
+
+            case ALLOC: /* mm_malloc */
+                if ((p = mm_malloc(op->size)) == NULL)
+                    app_error("mm_malloc error in replay_thread");
+                trace->blocks[index] = p;
+                break;
+
+            case REALLOC: /* mm_realloc */
+                p = mm_realloc(trace->blocks[index], op->size);
+                if (p == NULL && op->size != 0)
+                    app_error("mm_realloc error in replay_thread");
+                trace->blocks[index] = p;
+                break;
+
+            case FREE: /* mm_free */
+                mm_free(index < 0 ? NULL : trace->blocks[index]);
+                break;
+
+            default:
+                app_error("Nonexistent request type in replay_thread");
+        }
+        if (replay->id_turn != NULL && index >= 0)
+            __atomic_store_n(&replay->id_turn[index],
+                             replay->op_turn[replay->ops[i]] + 1, __ATOMIC_RELEASE);
+    }
+
+    replay->end = now_secs();
+    return NULL;
+}
+
+/*
+ * replay_once - Reset the heap and replay the trace on all threads;
+ *    returns the time from the first thread's start to the last one's end
+ */
+static double replay_once(trace_t *trace, replay_t *replays)
+{
+    pthread_t *threads = malloc(num_threads * sizeof(pthread_t));
+    pthread_barrier_t start;
+    pthread_attr_t attr;
+    cpu_set_t set;
+    int t;
+
+    if (threads == NULL)
+        unix_error("threads malloc in replay_once failed");
+    reinit_trace(trace);
+    if (replays[0].id_turn != NULL)
+        memset(replays[0].id_turn, 0, trace->num_ids * sizeof(int));
+    mem_reset_brk();
+    if (!mm_init())
+        app_error("mm_init failed in replay_once");
+
+    pthread_barrier_init(&start, NULL, num_threads + 1);
+    for (t = 0; t < num_threads; t++) {
+        replays[t].start = &start;
+        pthread_attr_init(&attr);
+        CPU_ZERO(&set);
+        CPU_SET(replays[t].cpu, &set);
+        pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+        errno = pthread_create(&threads[t], &attr, replay_thread, &replays[t]);
+        if (errno != 0)
+            unix_error("pthread_create in replay_once failed");
+        pthread_attr_destroy(&attr);
+    }
+
+    pthread_barrier_wait(&start);
+    double begin = DBL_MAX, end = 0;
+    for (t = 0; t < num_threads; t++) {
+        pthread_join(threads[t], NULL);
+        begin = fmin(begin, replays[t].begin);
+        end = fmax(end, replays[t].end);
+    }
+    double secs = end - begin;
+
+    pthread_barrier_destroy(&start);
+    free(threads);
+    return secs;
+}
+
+static void run_parallel(int num_tracefiles, const char *tracedir,
+                         char **tracefiles)
+{
+    int cpus[CPU_SETSIZE];
+    int num_cpus = 0;
+    cpu_set_t allowed;
+    double total_ops = 0, total_secs = 0;
+    int i, t;
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        unix_error("sched_getaffinity in run_parallel failed");
+    for (i = 0; i < CPU_SETSIZE; i++)
+        if (CPU_ISSET(i, &allowed))
+            cpus[num_cpus++] = i;
+
+    printf("\nParallel replay on %d threads over %d CPUs (best of %d%s):\n",
+           num_threads, num_cpus, PARALLEL_REPS,
+           handoff_mode ? ", frees handed off" : "");
+    printf("%-26s%9s%10s%10s%10s%10s%10s%7s%9s\n", "trace", "ops", "secs",
+           "Kops/s", "min Kops", "max Kops", "locks", "wait%", "remote");
+
+    for (i = 0; i < num_tracefiles; i++) {
+        stats_t stats;
+        mm_lock_stats_t locks, best_locks = {0, 0, 0};
+        double *best_secs = calloc(num_threads, sizeof(double));
+        replay_t *replays = calloc(num_threads, sizeof(replay_t));
+        int *op_turn = NULL, *id_turn = NULL;
+        double best = DBL_MAX;
+        int j, rep;
+
+        mem_init();
+        trace_t *trace = read_trace(&stats, tracedir, tracefiles[i]);
+        if (best_secs == NULL || replays == NULL)
+            unix_error("replay calloc in run_parallel failed");
+
+        if (handoff_mode) {
+            op_turn = malloc(trace->num_ops * sizeof(int));
+            id_turn = calloc(trace->num_ids, sizeof(int));
+            if (op_turn == NULL || id_turn == NULL)
+                unix_error("replay turn malloc in run_parallel failed");
+        }
+        for (t = 0; t < num_threads; t++) {
+            replays[t].trace = trace;
+            replays[t].cpu = cpus[t % num_cpus];
+            replays[t].ops = malloc(trace->num_ops * sizeof(int));
+            if (replays[t].ops == NULL)
+                unix_error("replay ops malloc in run_parallel failed");
+            replays[t].op_turn = op_turn;
+            replays[t].id_turn = id_turn;
+        }
+        for (j = 0; j < trace->num_ops; j++) {
+            long index = trace->ops[j].index;
+            long owner = index < 0 ? 0 : index;
+            if (handoff_mode && index >= 0) {
+                op_turn[j] = id_turn[index]++;
+                owner += (trace->ops[j].type != ALLOC);
+            }
+            replay_t *replay = &replays[owner % num_threads];
+            replay->ops[replay->num_ops++] = j;
+        }
+
+        for (rep = 0; rep < PARALLEL_REPS; rep++) {
+            double secs = replay_once(trace, replays);
+            mm_lock_stats(&locks);
+            if (debug_mode != DBG_NONE && !mm_checkheap(__LINE__)) {
+                printf("ERROR [trace %s]: mm_checkheap failed after parallel replay\n",
+                       trace->filename);
+                errors++;
+            }
+            if (secs < best) {
+                best = secs;
+                best_locks = locks;
+                for (t = 0; t < num_threads; t++)
+                    best_secs[t] = replays[t].end - replays[t].begin;
+            }
+        }
+
+        double min_kops = DBL_MAX, max_kops = 0;
+        for (t = 0; t < num_threads; t++) {
+            double kops = best_secs[t] > 0 ? replays[t].num_ops / best_secs[t] / 1000.0 : 0;
+            min_kops = fmin(min_kops, kops);
+            max_kops = fmax(max_kops, kops);
+        }
+        const char *name = strrchr(trace->filename, '/');
+        printf("%-26s%9d%10.6f%10.0f%10.0f%10.0f%10lu%6.1f%%%9lu\n",
+               name ? name + 1 : trace->filename, trace->num_ops, best,
+               trace->num_ops / best / 1000.0, min_kops, max_kops,
+               (unsigned long)best_locks.locked,
+               best_locks.locked ? 100.0 * best_locks.contended / best_locks.locked : 0.0,
+               (unsigned long)best_locks.remote_freed);
+        if (verbose > 1) {
+            for (t = 0; t < num_threads; t++)
+                printf("    thread %2d on cpu %3d: %9d ops %10.6f secs %10.0f Kops/s\n",
+                       t, replays[t].cpu, replays[t].num_ops, best_secs[t],
+                       best_secs[t] > 0 ? replays[t].num_ops / best_secs[t] / 1000.0 : 0);
+        }
+
+        total_ops += trace->num_ops;
+        total_secs += best;
+        for (t = 0; t < num_threads; t++)
+            free(replays[t].ops);
+        free(op_turn);
+        free(id_turn);
+        free(replays);
+        free(best_secs);
+        free_trace(trace);
+        mem_deinit();
+    }
+
+    printf("%-26s%9.0f%10.6f%10.0f\n", "Total", total_ops, total_secs,
+           total_secs > 0 ? total_ops / total_secs / 1000.0 : 0.0);
+}
+#endif /* THREADS */
+
 /*
  * eval_libc_valid - We run this function to make sure that the
  *    libc malloc can run to completion on the set of traces.
@@ -1620,6 +2089,40 @@ static void printresults(int n, stats_t *stats, sum_stats_t *sumstats)
     }
 }
 
+/*
+ * printrss - prints the resident memory measured by -R for each valid trace
+ */
+static void printrss(int n, stats_t *stats)
+{
+    int i;
+    int counted = 0;
+    double sum = 0;
+
+    printf("Resident memory for mm malloc (KiB, %d samples per trace):\n",
+           RSS_SAMPLES);
+    printf("  %9s%11s%10s%10s  %s\n",
+           "live/rss", "peak live", "peak rss", "end rss", "trace");
+    for (i = 0; i < n; i++) {
+        if (!stats[i].valid)
+            continue;
+        if (stats[i].rss_peak == 0) {
+            printf("  %9s%11s%10s%10s  %s\n", "--", "--", "--", "--",
+                   stats[i].filename);
+            continue;
+        }
+        printf("  %8.1f%%%11zu%10zu%10zu  %s\n",
+               stats[i].rss_util * 100.0,
+               stats[i].live_peak / 1024,
+               stats[i].rss_peak / 1024,
+               stats[i].rss_end / 1024,
+               stats[i].filename);
+        sum += stats[i].rss_util;
+        counted++;
+    }
+    if (counted > 0)
+        printf("  %8.1f%%  average\n", sum / counted * 100.0);
+}
+
 /*
  * app_error - Report an arbitrary application error
  */
@@ -1843,5 +2346,11 @@ static void usage(char *prog)
     fprintf(stderr, "\t-v <i>     Set Verbosity Level to <i>\n");
     fprintf(stderr, "\t-s <s>     Timeout after s secs (default no timeout)\n");
     fprintf(stderr, "\t-T         Print diagnostics in tab mode\n");
+    fprintf(stderr, "\t-R         Also report resident memory over each trace\n");
+    fprintf(stderr, "\t-L         Check that oversized requests fail before the traces\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file\n");
+    fprintf(stderr, "\t-p <n>     Replay each trace split by id over n pinned threads\n");
+    fprintf(stderr, "\t           (thread-safe build mdriver-mt only)\n");
+    fprintf(stderr, "\t-x         With -p, free and realloc each block on the thread\n");
+    fprintf(stderr, "\t           after the one that allocated it\n");
 }
@@ -4,6 +4,7 @@
  * package with the system's malloc package in libc.
  *
  */
+#define _GNU_SOURCE /* mremap */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -22,26 +23,62 @@
 static unsigned char *heap;                 /* Starting address of heap */
 static unsigned char *mem_brk;              /* Current position of break */
 static unsigned char *mem_max_addr;         /* Maximum allowable heap address */
+static unsigned char *mem_brk_max;          /* Highest break since tracking started */
+static bool mem_tracking;                   /* Whether pages really go back to the OS */
+
+/* Mappings made with mm_map, kept so the driver can account for them and
+   check that payloads lie in one */
+typedef struct mapping {
+    unsigned char *addr;
+    size_t len;
+    struct mapping *next;
+} mapping_t;
+
+static mapping_t *mappings;                 /* Live mappings */
+static size_t mem_mapped;                   /* Bytes in live mappings */
+
+/*
+ * Returns the whole pages in lo..hi to the OS; they read as zero after.
+ * Like the break, this is only modelled unless mem_track_resident is on:
+ * the pages stay, so repeated runs of a trace don't measure page faults
+ * the model otherwise never has.
+ */
+static void discard_pages(unsigned char *lo, unsigned char *hi) {
+    if (!mem_tracking)
+        return;
+    uintptr_t page = (uintptr_t) getpagesize();
+    uintptr_t start = ((uintptr_t) lo + page - 1) & ~(page - 1);
+    uintptr_t end = (uintptr_t) hi & ~(page - 1);
+    if (start < end)
+        madvise((void *) start, end - start, MADV_DONTNEED);
+}
 
 /* 
- * mm_sbrk - simple model of the sbrk function. Extends the heap 
- *           by incr bytes and returns the start address of the
- *           new area. In this model, the heap cannot be shrunk.
+ * mm_sbrk - simple model of the sbrk function. Moves the break by incr
+ *           bytes and returns its old position. A negative incr shrinks
+ *           the heap and discards the pages past the new break. The
+ *           thread-safe mm.c calls it under its heap lock, but reads the
+ *           break without it, so the new break is stored atomically.
  */
 void *mm_sbrk(intptr_t incr) {
     unsigned char *old_brk = mem_brk;
 
     bool ok = true;
-    if (incr < 0) {
+    if (incr < 0 && mem_brk - heap < -incr) {
 	ok = false;
-	fprintf(stderr, "ERROR: mm_sbrk failed.  Attempt to expand heap by negative value %ld\n", (long) incr);
+	fprintf(stderr, "ERROR: mm_sbrk failed.  Attempt to shrink heap of %zd bytes by %ld\n", (ssize_t)(mem_brk - heap), (long) -incr);
     } else if (mem_brk + incr > mem_max_addr) {
 	ok = false;
 	long alloc = mem_brk - heap + incr;
 	fprintf(stderr, "ERROR: mm_sbrk failed. Ran out of memory.  Would require heap size of %zd (0x%zx) bytes\n", alloc, alloc);
     }
     if (ok) {
-	mem_brk += incr;
+	unsigned char *new_brk = old_brk + incr;
+	__atomic_store_n(&mem_brk, new_brk, __ATOMIC_RELEASE);
+	if (incr < 0)
+	    discard_pages(new_brk, old_brk + getpagesize() - 1);
+	if (new_brk > mem_brk_max)
+	    mem_brk_max = new_brk;
 	return (void *) old_brk;
     } else {
 	errno = ENOMEM;
@@ -60,14 +97,14 @@ void *mm_heap_lo(){
  * mm_heap_hi - return address of last heap byte
  */
 void *mm_heap_hi(){
-    return (void *)(mem_brk - 1);
+    return (void *)(__atomic_load_n(&mem_brk, __ATOMIC_ACQUIRE) - 1);
 }
 
 /*
  * mm_heapsize - returns the heap size in bytes
  */
 size_t mm_heapsize() {
-    return (size_t)(mem_brk - heap);
+    return (size_t)(__atomic_load_n(&mem_brk, __ATOMIC_ACQUIRE) - heap);
 }
 
 /*
@@ -77,6 +114,84 @@ size_t mm_pagesize(){
     return (size_t) getpagesize();
 }
 
+/*
+ * mm_discard - tell the OS the whole pages in ptr..ptr+len-1 hold nothing
+ *              worth keeping. They stay mapped and may read as zero when
+ *              next touched.
+ */
+void mm_discard(void *ptr, size_t len) {
+    discard_pages(ptr, (unsigned char *) ptr + len);
+}
+
+/*
+ * mm_map - model of an anonymous mmap: returns size bytes of zeroed,
+ *          page-aligned memory outside the heap, or NULL. size must be a
+ *          multiple of the page size. The mapping is real; the model only
+ *          records it.
+ */
+void *mm_map(size_t size) {
+    mapping_t *m = malloc(sizeof(mapping_t));
+    if (m == NULL)
+        return NULL;
+    m->addr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (m->addr == MAP_FAILED) {
+        free(m);
+        return NULL;
+    }
+    m->len = size;
+    m->next = mappings;
+    mappings = m;
+    mem_mapped += size;
+    return m->addr;
+}
+
+/* Returns the link pointing at the mapping starting at addr, or NULL */
+static mapping_t **find_mapping(const void *addr) {
+    mapping_t **link;
+    for (link = &mappings; *link != NULL; link = &(*link)->next)
+        if ((*link)->addr == addr)
+            return link;
+    return NULL;
+}
+
+/*
+ * mm_unmap - release a whole mapping returned by mm_map or mm_remap
+ */
+bool mm_unmap(void *ptr, size_t size) {
+    mapping_t **link = find_mapping(ptr);
+    if (link == NULL || (*link)->len != size) {
+	fprintf(stderr, "ERROR: mm_unmap failed.  %p is not a mapping of %zu bytes\n", ptr, size);
+        return false;
+    }
+    mapping_t *m = *link;
+    munmap(m->addr, m->len);
+    mem_mapped -= m->len;
+    *link = m->next;
+    free(m);
+    return true;
+}
+
+/*
+ * mm_remap - resize a mapping to new_size bytes, moving it if it can't
+ *            grow in place; returns its address or NULL
+ */
+void *mm_remap(void *ptr, size_t old_size, size_t new_size) {
+    mapping_t **link = find_mapping(ptr);
+    if (link == NULL || (*link)->len != old_size) {
+	fprintf(stderr, "ERROR: mm_remap failed.  %p is not a mapping of %zu bytes\n", ptr, old_size);
+        return NULL;
+    }
+    mapping_t *m = *link;
+    void *addr = mremap(m->addr, old_size, new_size, MREMAP_MAYMOVE);
+    if (addr == MAP_FAILED)
+        return NULL;
+    m->addr = addr;
+    m->len = new_size;
+    mem_mapped = mem_mapped - old_size + new_size;
+    return addr;
+}
+
 /*
  * mm_memcpy - copies n bytes from src to dst
  */
@@ -138,6 +253,7 @@ void mem_init(){
     }
     heap = addr;
     mem_max_addr = addr + MAX_HEAP_SIZE;
+    mem_brk = mem_brk_max = heap;
     mem_reset_brk();
 }
 
@@ -145,6 +261,7 @@ void mem_init(){
  * mem_deinit - free the storage used by the memory system model
  */
 void mem_deinit(void){
+    mem_reset_brk();
     if (munmap(heap, MAX_HEAP_SIZE) != 0) {
         fprintf(stderr, "FAILURE.  munmap couldn't deallocate heap space\n");
         exit(1);
@@ -156,6 +273,8 @@ void mem_deinit(void){
  */
 void mem_reset_brk(){
     mem_brk = heap;
+    while (mappings != NULL)
+        mm_unmap(mappings->addr, mappings->len);
 }
 
 void *mem_sbrk(intptr_t incr) {
@@ -178,15 +297,73 @@ size_t mem_pagesize(){
     return (size_t) getpagesize();
 }
 
+/* Bytes in the mappings made with mm_map that are still live */
+size_t mem_mapsize(void) {
+    return mem_mapped;
+}
+
+/*
+ * mem_track_resident - make mm_discard and heap shrinking return pages to
+ *                      the OS for real, so that mem_resident sees them.
+ *                      Turning it on first returns every heap page used
+ *                      so far, so the count starts from the current heap.
+ */
+void mem_track_resident(bool on) {
+    mem_tracking = on;
+    if (on) {
+        discard_pages(heap, mem_brk_max);
+        mem_brk_max = mem_brk;
+    }
+}
+
+/* Counts the resident pages in lo..lo+len-1, which must be page aligned */
+static size_t resident_pages(unsigned char *lo, size_t len) {
+    size_t page = (size_t) getpagesize();
+    size_t pages = (len + page - 1) / page;
+    unsigned char vec[1024];
+    size_t count = 0;
+    size_t i, n;
+    for (; pages > 0; pages -= n, lo += n * page) {
+        n = (pages < sizeof(vec)) ? pages : sizeof(vec);
+        if (mincore(lo, n * page, vec) != 0)
+            return count;
+        for (i = 0; i < n; i++)
+            count += vec[i] & 1;
+    }
+    return count;
+}
+
+/*
+ * mem_resident - bytes of the heap and of live mappings that are backed by
+ *                memory right now (the model's resident set size)
+ */
+size_t mem_resident(void) {
+    size_t pages = resident_pages(heap, (size_t)(mem_brk - heap));
+    mapping_t *m;
+    for (m = mappings; m != NULL; m = m->next)
+        pages += resident_pages(m->addr, m->len);
+    return pages * (size_t) getpagesize();
+}
+
+/* Returns whether lo..hi (inclusive) lies in one live mapping */
+bool mem_in_mapping(const void *lo, const void *hi) {
+    mapping_t *m;
+    for (m = mappings; m != NULL; m = m->next)
+        if ((const unsigned char *)lo >= m->addr &&
+            (const unsigned char *)hi < m->addr + m->len)
+            return true;
+    return false;
+}
+
 /* Read len bytes and return value zero-extended to 64 bits */
 uint64_t mem_read(const void *addr, size_t len) {
-    uint64_t rdata;
-    /* Dense or non-heap read */
-    rdata = *(uint64_t *) addr;
-    if (len < sizeof(uint64_t)) {
-	uint64_t mask = ((uint64_t) 1 << (8 * len)) - 1;
-	rdata &= mask;
-    }
+    uint64_t rdata = 0;
+    /* Dense or non-heap read; short reads stay within len, since a
+       mapping may end right after addr */
+    if (len == sizeof(uint64_t))
+        rdata = *(uint64_t *) addr;
+    else
+        memcpy((void *) &rdata, addr, len);
     return rdata;
 }
 
@@ -11,6 +11,10 @@ size_t mm_heapsize(void);
 size_t mm_pagesize(void);
 void *mm_memcpy(void *dst, const void *src, size_t n);
 void *mm_memset(void *dst, int c, size_t n);
+void *mm_map(size_t size);
+bool mm_unmap(void *ptr, size_t size);
+void *mm_remap(void *ptr, size_t old_size, size_t new_size);
+void mm_discard(void *ptr, size_t len);
 
 /* Functions used for memory emulation */
 /* You should not be calling these functions */
@@ -23,6 +27,10 @@ void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
 size_t mem_pagesize(void);
+size_t mem_mapsize(void);
+bool mem_in_mapping(const void *lo, const void *hi);
+void mem_track_resident(bool on);
+size_t mem_resident(void);
 
 /* Read len bytes and return value zero-extended to 64 bits */
 /* Require 0 <= len <= 8 */
@@ -7,6 +7,24 @@
  * This assignment creates a dynamic memory allocator that provides
  * malloc, free, realloc, and calloc functions. It uses segregated free
  * lists and boundary tag coalescing to manage free memory blocks efficiently
+ *
+ * Requests up to SLAB_LIMIT bytes are served from slab runs instead: one
+ * RUN_SIZE-aligned heap block per run, cut into equal slots with no per-slot
+ * header. A bitmap in the run tracks its free slots, and a bitmap of heap
+ * RUN_SIZE pages tells free which pointers belong to a run.
+ *
+ * Once enough of the heap has been freed, a purge gives memory back: a large
+ * free block at the top of the heap is trimmed off with a negative mm_sbrk,
+ * and the page-aligned interiors of the other large free blocks are
+ * discarded with mm_discard, keeping their boundary tags and list links.
+ *
+ * Built with -DTHREADS, the allocator is thread-safe. The heap is split into
+ * MAX_ARENAS arenas, each with its own free index and lock, and every thread
+ * allocates from the arena it was assigned. A block records its arena in
+ * its header, so a block freed by another thread is pushed onto the owning
+ * arena's remote list and taken back the next time that arena is locked.
+ * Each thread also caches up to TCACHE_MAX freed slots per slab class and
+ * serves small requests from them without any lock.
  */
 
  #include <assert.h>
@@ -16,6 +34,10 @@
  #include <unistd.h>
  #include <stdint.h>
  #include <stdbool.h>
+ #include <errno.h>
+ #ifdef THREADS
+ #include <pthread.h>
+ #endif // THREADS
  
  #include "mm.h"
  #include "memlib.h"
@@ -52,27 +74,108 @@
  #define ALIGNMENT 16
  #define WSIZE 8         // Word size (bytes)
  #define CHUNKSIZE 2048  // Initial heap size (bytes)
+ #define MIN_BLOCK 32    // Free block: header, pred, succ and footer
+ 
+ // Free block index: two-level segregated fit (TLSF).
+ // The first level splits sizes by power of two, the second splits each power
+ // of two into SL_COUNT equal ranges. Below SMALL_LIMIT every 16-byte size has
+ // its own bin (first-level row 0). A bitmap of non-empty bins per row, and one
+ // of non-empty rows, find the first usable bin with two bit scans.
+ #define SL_BITS 4
+ #define SL_COUNT 16                      // 1 << SL_BITS
+ #define FL_COUNT 7                       // rows for sizes below TREE_MIN
+ #define SMALL_LIMIT 256                  // SL_COUNT * ALIGNMENT
+ #define FIT_SCAN 8                       // blocks examined in the request's own bin
+ 
+ // Free blocks of TREE_MIN bytes and up are kept in a splay tree ordered by
+ // size instead, giving best fit among them in amortized O(log n). Blocks of
+ // equal size hang off one tree node in a list, so the tree holds each size once.
+ #define TREE_MIN 16384                   // 1 << (FL_COUNT + SL_BITS + 3)
+ 
+ // Slab front end: each class of SLAB_LIMIT / ALIGNMENT sizes has its own runs.
+ // A run is an allocated heap block whose payload starts on a RUN_SIZE
+ // boundary (the heap itself starts page aligned), so a slot's run is found by
+ // rounding the slot's address down. Half-page runs fill up sooner than
+ // whole pages, which matters for traces with few objects per class.
+ #define SLAB_LIMIT 128                   // largest request served from a run
+ #define SLAB_CLASSES 8                   // SLAB_LIMIT / ALIGNMENT
+ #define RUN_SIZE 2048                    // heap block size of a run, and of a page map page
+ #define RUN_HEADER 64                    // run metadata ahead of the first slot
+ #define RUN_MAP_WORDS 2                  // free-slot bitmap words, enough for 16-byte slots
+ #define PAGE_MAP_MIN 4096                // pages covered by the first page map
+ 
+ // Thread-safe build. The arena id sits in header bits 2-3, which block sizes
+ // (multiples of 16) leave free.
+ #define MAX_ARENAS 4
+ #define ARENA_SHIFT 2
+ #define TCACHE_MAX 16                    // slots a thread caches per slab class
+ #define TCACHE_FILL 8                    // slots taken at once to refill an empty cache
+ 
+ // Requests of mmap_threshold bytes and up that no free block fits get a
+ // mapping of their own instead of growing the heap, and free releases it.
+ // The threshold starts at MMAP_THRESHOLD and rises to the
+ // length of each freed mapping up to MMAP_THRESHOLD_MAX, so a size that is
+ // allocated and freed over and over moves back onto the heap. Setting
+ // MM_MMAP_THRESHOLD in the environment fixes the threshold (0: no mappings).
+ #define MMAP_THRESHOLD (128 * 1024)
+ #define MMAP_THRESHOLD_MAX (32 * 1024 * 1024)
+ #define MAP_TAG ((size_t)0x6d61707065640000) // xor'd with a mapping's address in its first word
+ 
+ // Free memory goes back to the OS in a purge. An arena purges once it has
+ // freed 1/PURGE_SHARE of its heap, and at least TRIM_THRESHOLD bytes, since
+ // its last purge, while more than half its heap sits in the tree's free
+ // blocks. A purge cuts a free block of TRIM_THRESHOLD bytes or more at the
+ // top of the heap back to TRIM_PAD and shrinks the heap under it, and
+ // discards the interior pages of free blocks of DISCARD_MIN bytes or more.
+ // An arena whose large blocks are reused at its working size keeps its
+ // memory; one that has drained after a burst gives it back.
+ #define PURGE_SHARE 8
+ #define TRIM_THRESHOLD (256 * 1024)
+ #define TRIM_PAD (128 * 1024)
+ #define DISCARD_MIN (64 * 1024)
+ 
+ // Shared library build (no DRIVER): requests above MAX_REQUEST fail
+ // instead of overflowing the size arithmetic.
+ #define MAX_REQUEST (PTRDIFF_MAX / 2)
  
  // Helper functions for manipulating headers, footers, and block pointers
+ //
+ // Header bit 0 is the block's allocated bit and bit 1 is the allocated bit of
+ // the block before it. Only free blocks carry a footer; allocated blocks use
+ // that word for payload, so the footer of the previous block may only be read
+ // when the prev-alloc bit says it is free. Bits 2-3 hold the block's arena.
  
- /* Pack a size and allocated bit into a word. */
- static inline size_t pack(size_t size, int alloc) {
-     return size | alloc;
+ static inline size_t arena_bits(void);
+ 
+ /* Pack a size, the previous block's allocated bit and an allocated bit into a word,
+    tagged with the current arena. */
+ static inline size_t pack(size_t size, int prev_alloc, int alloc) {
+     return size | arena_bits() | (prev_alloc << 1) | alloc;
  }
  
- /* Read a word at address p. */
+ /* Read a word at address p.
+    Threads read the headers of blocks they own while the arena updates the
+    prev-alloc bit, so the threaded build makes every header access atomic. */
  static inline size_t get(void *p) {
+ #ifdef THREADS
+     return __atomic_load_n((size_t *)p, __ATOMIC_RELAXED);
+ #else
      return *(size_t *)p;
+ #endif // THREADS
  }
  
  /* Write a word at address p. */
  static inline void put(void *p, size_t val) {
+ #ifdef THREADS
+     __atomic_store_n((size_t *)p, val, __ATOMIC_RELAXED);
+ #else
      *(size_t *)p = val;
+ #endif // THREADS
  }
  
  /* Extract the block size from header/footer word. */
  static inline size_t get_size(void *p) {
-     return get(p) & ~0x7;
+     return get(p) & ~(size_t)0xF;
  }
  
  /* Extract the allocated bit from header/footer word. */
@@ -80,12 +183,22 @@
      return get(p) & 0x1;
  }
  
+ /* Extract the previous block's allocated bit from a header word. */
+ static inline int get_prev_alloc(void *p) {
+     return (get(p) >> 1) & 0x1;
+ }
+ 
+ /* Update the previous block's allocated bit in a header word. */
+ static inline void set_prev_alloc(void *p, int prev_alloc) {
+     put(p, (get(p) & ~(size_t)0x2) | ((size_t)prev_alloc << 1));
+ }
+ 
  /* Given a pointer to payload, return pointer to its header. */
  static inline void *hdrp(void *ptr) {
      return (char *)ptr - WSIZE;
  }
  
- /* Given a pointer to payload, return pointer to its footer.
+ /* Given a pointer to a free block's payload, return pointer to its footer.
     (Subtracting 2*WSIZE because header and footer each take one word.) */
  static inline void *ftrp(void *ptr) {
      return (char *)ptr + get_size(hdrp(ptr)) - 2*WSIZE;
@@ -96,7 +209,8 @@
      return (char *)ptr + get_size(hdrp(ptr));
  }
  
- /* Return pointer to previous block's payload in the heap. */
+ /* Return pointer to previous block's payload in the heap.
+    Only valid when the previous block is free, as only free blocks have footers. */
  static inline void *prev_blkp(void *ptr) {
      return (char *)ptr - get_size((char *)ptr - 2*WSIZE);
  }
@@ -136,11 +250,145 @@
  static void place(void *ptr, size_t asize);
  static void add_to_free_list(void *ptr);
  static void remove_from_free_list(void *ptr);
- static int get_list_index(size_t size);
+ static void size_class(size_t size, int *fl, int *sl);
+ static void *heap_malloc(size_t size, bool may_map);
+ static void heap_free(void *ptr);
+ static void *arena_malloc(size_t size);
+ static void arena_free(void *ptr);
+ static bool resize_block(void *ptr, size_t size, size_t *oldsize);
+ static void lock_heap(void);
+ static void unlock_heap(void);
+ static void *slab_malloc(size_t size);
+ static void slab_free(void *run, void *ptr);
+ static void *slab_run_of(void *ptr);
+ static int slab_class(size_t slot_size);
+ static void tree_insert(void *ptr);
+ static void tree_remove(void *ptr);
+ static void *tree_fit(size_t asize);
+ static void *alloc_aligned(size_t asize, size_t alignment);
+ static bool is_mapped(void *ptr);
+ static bool owns_mapping(void *ptr);
+ static void *map_block(size_t size);
+ static void unmap_block(void *ptr);
+ static void *remap_block(void *ptr, size_t size);
+ static void purge(void);
+ static void trim_heap(void *ptr);
+ #ifndef DRIVER
+ static bool ensure_init(void);
+ static bool is_foreign(void *ptr);
+ #endif // DRIVER
+ #ifdef DEBUG
+ static bool in_free_list(void *ptr, int fl, int sl);
+ static bool in_tree(void *ptr);
+ static bool check_tree(int line_number, size_t *count);
+ static bool check_slabs(int line_number);
+ static bool check_arena(int line_number);
+ #endif // DEBUG
+ 
+ // Run metadata, at the start of the run's payload.
+ typedef struct slab_run {
+     struct slab_run *next;             // runs of the same class with a free slot
+     struct slab_run *prev;
+     uint32_t slot_size;
+     uint32_t nfree;                    // free slots left
+     uint64_t free_map[RUN_MAP_WORDS];  // bit i set if slot i is free
+ } slab_run_t;
+ 
+ _Static_assert(sizeof(slab_run_t) <= RUN_HEADER, "run metadata must fit RUN_HEADER");
+ 
+ typedef struct {
+     uint64_t fl_bitmap;              // bit f set if row f has a non-empty bin
+     uint32_t sl_bitmap[FL_COUNT];    // bit s of row f set if bins[f][s] is non-empty
+     char *bins[FL_COUNT][SL_COUNT];  // segregated free lists
+     char *tree_root;                 // free blocks of TREE_MIN bytes and up
+     slab_run_t *runs[SLAB_CLASSES];  // per class, runs with a free slot
+     char *segment;                   // prologue of the arena's newest segment
+     char *top;                       // end of the newest segment
+     size_t heap_bytes;               // bytes of heap in the arena's segments
+     size_t tree_bytes;               // bytes in the tree's free blocks
+     size_t dirty;                    // bytes freed since the last purge
+ #ifdef THREADS
+     int id;
+     pthread_mutex_t lock;
+     void *remote;                    // blocks freed by other threads, linked through their first word
+     uint64_t locked;                 // lock acquisitions since mm_init
+     uint64_t contended;              // acquisitions that found the lock held
+     uint64_t remote_freed;           // blocks taken back from the remote list
+ #endif // THREADS
+ } free_index_t;
+ 
+ // An arena's blocks live in segments, each a stretch of heap with its own
+ // prologue and epilogue. A segment grows in place while nothing else was
+ // added to the heap after it; otherwise the arena starts a new one. The
+ // padding word before a segment's prologue links to the previous segment.
+ 
+ typedef struct {
+     uint64_t *page_map;              // word 0: pages covered; then bit i set if heap page i holds a run
+     size_t mmap_threshold;           // smallest request given its own mapping
+     bool mmap_fixed;                 // set from the environment, so never adapted
+ #ifdef THREADS
+     pthread_mutex_t lock;            // guards mm_sbrk, segment growth and page map updates
+     free_index_t *arenas[MAX_ARENAS];
+     unsigned next_arena;             // round-robin arena assignment
+ #endif // THREADS
+ } heap_state_t;
+ 
+ #ifdef THREADS
+ // Slots a thread freed, per slab class, linked through their first word.
+ typedef struct {
+     void *slots[SLAB_CLASSES];
+     uint32_t count[SLAB_CLASSES];
+ } tcache_t;
+
+ static void lock_arena(free_index_t *arena);
+ static void unlock_arena(free_index_t *arena);
+ static void release(void *ptr);
+ static void tcache_push(int c, void *slot);
+ static void *tcache_pop(int c);
+ static void create_tcache_key(void);
+ static free_index_t *attach_thread(void);
+ #endif // THREADS
  
  // Global variables
- static char *heap_listp = 0;  // Pointer to first block in heap
- static char *free_lists[11];  // Array of segregated free lists
+ static heap_state_t *heap_state = 0;             // Shared state, kept at the bottom of the heap
+ #ifdef THREADS
+ static __thread free_index_t *free_index = 0;    // Arena being worked on; its lock is held
+ static __thread free_index_t *thread_arena = 0;  // Arena this thread allocates from
+ static __thread tcache_t tcache;
+ static __thread unsigned thread_generation = 0;  // heap_generation the thread's state belongs to
+ static unsigned heap_generation = 0;             // bumped by mm_init
+ static pthread_key_t tcache_key;                 // flushes a thread's cache when it exits
+ static pthread_once_t tcache_key_once = PTHREAD_ONCE_INIT;
+ #else
+ static free_index_t *free_index = 0;             // Free lists, kept after the shared state
+ #endif // THREADS
+ #ifndef DRIVER
+ static bool heap_ready = false;                  // set once the first call has run mm_init
+ #ifdef THREADS
+ static pthread_once_t heap_once = PTHREAD_ONCE_INIT;
+ #endif // THREADS
+ #endif // DRIVER
+ 
+ // Arena id of the free index being worked on.
+ static inline int arena_id(void)
+ {
+ #ifdef THREADS
+     return free_index->id;
+ #else
+     return 0;
+ #endif // THREADS
+ }
+ 
+ static inline size_t arena_bits(void)
+ {
+     return (size_t)arena_id() << ARENA_SHIFT;
+ }
+ 
+ // Arena id recorded in a header word.
+ static inline int header_arena(void *p)
+ {
+     return (int)((get(p) >> ARENA_SHIFT) & (MAX_ARENAS - 1));
+ }
  
  // rounds up to the nearest multiple of ALIGNMENT
  static size_t align(size_t x)
@@ -148,56 +396,147 @@
      return ALIGNMENT * ((x+ALIGNMENT-1)/ALIGNMENT);
  }
  
- // mm_init: Initialize the memory manager.
- // Initializes free lists.
- // Creates an initial empty heap with prologue and epilogue.
- // Extends the heap with an initial free block.
- bool mm_init(void)
+ // block size for a request of size bytes: payload plus the header, at least
+ // big enough to hold a free block once it is released
+ static size_t adjust_size(size_t size)
+ {
+     size_t asize = align(size + WSIZE);
+     return (asize < MIN_BLOCK) ? MIN_BLOCK : asize;
+ }
+ 
+ // new_arena: Set up an arena: its free index, then a first segment holding
+ // an initial free block.
+ static free_index_t *new_arena(int id)
  {
-     for (int i = 0; i < 11; i++) {
-         free_lists[i] = NULL;
+     free_index_t *arena = mm_sbrk(align(sizeof(free_index_t)));
+     if (arena == (void *)-1) {
+         return NULL;
      }
+     memset(arena, 0, sizeof(free_index_t));
+ #ifdef THREADS
+     arena->id = id;
+     pthread_mutex_init(&arena->lock, NULL);
+ #endif // THREADS
      
-     if ((heap_listp = mm_sbrk(4*WSIZE)) == (void *)-1) {
+     free_index = arena;
+     if (extend_heap(CHUNKSIZE/WSIZE) == NULL) {
+         return NULL;
+     }
+     return arena;
+ }
+ 
+ // mm_init: Initialize the memory manager.
+ // The shared state and the arenas' free indexes are too large for global
+ // variables, so they take the first bytes of the heap.
+ // Each arena starts with one segment holding a free block.
+ bool mm_init(void)
+ {
+     heap_state = mm_sbrk(align(sizeof(heap_state_t)));
+     if (heap_state == (void *)-1) {
          return false;
      }
+     memset(heap_state, 0, sizeof(heap_state_t));
+     dbg_assert((size_t)heap_state % RUN_SIZE == 0);
      
-     put(heap_listp, 0);                              // Alignment padding
-     put(heap_listp + (1*WSIZE), pack(WSIZE*2, 1));     // Prologue header
-     put(heap_listp + (2*WSIZE), pack(WSIZE*2, 1));     // Prologue footer
-     put(heap_listp + (3*WSIZE), pack(0, 1));           // Epilogue header
-     heap_listp += (2*WSIZE);
-     
-     if (extend_heap(CHUNKSIZE/WSIZE) == NULL) {
-         return false;
+     const char *threshold = getenv("MM_MMAP_THRESHOLD");
+     heap_state->mmap_threshold = MMAP_THRESHOLD;
+     if (threshold != NULL) {
+         size_t bytes = strtoul(threshold, NULL, 0);
+         heap_state->mmap_threshold = (bytes != 0) ? bytes : SIZE_MAX;
+         heap_state->mmap_fixed = true;
      }
      
+ #ifdef THREADS
+     pthread_once(&tcache_key_once, create_tcache_key);
+     pthread_mutex_init(&heap_state->lock, NULL);
+     heap_generation++;
+     for (int id = 0; id < MAX_ARENAS; id++) {
+         if ((heap_state->arenas[id] = new_arena(id)) == NULL) {
+             return false;
+         }
+     }
+     attach_thread();
      return true;
+ #else
+     return new_arena(0) != NULL;
+ #endif // THREADS
  }
  
  // malloc: Allocate a block with at least 'size' bytes of payload.
- // Adjusts size to include header/footer overhead and align the block.
- // Searches the free list for a fit; if none, extends the heap.
+ // The threaded build first tries the thread's cache, then locks its arena,
+ // refilling the cache while it holds the lock.
  void* malloc(size_t size)
  {
-     size_t asize;      // Adjusted block size
-     size_t extendsize; // Amount to extend heap if no fit found
-     char *ptr;          
-     
+ #ifndef DRIVER
+     // Programs expect a unique pointer even for 0 bytes
+     if (!ensure_init() || size > MAX_REQUEST) {
+         errno = ENOMEM;
+         return NULL;
+     }
+     size += (size == 0);
+ #endif // DRIVER
      if (size == 0) {
          return NULL;
      }
      
-     if (size <= WSIZE*2) {
-         asize = WSIZE*4;  // Minimum block size (16 bytes payload + 16 bytes overhead)
-     } else {
-         asize = align(size + WSIZE*2);  // Include overhead for header and footer
+ #ifdef THREADS
+     free_index_t *arena = attach_thread();
+     int c = slab_class(align(size));
+     if (size <= SLAB_LIMIT && tcache.count[c] > 0) {
+         return tcache_pop(c);
+     }
+     
+     lock_arena(arena);
+     void *ptr = arena_malloc(size);
+     if (ptr != NULL && size <= SLAB_LIMIT) {
+         for (int i = 0; i < TCACHE_FILL && tcache.count[c] < TCACHE_MAX; i++) {
+             void *slot = slab_malloc(size);
+             if (slot == NULL) {
+                 break;
+             }
+             tcache_push(c, slot);
+         }
      }
+     unlock_arena(arena);
+     return ptr;
+ #else
+     return arena_malloc(size);
+ #endif // THREADS
+ }
+ 
+ // arena_malloc: Allocate from the current arena.
+ // Small requests take a slab slot; the rest go to the heap.
+ static void *arena_malloc(size_t size)
+ {
+     if (size <= SLAB_LIMIT) {
+         void *ptr = slab_malloc(size);
+         if (ptr != NULL) {
+             return ptr;
+         }
+     }
+     return heap_malloc(size, true);
+ }
+ 
+ // heap_malloc: Allocate a heap block with at least 'size' bytes of payload.
+ // Adjusts size to include header overhead and align the block.
+ // Searches the free list for a fit; if none, extends the heap, or, if
+ // may_map is set, maps a block of its own for requests above the mmap
+ // threshold.
+ static void *heap_malloc(size_t size, bool may_map)
+ {
+     size_t asize;      // Adjusted block size
+     size_t extendsize; // Amount to extend heap if no fit found
+     char *ptr;          
+     
+     asize = adjust_size(size);
      
      if ((ptr = find_fit(asize)) != NULL) {
          place(ptr, asize);
          return ptr;
      }
+     if (may_map && size >= __atomic_load_n(&heap_state->mmap_threshold, __ATOMIC_RELAXED)) {
+         return map_block(size);
+     }
      
      extendsize = (asize > CHUNKSIZE) ? asize : CHUNKSIZE;
      if ((ptr = extend_heap(extendsize/WSIZE)) == NULL) {
@@ -207,50 +546,172 @@
      return ptr;
  }
  
- // free: Free an allocated block.
- // Marks the block as free and updates its header/footer.
- // Attempts to coalesce with adjacent free blocks.
+ // free: Free an allocated block or slab slot.
+ // The threaded build keeps small slots in the thread's cache while it has
+ // room, and hands everything else back to the block's arena.
  void free(void* ptr)
  {
      if (ptr == NULL) {
          return;
      }
+ #ifndef DRIVER
+     if (is_foreign(ptr)) {
+         return;
+     }
+ #endif // DRIVER
+     if (is_mapped(ptr)) {
+         unmap_block(ptr);
+         return;
+     }
      
+ #ifdef THREADS
+     attach_thread();
+     slab_run_t *run = slab_run_of(ptr);
+     if (run != NULL) {
+         int c = slab_class(run->slot_size);
+         if (tcache.count[c] < TCACHE_MAX) {
+             tcache_push(c, ptr);
+             return;
+         }
+     }
+     release(ptr);
+ #else
+     arena_free(ptr);
+ #endif // THREADS
+ }
+ 
+ // arena_free: Free a block or slot of the current arena.
+ static void arena_free(void *ptr)
+ {
+     void *run = slab_run_of(ptr);
+     if (run != NULL) {
+         slab_free(run, ptr);
+         return;
+     }
+     heap_free(ptr);
+ }
+ 
+ // heap_free: Free an allocated heap block.
+ // Marks the block as free, gives it a footer and tells the next block.
+ // Attempts to coalesce with adjacent free blocks.
+ // Purges the arena once enough of it is free.
+ static void heap_free(void *ptr)
+ {
      size_t size = get_size(hdrp(ptr));
      
-     put(hdrp(ptr), pack(size, 0));
-     put(ftrp(ptr), pack(size, 0));
+     put(hdrp(ptr), pack(size, get_prev_alloc(hdrp(ptr)), 0));
+     put(ftrp(ptr), get(hdrp(ptr)));
+     set_prev_alloc(hdrp(next_blkp(ptr)), 0);
      
      coalesce(ptr);
+     
+     free_index->dirty += size;
+     if (free_index->dirty >= TRIM_THRESHOLD &&
+         free_index->dirty >= free_index->heap_bytes / PURGE_SHARE &&
+         free_index->tree_bytes > free_index->heap_bytes / 2) {
+         free_index->dirty = 0;
+         purge();
+     }
  }
  
  
  // realloc: Reallocate a block to a new size.
+ // A slab slot stays put while the new size fits the slot.
  // If the new size is smaller, shrink the block (split if possible).
  // If larger, attempt in-place extension; otherwise, allocate a new block.
  void* realloc(void* oldptr, size_t size)
  {
+ #ifndef DRIVER
+     if (size > MAX_REQUEST) {
+         errno = ENOMEM;
+         return NULL;
+     }
+ #endif // DRIVER
      if (size == 0) {
          free(oldptr);
          return NULL;
      }
      if (oldptr == NULL)
          return malloc(size);
+ #ifndef DRIVER
+     // A foreign block's size is unknown, so it can't be copied or resized
+     if (is_foreign(oldptr))
+         return malloc(size);
+ #endif // DRIVER
      
+     // A mapped block that stays above the threshold is resized by the
+     // kernel, without a copy; below it, it moves onto the heap.
+     if (is_mapped(oldptr)) {
+         if (size >= __atomic_load_n(&heap_state->mmap_threshold, __ATOMIC_RELAXED))
+             return remap_block(oldptr, size);
+         void *newptr = malloc(size);
+         if (newptr == NULL)
+             return NULL;
+         size_t oldsize = get_size(hdrp(oldptr)) - 2*WSIZE;
+         memcpy(newptr, oldptr, (size < oldsize) ? size : oldsize);
+         free(oldptr);
+         return newptr;
+     }
+     
+     slab_run_t *run = slab_run_of(oldptr);
+     if (run != NULL) {
+         if (size <= run->slot_size)
+             return oldptr;
+         void *newptr = malloc(size);
+         if (newptr == NULL)
+             return NULL;
+         memcpy(newptr, oldptr, run->slot_size);
+         free(oldptr);
+         return newptr;
+     }
+     
+     size_t oldsize;
+ #ifdef THREADS
+     free_index_t *owner = heap_state->arenas[header_arena(hdrp(oldptr))];
+     lock_arena(owner);
+     bool resized = resize_block(oldptr, size, &oldsize);
+     unlock_arena(owner);
+ #else
+     bool resized = resize_block(oldptr, size, &oldsize);
+ #endif // THREADS
+     if (resized)
+         return oldptr;
+     
+     // Otherwise, allocate a new block, copy the data, and free the old block.
+     void *newptr = malloc(size);
+     if (newptr == NULL)
+         return NULL;
+     
+     size_t copySize = oldsize - WSIZE;
+     if (size < copySize)
+         copySize = size;
+     memcpy(newptr, oldptr, copySize);
+     free(oldptr);
+     return newptr;
+ }
+ 
+ // resize_block: Resize heap block ptr of the current arena in place.
+ // Shrinks it (splitting off the tail if possible), or grows it into a free
+ // next block. Returns false if it can't, with the block's size in *oldsize.
+ static bool resize_block(void *ptr, size_t size, size_t *oldsize_out)
+ {
+     void *oldptr = ptr;
      size_t oldsize = get_size(hdrp(oldptr));
-     size_t newsize = align(size + WSIZE*2);  // New block size including overhead
+     size_t newsize = adjust_size(size);  // New block size including overhead
+     int prev_alloc = get_prev_alloc(hdrp(oldptr));
+     *oldsize_out = oldsize;
      
      if (newsize <= oldsize) {
-         if (oldsize - newsize >= (4*WSIZE)) {
-             put(hdrp(oldptr), pack(newsize, 1));
-             put(ftrp(oldptr), pack(newsize, 1));
+         if (oldsize - newsize >= MIN_BLOCK) {
+             put(hdrp(oldptr), pack(newsize, prev_alloc, 1));
              
              void *next_ptr = next_blkp(oldptr);
-             put(hdrp(next_ptr), pack(oldsize - newsize, 0));
-             put(ftrp(next_ptr), pack(oldsize - newsize, 0));
-             add_to_free_list(next_ptr);
+             put(hdrp(next_ptr), pack(oldsize - newsize, 1, 0));
+             put(ftrp(next_ptr), get(hdrp(next_ptr)));
+             set_prev_alloc(hdrp(next_blkp(next_ptr)), 0);
+             coalesce(next_ptr);
          }
-         return oldptr;
+         return true;
      }
      
      // Attempt to extend block in place if the next block is free.
@@ -259,33 +720,22 @@
          size_t combined_size = oldsize + get_size(hdrp(next_ptr));
          if (combined_size >= newsize) {
              remove_from_free_list(next_ptr);
-             put(hdrp(oldptr), pack(combined_size, 1));
-             put(ftrp(oldptr), pack(combined_size, 1));
              // Split if the excess space is sufficient.
-             if (combined_size - newsize >= (4*WSIZE)) {
-                 put(hdrp(oldptr), pack(newsize, 1));
-                 put(ftrp(oldptr), pack(newsize, 1));
+             if (combined_size - newsize >= MIN_BLOCK) {
+                 put(hdrp(oldptr), pack(newsize, prev_alloc, 1));
                  
                  void *remainder = next_blkp(oldptr);
-                 put(hdrp(remainder), pack(combined_size - newsize, 0));
-                 put(ftrp(remainder), pack(combined_size - newsize, 0));
+                 put(hdrp(remainder), pack(combined_size - newsize, 1, 0));
+                 put(ftrp(remainder), get(hdrp(remainder)));
                  add_to_free_list(remainder);
+             } else {
+                 put(hdrp(oldptr), pack(combined_size, prev_alloc, 1));
+                 set_prev_alloc(hdrp(next_blkp(oldptr)), 1);
              }
-             return oldptr;
+             return true;
          }
      }
-     
-     // Otherwise, allocate a new block, copy the data, and free the old block.
-     void *newptr = malloc(size);
-     if (newptr == NULL)
-         return NULL;
-     
-     size_t copySize = oldsize - (WSIZE*2);
-     if (size < copySize)
-         copySize = size;
-     memcpy(newptr, oldptr, copySize);
-     free(oldptr);
-     return newptr;
+     return false;
  }
  
  /*
@@ -295,14 +745,160 @@
  void* calloc(size_t nmemb, size_t size)
  {
      void* ptr;
+     if (nmemb != 0 && size > SIZE_MAX / nmemb) {
+         errno = ENOMEM;
+         return NULL;
+     }
      size *= nmemb;
      ptr = malloc(size);
-     if (ptr) {
+     // a new mapping is already zeroed
+     if (ptr && !is_mapped(ptr)) {
          memset(ptr, 0, size);
      }
      return ptr;
  }
  
+ #ifndef DRIVER
+ // Shared library build
+ //  libmm.so exports the allocator in place of the C library's. The heap
+ //  comes from osmem.c, and the first call into the library sets it up.
+ 
+ #ifdef THREADS
+ // prepare_fork, after_fork: Hold every lock across fork, so the child
+ //  doesn't inherit one that a thread it lost was holding. Arena locks come
+ //  first and the heap lock last, as everywhere else.
+ 
+ static void prepare_fork(void)
+ {
+     for (int id = 0; id < MAX_ARENAS; id++) {
+         pthread_mutex_lock(&heap_state->arenas[id]->lock);
+     }
+     pthread_mutex_lock(&heap_state->lock);
+ }
+ 
+ static void after_fork(void)
+ {
+     pthread_mutex_unlock(&heap_state->lock);
+     for (int id = MAX_ARENAS - 1; id >= 0; id--) {
+         pthread_mutex_unlock(&heap_state->arenas[id]->lock);
+     }
+ }
+ #endif // THREADS
+ 
+ // init_heap: Run mm_init once. The heap is marked ready before the fork
+ //  handlers are registered, since registering them may call malloc.
+ 
+ static void init_heap(void)
+ {
+     if (!mm_init()) {
+         return;
+     }
+     __atomic_store_n(&heap_ready, true, __ATOMIC_RELEASE);
+ #ifdef THREADS
+     pthread_atfork(prepare_fork, after_fork, after_fork);
+ #endif // THREADS
+ }
+ 
+ static bool ensure_init(void)
+ {
+     if (__atomic_load_n(&heap_ready, __ATOMIC_ACQUIRE)) {
+         return true;
+     }
+ #ifdef THREADS
+     pthread_once(&heap_once, init_heap);
+ #else
+     init_heap();
+ #endif // THREADS
+     return __atomic_load_n(&heap_ready, __ATOMIC_ACQUIRE);
+ }
+ 
+ // is_foreign: Whether ptr came from someone else's allocator, such as the
+ //  blocks the dynamic loader allocated before the library took over. free,
+ //  realloc and malloc_usable_size leave those alone.
+ static bool is_foreign(void *ptr)
+ {
+     return !__atomic_load_n(&heap_ready, __ATOMIC_ACQUIRE) ||
+            (is_mapped(ptr) && !owns_mapping(ptr));
+ }
+ 
+ // memalign: Allocate size bytes whose address is a multiple of alignment,
+ //  a power of two. The heap's own alignment goes through malloc; larger
+ //  ones are carved out of a free block with room to spare.
+ void *memalign(size_t alignment, size_t size)
+ {
+     if (alignment <= ALIGNMENT) {
+         return malloc(size);
+     }
+     if ((alignment & (alignment - 1)) != 0) {
+         errno = EINVAL;
+         return NULL;
+     }
+     if (!ensure_init() || size > MAX_REQUEST || alignment > MAX_REQUEST) {
+         errno = ENOMEM;
+         return NULL;
+     }
+     
+ #ifdef THREADS
+     free_index_t *arena = attach_thread();
+     lock_arena(arena);
+     void *ptr = alloc_aligned(adjust_size(size), alignment);
+     unlock_arena(arena);
+ #else
+     void *ptr = alloc_aligned(adjust_size(size), alignment);
+ #endif // THREADS
+     if (ptr == NULL) {
+         errno = ENOMEM;
+     }
+     return ptr;
+ }
+ 
+ int posix_memalign(void **memptr, size_t alignment, size_t size)
+ {
+     if (alignment == 0 || alignment % sizeof(void *) != 0 ||
+         (alignment & (alignment - 1)) != 0) {
+         return EINVAL;
+     }
+     void *ptr = memalign(alignment, size);
+     if (ptr == NULL) {
+         return ENOMEM;
+     }
+     *memptr = ptr;
+     return 0;
+ }
+ 
+ void *aligned_alloc(size_t alignment, size_t size)
+ {
+     return memalign(alignment, size);
+ }
+ 
+ void *valloc(size_t size)
+ {
+     return memalign(mm_pagesize(), size);
+ }
+ 
+ void *pvalloc(size_t size)
+ {
+     size_t page = mm_pagesize();
+     return memalign(page, (size + page - 1) & ~(page - 1));
+ }
+ 
+ // malloc_usable_size: Payload bytes of an allocated block or slot.
+ size_t malloc_usable_size(void *ptr)
+ {
+     if (ptr == NULL || is_foreign(ptr)) {
+         return 0;
+     }
+     if (is_mapped(ptr)) {
+         return get_size(hdrp(ptr)) - 2*WSIZE;
+     }
+     slab_run_t *run = slab_run_of(ptr);
+     if (run != NULL) {
+         return run->slot_size;
+     }
+     return get_size(hdrp(ptr)) - WSIZE;
+ }
+ #endif // DRIVER
+ 
  /*
  * Returns whether the pointer is in the heap.
  * May be useful for debugging.
@@ -331,37 +927,132 @@
  bool mm_checkheap(int line_number)
  {
  #ifdef DEBUG
-     if (get_size(hdrp(heap_listp)) != WSIZE*2 || !get_alloc(hdrp(heap_listp))) {
-         dbg_printf("Line %d: Prologue header invalid\n", line_number);
-         return false;
+ #ifdef THREADS
+     // only meaningful while no other thread is using the allocator
+     free_index_t *current = free_index;
+     bool ok = true;
+     for (int id = 0; id < MAX_ARENAS && ok; id++) {
+         free_index = heap_state->arenas[id];
+         ok = check_arena(line_number);
      }
-     
-     char *ptr = heap_listp;
-     while (get_size(hdrp(ptr)) > 0) {
-         if (!aligned(ptr)) {
-             dbg_printf("Line %d: Block at %p not aligned\n", line_number, ptr);
+     free_index = current;
+     return ok;
+ #else
+     return check_arena(line_number);
+ #endif // THREADS
+ #endif // DEBUG
+     return true;
+ }
+ 
+ 
+ #ifdef DEBUG
+ // check_arena: Check every segment of the current arena block by block,
+ //  then its free lists, tree and slab runs.
+ 
+ static bool check_arena(int line_number)
+ {
+     // The free bit is what remove_from_free_list trusts: every free block in
+     // the heap must be on the list for its size, and every listed block free.
+     size_t heap_free = 0;
+     for (char *seg = free_index->segment; seg != NULL; seg = (char *)get(seg - 2*WSIZE)) {
+         if (get_size(hdrp(seg)) != WSIZE*2 || !get_alloc(hdrp(seg))) {
+             dbg_printf("Line %d: Prologue header invalid\n", line_number);
              return false;
          }
          
-         if (get(hdrp(ptr)) != get(ftrp(ptr))) {
-             dbg_printf("Line %d: Header/footer mismatch for block at %p\n", line_number, ptr);
-             return false;
+         char *ptr = next_blkp(seg);
+         int prev_alloc = 1;  // the prologue
+         while (get_size(hdrp(ptr)) > 0) {
+             if (!aligned(ptr)) {
+                 dbg_printf("Line %d: Block at %p not aligned\n", line_number, ptr);
+                 return false;
+             }
+             
+             if (get_prev_alloc(hdrp(ptr)) != prev_alloc) {
+                 dbg_printf("Line %d: Prev-alloc bit wrong for block at %p\n", line_number, ptr);
+                 return false;
+             }
+             
+             if (header_arena(hdrp(ptr)) != arena_id()) {
+                 dbg_printf("Line %d: Block at %p tagged with arena %d\n", line_number, ptr, header_arena(hdrp(ptr)));
+                 return false;
+             }
+             
+             if (!get_alloc(hdrp(ptr))) {
+                 if (get(hdrp(ptr)) != get(ftrp(ptr))) {
+                     dbg_printf("Line %d: Header/footer mismatch for block at %p\n", line_number, ptr);
+                     return false;
+                 }
+                 if (!prev_alloc) {
+                     dbg_printf("Line %d: Uncoalesced free blocks at %p\n", line_number, ptr);
+                     return false;
+                 }
+                 int fl = 0, sl = 0;
+                 if (get_size(hdrp(ptr)) < TREE_MIN) {
+                     size_class(get_size(hdrp(ptr)), &fl, &sl);
+                 }
+                 if ((get_size(hdrp(ptr)) < TREE_MIN) ? !in_free_list(ptr, fl, sl) : !in_tree(ptr)) {
+                     dbg_printf("Line %d: Free block %p missing from its list\n", line_number, ptr);
+                     return false;
+                 }
+                 heap_free++;
+             }
+             
+             prev_alloc = get_alloc(hdrp(ptr));
+             ptr = next_blkp(ptr);
          }
          
-         ptr = next_blkp(ptr);
+         if (!get_alloc(hdrp(ptr)) || get_size(hdrp(ptr)) != 0 || get_prev_alloc(hdrp(ptr)) != prev_alloc) {
+             dbg_printf("Line %d: Epilogue header invalid\n", line_number);
+             return false;
+         }
      }
      
-     if (!get_alloc(hdrp(ptr)) || get_size(hdrp(ptr)) != 0) {
-         dbg_printf("Line %d: Epilogue header invalid\n", line_number);
+     size_t listed = 0;
+     if (!check_tree(line_number, &listed)) {
          return false;
      }
- #endif // DEBUG
-     return true;
+     for (int f = 0; f < FL_COUNT; f++) {
+         for (int s = 0; s < SL_COUNT; s++) {
+             char *head = free_index->bins[f][s];
+             // the bitmaps must mark exactly the non-empty bins
+             if ((head != NULL) != ((free_index->sl_bitmap[f] >> s) & 1)) {
+                 dbg_printf("Line %d: Bitmap out of date for bin %d/%d\n", line_number, f, s);
+                 return false;
+             }
+             for (char *cur = head; cur != NULL; cur = get_succ(cur)) {
+                 int fl, sl;
+                 size_class(get_size(hdrp(cur)), &fl, &sl);
+                 if (!in_heap(cur) || get_alloc(hdrp(cur)) || fl != f || sl != s) {
+                     dbg_printf("Line %d: Bad block %p on free list %d/%d\n", line_number, cur, f, s);
+                     return false;
+                 }
+                 if (get_succ(cur) != NULL && get_pred(get_succ(cur)) != cur) {
+                     dbg_printf("Line %d: Broken pred link after %p\n", line_number, cur);
+                     return false;
+                 }
+                 listed++;
+             }
+         }
+         if ((free_index->sl_bitmap[f] != 0) != ((free_index->fl_bitmap >> f) & 1)) {
+             dbg_printf("Line %d: Row bitmap out of date for row %d\n", line_number, f);
+             return false;
+         }
+     }
+     if (listed != heap_free) {
+         dbg_printf("Line %d: %zu free blocks but %zu listed\n", line_number, heap_free, listed);
+         return false;
+     }
+     
+     return check_slabs(line_number);
  }
+ #endif // DEBUG
  
 
- // extend_heap: Extend the heap by allocating new memory.
+ // extend_heap: Extend the current arena by allocating new memory.
  // Allocates an even number of words to maintain alignment.
+ // Grows the arena's newest segment if it ends at the top of the heap, and
+ // starts a new segment otherwise.
  // Initializes a new free block and the new epilogue.
  // Coalesces with the previous block if possible.
 
@@ -371,13 +1062,37 @@
      size_t size;
      
      size = (words % 2) ? (words+1) * WSIZE : words * WSIZE;
-     if ((long)(ptr = mm_sbrk(size)) == -1) {
-         return NULL;
+     
+     lock_heap();
+     if (free_index->top == (char *)mm_heap_hi() + 1) {
+         if ((long)(ptr = mm_sbrk(size)) == -1) {
+             unlock_heap();
+             return NULL;
+         }
+         // The old epilogue header becomes the new block's header
+         put(hdrp(ptr), pack(size, get_prev_alloc(hdrp(ptr)), 0));
+         free_index->heap_bytes += size;
+     }
+     else {
+         // Start a segment: link word, prologue, then the block
+         char *base = mm_sbrk(size + 4*WSIZE);
+         if ((long)base == -1) {
+             unlock_heap();
+             return NULL;
+         }
+         put(base, (size_t)free_index->segment);       // Previous segment
+         put(base + (1*WSIZE), pack(WSIZE*2, 1, 1));    // Prologue header
+         put(base + (2*WSIZE), pack(WSIZE*2, 1, 1));    // Prologue footer
+         free_index->segment = base + 2*WSIZE;
+         ptr = base + 4*WSIZE;
+         put(hdrp(ptr), pack(size, 1, 0));
+         free_index->heap_bytes += size + 4*WSIZE;
      }
+     free_index->top = (char *)mm_heap_hi() + 1;
+     unlock_heap();
      
-     put(hdrp(ptr), pack(size, 0));         // Free block header
-     put(ftrp(ptr), pack(size, 0));           // Free block footer
-     put(hdrp(next_blkp(ptr)), pack(0, 1));   // New epilogue header
+     put(ftrp(ptr), get(hdrp(ptr)));              // Free block footer
+     put(hdrp(next_blkp(ptr)), pack(0, 0, 1));    // New epilogue header
      
      return coalesce(ptr);
  }
@@ -386,11 +1101,13 @@
  // coalesce: Merge adjacent free blocks.
  //  Checks if the previous and/or next blocks are free and merges accordingly.
  //  Updates block headers, footers, and free lists.
+ //  Free blocks never sit next to each other, so the merged block's previous
+ //  block is always allocated.
 
  static void *coalesce(void *ptr)
  {
-     size_t prev_alloc = get_alloc(ftrp(prev_blkp(ptr))) || prev_blkp(ptr) == ptr;
-     size_t next_alloc = get_alloc(hdrp(next_blkp(ptr)));
+     int prev_alloc = get_prev_alloc(hdrp(ptr));
+     int next_alloc = get_alloc(hdrp(next_blkp(ptr)));
      size_t size_val = get_size(hdrp(ptr));
      
      if (prev_alloc && next_alloc) {      // Case 1: Both neighbors allocated
@@ -402,16 +1119,16 @@
          remove_from_free_list(next_ptr);
          
          size_val += get_size(hdrp(next_ptr));
-         put(hdrp(ptr), pack(size_val, 0));
-         put(ftrp(ptr), pack(size_val, 0));
+         put(hdrp(ptr), pack(size_val, 1, 0));
+         put(ftrp(ptr), pack(size_val, 1, 0));
      }
      else if (!prev_alloc && next_alloc) { // Case 3: Previous block free
          void *prev_ptr = prev_blkp(ptr);
          remove_from_free_list(prev_ptr);
          
          size_val += get_size(hdrp(prev_ptr));
-         put(ftrp(ptr), pack(size_val, 0));
-         put(hdrp(prev_ptr), pack(size_val, 0));
+         put(ftrp(ptr), pack(size_val, 1, 0));
+         put(hdrp(prev_ptr), pack(size_val, 1, 0));
          ptr = prev_ptr;
      }
      else {                               // Case 4: Both neighbors free
@@ -421,8 +1138,8 @@
          remove_from_free_list(next_ptr);
          
          size_val += get_size(hdrp(prev_ptr)) + get_size(hdrp(next_ptr));
-         put(hdrp(prev_ptr), pack(size_val, 0));
-         put(ftrp(next_ptr), pack(size_val, 0));
+         put(hdrp(prev_ptr), pack(size_val, 1, 0));
+         put(ftrp(next_ptr), pack(size_val, 1, 0));
          ptr = prev_ptr;
      }
      
@@ -432,29 +1149,48 @@
  
  
  // find_fit: Find a free block that fits at least asize bytes.
- //  Uses a best-fit approach over segregated free lists to reduce waste.
+ //  The bin asize maps to also holds blocks smaller than asize, so a few of
+ //  its blocks are checked for the best fit. Past that, every block in a
+ //  higher bin fits, and the first non-empty one is found from the bitmaps
+ //  (good fit: it wastes less than 1/SL_COUNT of the block). With no bin
+ //  left, the tree's best fit is used.
  
  static void *find_fit(size_t asize)
  {
-     int index = get_list_index(asize);
+     if (asize >= TREE_MIN) {
+         return tree_fit(asize);
+     }
+     
+     int fl, sl;
+     size_class(asize, &fl, &sl);
+     
      void *best_ptr = NULL;
      size_t best_size = (size_t)-1;
-     
-     // Search free lists starting at the bin corresponding to asize.
-     for (int i = index; i < 11; i++) {
-         for (void *ptr = free_lists[i]; ptr != NULL; ptr = get_succ(ptr)) {
-             size_t block_size = get_size(hdrp(ptr));
-             if (block_size >= asize && block_size < best_size) {
-                 best_ptr = ptr;
-                 best_size = block_size;
-             }
+     int scanned = 0;
+     for (void *ptr = free_index->bins[fl][sl]; ptr != NULL && scanned < FIT_SCAN; ptr = get_succ(ptr)) {
+         size_t block_size = get_size(hdrp(ptr));
+         if (block_size >= asize && block_size < best_size) {
+             best_ptr = ptr;
+             best_size = block_size;
+             if (block_size == asize)
+                 break;
          }
-         // Return immediately if an exact fit is found.
-         if (best_ptr != NULL && best_size == asize)
-             return best_ptr;
+         scanned++;
      }
-     return best_ptr;
- }
+     if (best_ptr != NULL)
+         return best_ptr;
+     
+     uint32_t sl_map = (sl + 1 < SL_COUNT) ? free_index->sl_bitmap[fl] & (~0u << (sl + 1)) : 0;
+     if (sl_map == 0) {
+         uint64_t fl_map = (fl + 1 < FL_COUNT) ? free_index->fl_bitmap & (~0ull << (fl + 1)) : 0;
+         if (fl_map == 0)
+             return tree_fit(asize);
+         fl = __builtin_ctzll(fl_map);
+         sl_map = free_index->sl_bitmap[fl];
+     }
+     sl = __builtin_ctz(sl_map);
+     return free_index->bins[fl][sl];
+ }
  
  
  // place: Place a block of asize bytes into the free block pointed to by ptr.
@@ -466,88 +1202,979 @@
      
      remove_from_free_list(ptr);
      
-     if ((csize - asize) >= (4*WSIZE)) {
-         put(hdrp(ptr), pack(asize, 1));
-         put(ftrp(ptr), pack(asize, 1));
+     // a free block's previous block is always allocated
+     if ((csize - asize) >= MIN_BLOCK) {
+         put(hdrp(ptr), pack(asize, 1, 1));
          
          void *next_ptr = next_blkp(ptr);
-         put(hdrp(next_ptr), pack(csize - asize, 0));
-         put(ftrp(next_ptr), pack(csize - asize, 0));
+         put(hdrp(next_ptr), pack(csize - asize, 1, 0));
+         put(ftrp(next_ptr), pack(csize - asize, 1, 0));
          add_to_free_list(next_ptr);
      }
      else {
-         put(hdrp(ptr), pack(csize, 1));
-         put(ftrp(ptr), pack(csize, 1));
+         put(hdrp(ptr), pack(csize, 1, 1));
+         set_prev_alloc(hdrp(next_blkp(ptr)), 1);
      }
  }
  
  
- // add_to_free_list: Insert a free block into the appropriate segregated list.
+ // add_to_free_list: Insert a free block into the appropriate segregated list,
+ //  or the tree for large blocks.
  //  Uses LIFO insertion (inserting at the head).
  
  static void add_to_free_list(void *ptr)
  {
-     size_t size_val = get_size(hdrp(ptr));
-     int index = get_list_index(size_val);
+     if (get_size(hdrp(ptr)) >= TREE_MIN) {
+         tree_insert(ptr);
+         return;
+     }
+     
+     int fl, sl;
+     size_class(get_size(hdrp(ptr)), &fl, &sl);
+     char **head = &free_index->bins[fl][sl];
      
      set_pred(ptr, NULL);
-     set_succ(ptr, free_lists[index]);
+     set_succ(ptr, *head);
      
-     if (free_lists[index] != NULL) {
-         set_pred(free_lists[index], ptr);
+     if (*head != NULL) {
+         set_pred(*head, ptr);
      }
      
-     free_lists[index] = ptr;
+     *head = ptr;
+     free_index->sl_bitmap[fl] |= 1u << sl;
+     free_index->fl_bitmap |= 1ull << fl;
+ }
+ 
+ 
+ #ifdef DEBUG
+ // in_free_list: Returns whether ptr is linked into free list (fl, sl).
+ //  Linear in the list length, so only the debug build scans.
+ 
+ static bool in_free_list(void *ptr, int fl, int sl)
+ {
+     for (void *current = free_index->bins[fl][sl]; current != NULL; current = get_succ(current)) {
+         if (current == ptr) {
+             return true;
+         }
+     }
+     return false;
  }
+ #endif // DEBUG
  
  
  // remove_from_free_list: Remove a block from its segregated free list.
- //  Performs a defensive check to ensure the block is in the list.
+ //  Every block whose header has the alloc bit clear is linked into the list
+ //  for its size (add_to_free_list runs whenever a block is marked free), so
+ //  the block's own pred/succ links unlink it in O(1).
  
  static void remove_from_free_list(void *ptr)
  {
-     size_t size_val = get_size(hdrp(ptr));
-     int index = get_list_index(size_val);
+     dbg_assert(!get_alloc(hdrp(ptr)));
      
-     void *current = free_lists[index];
-     bool found = false;
-     while (current != NULL) {
-         if (current == ptr) {
-             found = true;
+     if (get_size(hdrp(ptr)) >= TREE_MIN) {
+         tree_remove(ptr);
+         return;
+     }
+     
+     int fl, sl;
+     size_class(get_size(hdrp(ptr)), &fl, &sl);
+     
+ #ifdef DEBUG
+     dbg_assert(in_free_list(ptr, fl, sl));
+ #endif // DEBUG
+     
+     if (get_pred(ptr) != NULL) {
+         set_succ(get_pred(ptr), get_succ(ptr));
+     } else {
+         free_index->bins[fl][sl] = get_succ(ptr);
+         // the bin is empty once its head goes
+         if (free_index->bins[fl][sl] == NULL) {
+             free_index->sl_bitmap[fl] &= ~(1u << sl);
+             if (free_index->sl_bitmap[fl] == 0) {
+                 free_index->fl_bitmap &= ~(1ull << fl);
+             }
+         }
+     }
+     
+     if (get_succ(ptr) != NULL) {
+         set_pred(get_succ(ptr), get_pred(ptr));
+     }
+ }
+ 
+ 
+ // size_class: Map a block size below TREE_MIN to its free list bin (fl, sl).
+ //  Sizes below SMALL_LIMIT get one bin per 16 bytes in row 0. Larger sizes
+ //  use row log2(size) - 7 and the SL_BITS bits below the leading one.
+ //  A request of TREE_MIN or more maps to the last bin, which find_fit then
+ //  finds empty.
+ 
+ static void size_class(size_t size, int *fl, int *sl)
+ {
+     if (size < SMALL_LIMIT) {
+         *fl = 0;
+         *sl = (int)(size / ALIGNMENT);
+         return;
+     }
+     int log2 = 63 - __builtin_clzll(size);
+     *fl = log2 - (SL_BITS + 4) + 1;
+     *sl = (int)((size >> (log2 - SL_BITS)) & (SL_COUNT - 1));
+     if (*fl >= FL_COUNT) {
+         *fl = FL_COUNT - 1;
+         *sl = SL_COUNT - 1;
+     }
+ }
+ 
+ 
+ 
+ // Free block tree
+ //  A tree node reuses the free block's pred/succ words for its list of
+ //  equal-sized blocks and keeps its children in the next two words. Only the
+ //  list head is in the tree, and its pred is NULL; list members have a pred.
+ //  The tree is a top-down splay tree keyed on block size: every operation
+ //  splays the size it looks for to the root.
+ 
+ static inline void *get_left(void *ptr) {
+     return *(char **)((char *)ptr + 2*WSIZE);
+ }
+ 
+ static inline void *get_right(void *ptr) {
+     return *(char **)((char *)ptr + 3*WSIZE);
+ }
+ 
+ static inline void set_left(void *ptr, void *val) {
+     *(char **)((char *)ptr + 2*WSIZE) = val;
+ }
+ 
+ static inline void set_right(void *ptr, void *val) {
+     *(char **)((char *)ptr + 3*WSIZE) = val;
+ }
+ 
+ 
+ // splay: Splay the node for key, or the last node on its search path (the
+ //  closest size above or below it), to the root of tree t and return it.
+ 
+ static void *splay(void *t, size_t key)
+ {
+     if (t == NULL) {
+         return NULL;
+     }
+     
+     char header[4*WSIZE];   // left/right at the same offsets as a tree node
+     void *l = header;       // largest node of the left tree being assembled
+     void *r = header;       // smallest node of the right tree
+     set_left(header, NULL);
+     set_right(header, NULL);
+     
+     for (;;) {
+         size_t size = get_size(hdrp(t));
+         if (key < size) {
+             if (get_left(t) == NULL)
+                 break;
+             if (key < get_size(hdrp(get_left(t)))) {   // rotate right
+                 void *y = get_left(t);
+                 set_left(t, get_right(y));
+                 set_right(y, t);
+                 t = y;
+                 if (get_left(t) == NULL)
+                     break;
+             }
+             set_left(r, t);                            // link right
+             r = t;
+             t = get_left(t);
+         }
+         else if (key > size) {
+             if (get_right(t) == NULL)
+                 break;
+             if (key > get_size(hdrp(get_right(t)))) {  // rotate left
+                 void *y = get_right(t);
+                 set_right(t, get_left(y));
+                 set_left(y, t);
+                 t = y;
+                 if (get_right(t) == NULL)
+                     break;
+             }
+             set_right(l, t);                           // link left
+             l = t;
+             t = get_right(t);
+         }
+         else {
              break;
          }
-         current = get_succ(current);
      }
-     if (!found) {
+     
+     set_right(l, get_left(t));                         // assemble
+     set_left(r, get_right(t));
+     set_left(t, get_right(header));
+     set_right(t, get_left(header));
+     return t;
+ }
+ 
+ 
+ // tree_insert: Add a free block to the tree, or to the list of the node of
+ //  its size if there is one.
+ 
+ static void tree_insert(void *ptr)
+ {
+     size_t size = get_size(hdrp(ptr));
+     void *root = splay(free_index->tree_root, size);
+     free_index->tree_bytes += size;
+     
+     if (root != NULL && get_size(hdrp(root)) == size) {
+         set_pred(ptr, root);
+         set_succ(ptr, get_succ(root));
+         if (get_succ(root) != NULL) {
+             set_pred(get_succ(root), ptr);
+         }
+         set_succ(root, ptr);
+         free_index->tree_root = root;
          return;
      }
      
+     set_pred(ptr, NULL);
+     set_succ(ptr, NULL);
+     if (root == NULL) {
+         set_left(ptr, NULL);
+         set_right(ptr, NULL);
+     }
+     else if (size < get_size(hdrp(root))) {
+         set_left(ptr, get_left(root));
+         set_right(ptr, root);
+         set_left(root, NULL);
+     }
+     else {
+         set_right(ptr, get_right(root));
+         set_left(ptr, root);
+         set_right(root, NULL);
+     }
+     free_index->tree_root = ptr;
+ }
+ 
+ 
+ // tree_remove: Take a free block out of the tree.
+ //  A list member unlinks in O(1). A node hands its place to the next block
+ //  of its size, or if it was the last, is replaced by its predecessor.
+ 
+ static void tree_remove(void *ptr)
+ {
+     free_index->tree_bytes -= get_size(hdrp(ptr));
      if (get_pred(ptr) != NULL) {
          set_succ(get_pred(ptr), get_succ(ptr));
+         if (get_succ(ptr) != NULL) {
+             set_pred(get_succ(ptr), get_pred(ptr));
+         }
+         return;
+     }
+     
+     size_t size = get_size(hdrp(ptr));
+     void *root = splay(free_index->tree_root, size);
+     dbg_assert(root == ptr);
+     
+     void *next = get_succ(root);
+     if (next != NULL) {
+         set_pred(next, NULL);
+         set_left(next, get_left(root));
+         set_right(next, get_right(root));
+         free_index->tree_root = next;
+     }
+     else if (get_left(root) == NULL) {
+         free_index->tree_root = get_right(root);
+     }
+     else {
+         // every key on the left is smaller, so this splays its maximum up
+         void *left = splay(get_left(root), size);
+         set_right(left, get_right(root));
+         free_index->tree_root = left;
+     }
+ }
+ 
+ 
+ // tree_fit: Return the smallest free block in the tree of at least asize
+ //  bytes, or NULL. A list member is preferred so the caller's removal
+ //  doesn't have to restructure the tree.
+ 
+ static void *tree_fit(size_t asize)
+ {
+     void *root = splay(free_index->tree_root, asize);
+     free_index->tree_root = root;
+     if (root == NULL) {
+         return NULL;
+     }
+     
+     // root is asize's closest neighbour; if it is too small, the fit is
+     // the smallest node above it
+     void *fit = root;
+     if (get_size(hdrp(root)) < asize) {
+         fit = get_right(root);
+         if (fit == NULL) {
+             return NULL;
+         }
+         while (get_left(fit) != NULL) {
+             fit = get_left(fit);
+         }
+     }
+     return (get_succ(fit) != NULL) ? get_succ(fit) : fit;
+ }
+ 
+ 
+ #ifdef DEBUG
+ // in_tree: Returns whether ptr is a node of the tree or on a node's list.
+ //  Searches without splaying, so the checker leaves the tree as it was.
+ 
+ static bool in_tree(void *ptr)
+ {
+     size_t size = get_size(hdrp(ptr));
+     void *node = free_index->tree_root;
+     while (node != NULL && get_size(hdrp(node)) != size) {
+         node = (size < get_size(hdrp(node))) ? get_left(node) : get_right(node);
+     }
+     for (; node != NULL; node = get_succ(node)) {
+         if (node == ptr) {
+             return true;
+         }
+     }
+     return false;
+ }
+ 
+ 
+ // check_subtree: Check the subtree at node holds sizes strictly between lo
+ //  and hi, with well-formed lists, and add its blocks to *count.
+ 
+ static bool check_subtree(int line_number, void *node, size_t lo, size_t hi, size_t *count)
+ {
+     if (node == NULL) {
+         return true;
+     }
+     size_t size = get_size(hdrp(node));
+     if (!in_heap(node) || get_alloc(hdrp(node)) || size < TREE_MIN || size <= lo || size >= hi ||
+         get_pred(node) != NULL) {
+         dbg_printf("Line %d: Bad tree node %p\n", line_number, node);
+         return false;
+     }
+     for (void *cur = node; cur != NULL; cur = get_succ(cur)) {
+         if (get_alloc(hdrp(cur)) || get_size(hdrp(cur)) != size ||
+             (get_succ(cur) != NULL && get_pred(get_succ(cur)) != cur)) {
+             dbg_printf("Line %d: Bad block %p on tree list of %p\n", line_number, cur, node);
+             return false;
+         }
+         (*count)++;
+     }
+     return check_subtree(line_number, get_left(node), lo, size, count) &&
+            check_subtree(line_number, get_right(node), size, hi, count);
+ }
+ 
+ 
+ // check_tree: Check the tree is ordered by size and count its blocks.
+ 
+ static bool check_tree(int line_number, size_t *count)
+ {
+     return check_subtree(line_number, free_index->tree_root, 0, (size_t)-1, count);
+ }
+ #endif // DEBUG
+
+ 
+ 
+ // Slab runs
+ //  A run's slots follow its RUN_HEADER bytes of metadata and end where the
+ //  next heap block's header starts. Runs with a free slot are linked into
+ //  runs[class]; full runs are reachable only through their slots.
+ 
+ static int slab_class(size_t slot_size)
+ {
+     return (int)(slot_size / ALIGNMENT) - 1;
+ }
+ 
+ static uint32_t slab_slots(size_t slot_size)
+ {
+     return (uint32_t)((RUN_SIZE - WSIZE - RUN_HEADER) / slot_size);
+ }
+ 
+ // Index of the RUN_SIZE page holding ptr, counted from the start of the heap.
+ static size_t page_index(const void *ptr)
+ {
+     return (size_t)((const char *)ptr - (const char *)heap_state) / RUN_SIZE;
+ }
+ 
+ // The page map is read without locks: a thread freeing a slot reads the bit
+ // of a run that can't go away under it. Updates hold the heap lock, and a
+ // map that is replaced is only freed in the single-threaded build.
+ static bool page_is_run(size_t page)
+ {
+     uint64_t *map = __atomic_load_n(&heap_state->page_map, __ATOMIC_ACQUIRE);
+     return map != NULL && page < map[0] &&
+            ((__atomic_load_n(&map[1 + page / 64], __ATOMIC_RELAXED) >> (page % 64)) & 1);
+ }
+ 
+ // Mark or clear page as holding a run. The map must cover it.
+ static void mark_page(size_t page, bool is_run)
+ {
+     lock_heap();
+     uint64_t *word = &heap_state->page_map[1 + page / 64];
+     if (is_run) {
+         __atomic_fetch_or(word, 1ull << (page % 64), __ATOMIC_RELAXED);
      } else {
-         free_lists[index] = get_succ(ptr);
+         __atomic_fetch_and(word, ~(1ull << (page % 64)), __ATOMIC_RELAXED);
      }
+     unlock_heap();
+ }
+ 
+ // slab_run_of: Return the run holding slot ptr, or NULL if ptr is a heap block.
+ //  A run's page holds nothing but the run, so any pointer into it is a slot.
+ 
+ static void *slab_run_of(void *ptr)
+ {
+     size_t page = page_index(ptr);
+     if (!page_is_run(page)) {
+         return NULL;
+     }
+     return (char *)heap_state + page * RUN_SIZE;
+ }
+ 
+ 
+ // grow_page_map: Make the page map cover page, doubling it as needed.
+ //  The map is an ordinary heap block of the current arena, never a mapping
+ //  of its own, since it is released with heap_free. If another
+ //  arena replaced the map meanwhile, the new one is dropped and the check
+ //  starts over.
+ 
+ static bool grow_page_map(size_t page)
+ {
+     for (;;) {
+         uint64_t *old = __atomic_load_n(&heap_state->page_map, __ATOMIC_ACQUIRE);
+         size_t pages = (old != NULL) ? old[0] : 0;
+         if (page < pages) {
+             return true;
+         }
+         
+         size_t new_pages = (pages != 0) ? pages : PAGE_MAP_MIN;
+         while (new_pages <= page) {
+             new_pages *= 2;
+         }
+         size_t bytes = WSIZE + new_pages / 8;
+         uint64_t *map = heap_malloc(bytes, false);
+         if (map == NULL) {
+             return false;
+         }
+         
+         lock_heap();
+         if (heap_state->page_map != old) {
+             unlock_heap();
+             heap_free(map);
+             continue;
+         }
+         memset(map, 0, bytes);
+         map[0] = new_pages;
+         if (old != NULL) {
+             memcpy(map + 1, old + 1, pages / 8);
+         }
+         __atomic_store_n(&heap_state->page_map, map, __ATOMIC_RELEASE);
+         unlock_heap();
+ #ifndef THREADS
+         if (old != NULL) {
+             heap_free(old);
+         }
+ #endif // THREADS
+         return true;
+     }
+ }
+ 
+ 
+ // alloc_aligned: Carve an allocated block of asize bytes whose payload is
+ //  aligned to 'alignment' (a power of two) out of a free block big enough
+ //  to hold it at any offset. The space before and after it goes back on
+ //  the free lists.
+ 
+ static void *alloc_aligned(size_t asize, size_t alignment)
+ {
+     size_t need = asize + alignment + MIN_BLOCK;
+     char *ptr = find_fit(need);
+     if (ptr == NULL) {
+         ptr = extend_heap(((need > CHUNKSIZE) ? need : CHUNKSIZE) / WSIZE);
+         if (ptr == NULL) {
+             return NULL;
+         }
+     }
+     remove_from_free_list(ptr);
      
-     if (get_succ(ptr) != NULL) {
-         set_pred(get_succ(ptr), get_pred(ptr));
+     size_t csize = get_size(hdrp(ptr));
+     size_t offset = (size_t)ptr % alignment;
+     size_t lead = (offset != 0) ? alignment - offset : 0;
+     if (lead != 0 && lead < MIN_BLOCK) {
+         lead += alignment;
+     }
+     
+     // a free block's previous block is always allocated
+     char *block = ptr + lead;
+     if (lead != 0) {
+         put(hdrp(ptr), pack(lead, 1, 0));
+         put(ftrp(ptr), get(hdrp(ptr)));
+         add_to_free_list(ptr);
+     }
+     
+     size_t rest = csize - lead - asize;
+     if (rest >= MIN_BLOCK) {
+         put(hdrp(block), pack(asize, lead == 0, 1));
+         
+         void *next_ptr = next_blkp(block);
+         put(hdrp(next_ptr), pack(rest, 1, 0));
+         put(ftrp(next_ptr), get(hdrp(next_ptr)));
+         add_to_free_list(next_ptr);
+     }
+     else {
+         put(hdrp(block), pack(asize + rest, lead == 0, 1));
+         set_prev_alloc(hdrp(next_blkp(block)), 1);
+     }
+     return block;
+ }
+ 
+ 
+ // alloc_run_block: Carve an allocated block of RUN_SIZE whose payload starts
+ //  on a page boundary. The heap starts page aligned, so page boundaries are
+ //  RUN_SIZE-aligned addresses.
+ 
+ static void *alloc_run_block(void)
+ {
+     return alloc_aligned(RUN_SIZE, RUN_SIZE);
+ }
+ 
+ 
+ static void link_run(slab_run_t *run, int c)
+ {
+     run->prev = NULL;
+     run->next = free_index->runs[c];
+     if (run->next != NULL) {
+         run->next->prev = run;
+     }
+     free_index->runs[c] = run;
+ }
+ 
+ static void unlink_run(slab_run_t *run, int c)
+ {
+     if (run->prev != NULL) {
+         run->prev->next = run->next;
+     } else {
+         free_index->runs[c] = run->next;
+     }
+     if (run->next != NULL) {
+         run->next->prev = run->prev;
+     }
+ }
+ 
+ 
+ // new_run: Set up an empty run for class c and link it in.
+ 
+ static slab_run_t *new_run(int c)
+ {
+     slab_run_t *run = alloc_run_block();
+     if (run == NULL) {
+         return NULL;
+     }
+     size_t page = page_index(run);
+     if (!grow_page_map(page)) {
+         heap_free(run);
+         return NULL;
+     }
+     mark_page(page, true);
+     
+     run->slot_size = (uint32_t)((c + 1) * ALIGNMENT);
+     run->nfree = slab_slots(run->slot_size);
+     memset(run->free_map, 0, sizeof(run->free_map));
+     for (uint32_t i = 0; i < run->nfree; i++) {
+         run->free_map[i / 64] |= 1ull << (i % 64);
+     }
+     link_run(run, c);
+     return run;
+ }
+ 
+ 
+ // slab_malloc: Take the lowest free slot of the first run of size's class.
+ 
+ static void *slab_malloc(size_t size)
+ {
+     int c = slab_class(align(size));
+     slab_run_t *run = free_index->runs[c];
+     if (run == NULL && (run = new_run(c)) == NULL) {
+         return NULL;
+     }
+     
+     int w = 0;
+     while (run->free_map[w] == 0) {
+         w++;
+     }
+     int bit = __builtin_ctzll(run->free_map[w]);
+     run->free_map[w] &= ~(1ull << bit);
+     if (--run->nfree == 0) {
+         unlink_run(run, c);
+     }
+     return (char *)run + RUN_HEADER + (size_t)(w*64 + bit) * run->slot_size;
+ }
+ 
+ 
+ // slab_free: Return slot ptr to its run.
+ //  A run that empties goes back to the heap unless it is the class's last
+ //  run with free slots, which is kept so alternating malloc/free of one slot
+ //  doesn't create and release a run each time.
+ 
+ static void slab_free(void *run_ptr, void *ptr)
+ {
+     slab_run_t *run = run_ptr;
+     int c = slab_class(run->slot_size);
+     size_t slot = (size_t)((char *)ptr - (char *)run - RUN_HEADER) / run->slot_size;
+     
+     dbg_assert(((char *)ptr - (char *)run - RUN_HEADER) % run->slot_size == 0);
+     dbg_assert(!((run->free_map[slot / 64] >> (slot % 64)) & 1));
+     
+     run->free_map[slot / 64] |= 1ull << (slot % 64);
+     if (run->nfree++ == 0) {
+         link_run(run, c);
+     }
+     
+     if (run->nfree == slab_slots(run->slot_size) &&
+         (run->prev != NULL || run->next != NULL)) {
+         unlink_run(run, c);
+         mark_page(page_index(run), false);
+         heap_free(run);
+     }
+ }
+ 
+ 
+ #ifdef DEBUG
+ // check_slabs: Every page marked in the page map must hold an allocated run
+ //  whose free count matches its bitmap. The current arena's runs must be
+ //  linked into their class's list exactly when they have a free slot.
+ 
+ static bool check_slabs(int line_number)
+ {
+     size_t partial = 0;
+     size_t pages = (heap_state->page_map != NULL) ? heap_state->page_map[0] : 0;
+     for (size_t page = 0; page < pages; page++) {
+         if (!page_is_run(page)) {
+             continue;
+         }
+         slab_run_t *run = (slab_run_t *)((char *)heap_state + page * RUN_SIZE);
+         if (!in_heap(run) || !get_alloc(hdrp(run)) || get_size(hdrp(run)) < RUN_SIZE) {
+             dbg_printf("Line %d: Page %zu marked as a run but has no run block\n", line_number, page);
+             return false;
+         }
+         if (run->slot_size == 0 || run->slot_size > SLAB_LIMIT || run->slot_size % ALIGNMENT != 0) {
+             dbg_printf("Line %d: Run %p has bad slot size %u\n", line_number, run, run->slot_size);
+             return false;
+         }
+         uint32_t counted = 0;
+         for (int w = 0; w < RUN_MAP_WORDS; w++) {
+             counted += (uint32_t)__builtin_popcountll(run->free_map[w]);
+         }
+         if (counted != run->nfree || run->nfree > slab_slots(run->slot_size)) {
+             dbg_printf("Line %d: Run %p counts %u free slots, bitmap has %u\n", line_number, run, run->nfree, counted);
+             return false;
+         }
+         if (run->nfree > 0 && header_arena(hdrp(run)) == arena_id()) {
+             partial++;
+         }
+     }
+     
+     size_t listed = 0;
+     for (int c = 0; c < SLAB_CLASSES; c++) {
+         for (slab_run_t *run = free_index->runs[c]; run != NULL; run = run->next) {
+             if (!page_is_run(page_index(run)) || slab_class(run->slot_size) != c || run->nfree == 0 ||
+                 header_arena(hdrp(run)) != arena_id()) {
+                 dbg_printf("Line %d: Bad run %p on class list %d\n", line_number, run, c);
+                 return false;
+             }
+             if (run->next != NULL && run->next->prev != run) {
+                 dbg_printf("Line %d: Broken prev link after run %p\n", line_number, run);
+                 return false;
+             }
+             listed++;
+         }
+     }
+     if (listed != partial) {
+         dbg_printf("Line %d: %zu runs with free slots but %zu listed\n", line_number, partial, listed);
+         return false;
+     }
+     return true;
+ }
+ #endif // DEBUG
+
+ 
+ 
+ // Mapped blocks
+ //  A mapped block's payload starts two words into a page-aligned mapping of
+ //  its own. The first word tags the mapping with its address, the second is
+ //  an allocated header holding the mapping's length. Mapped blocks lie
+ //  outside the heap, which is how free tells them apart, and belong to no
+ //  arena; the mapping calls hold the heap lock.
+ 
+ static bool is_mapped(void *ptr)
+ {
+     return (char *)ptr < (char *)heap_state || ptr > mm_heap_hi();
+ }
+ 
+ // owns_mapping: Whether ptr outside the heap is a mapped block's payload.
+ //  Only the tag on ptr's own page is read.
+ static bool owns_mapping(void *ptr)
+ {
+     char *base = (char *)ptr - 2*WSIZE;
+     return ((size_t)ptr & (mm_pagesize() - 1)) == 2*WSIZE &&
+            get(base) == ((size_t)base ^ MAP_TAG);
+ }
+ 
+ // map_length: Page-rounded length of the mapping for a size-byte payload,
+ //  or 0 if that length doesn't fit in a size_t.
+ static size_t map_length(size_t size)
+ {
+     size_t page = mm_pagesize();
+     if (size > SIZE_MAX - 2*WSIZE - (page - 1)) {
+         return 0;
+     }
+     return (size + 2*WSIZE + page - 1) & ~(page - 1);
+ }
+ 
+ static void *tag_mapping(char *base, size_t len)
+ {
+     put(base, (size_t)base ^ MAP_TAG);
+     put(base + WSIZE, len | 1);
+     return base + 2*WSIZE;
+ }
+ 
+ static void *map_block(size_t size)
+ {
+     size_t len = map_length(size);
+     if (len == 0) {
+         return NULL;
+     }
+     lock_heap();
+     char *base = mm_map(len);
+     unlock_heap();
+     return (base != NULL) ? tag_mapping(base, len) : NULL;
+ }
+ 
+ // unmap_block: Release a mapped block. Unless the threshold is fixed, it
+ //  rises to the block's length.
+ static void unmap_block(void *ptr)
+ {
+     size_t len = get_size(hdrp(ptr));
+     dbg_assert(owns_mapping(ptr));
+     
+     lock_heap();
+     if (!heap_state->mmap_fixed && len > heap_state->mmap_threshold && len <= MMAP_THRESHOLD_MAX) {
+         __atomic_store_n(&heap_state->mmap_threshold, len, __ATOMIC_RELAXED);
+     }
+     mm_unmap((char *)ptr - 2*WSIZE, len);
+     unlock_heap();
+ }
+ 
+ // remap_block: Resize a mapped block to hold size bytes, moving it if the
+ //  mapping can't grow in place. Returns NULL, leaving it as it was, if the
+ //  size is too large to map or the kernel refuses.
+ static void *remap_block(void *ptr, size_t size)
+ {
+     size_t len = get_size(hdrp(ptr));
+     size_t new_len = map_length(size);
+     if (new_len == 0) {
+         return NULL;
+     }
+     if (new_len == len) {
+         return ptr;
+     }
+     lock_heap();
+     char *base = mm_remap((char *)ptr - 2*WSIZE, len, new_len);
+     unlock_heap();
+     return (base != NULL) ? tag_mapping(base, new_len) : NULL;
+ }
+ 
+ 
+ // Returning memory
+ 
+ // purge: Give the current arena's large free blocks back to the OS.
+ //  Trims the heap under the newest segment's last block if it is free and
+ //  large, then discards the pages of every free block of DISCARD_MIN bytes
+ //  or more between its tree words and its footer, one size at a time.
+ 
+ static void purge(void)
+ {
+     char *epilogue = free_index->top - WSIZE;
+     if (!get_prev_alloc(epilogue)) {
+         size_t size = get_size(epilogue - WSIZE);
+         if (size >= TRIM_THRESHOLD) {
+             trim_heap(free_index->top - size);
+         }
+     }
+     
+     for (char *fit = tree_fit(DISCARD_MIN); fit != NULL; ) {
+         size_t size = get_size(hdrp(fit));
+         while (get_pred(fit) != NULL) {
+             fit = get_pred(fit);  // back to the node heading the list
+         }
+         for (char *block = fit; block != NULL; block = get_succ(block)) {
+             mm_discard(block + 4*WSIZE, size - 6*WSIZE);
+         }
+         fit = tree_fit(size + ALIGNMENT);
+     }
+ }
+ 
+ // trim_heap: Cut free block ptr, the last of the newest segment, back to
+ //  TRIM_PAD bytes and shrink the heap by the rest, unless another arena
+ //  has grown the heap past the segment.
+ 
+ static void trim_heap(void *ptr)
+ {
+     size_t size = get_size(hdrp(ptr));
+     
+     lock_heap();
+     if (free_index->top != (char *)mm_heap_hi() + 1) {
+         unlock_heap();
+         return;
+     }
+     remove_from_free_list(ptr);
+     put(hdrp(ptr), pack(TRIM_PAD, get_prev_alloc(hdrp(ptr)), 0));
+     put(ftrp(ptr), get(hdrp(ptr)));
+     put(hdrp(next_blkp(ptr)), pack(0, 0, 1));    // New epilogue header
+     add_to_free_list(ptr);
+     mm_sbrk(-(intptr_t)(size - TRIM_PAD));
+     free_index->top = (char *)mm_heap_hi() + 1;
+     free_index->heap_bytes -= size - TRIM_PAD;
+     unlock_heap();
+ }
+ 
+ 
+ // Locking
+ //  The heap lock guards mm_sbrk, segment growth and page map updates, and is
+ //  only ever taken last. In the single-threaded build both are no-ops.
+ 
+ static void lock_heap(void)
+ {
+ #ifdef THREADS
+     pthread_mutex_lock(&heap_state->lock);
+ #endif // THREADS
+ }
+ 
+ static void unlock_heap(void)
+ {
+ #ifdef THREADS
+     pthread_mutex_unlock(&heap_state->lock);
+ #endif // THREADS
+ }
+ 
+ 
+ #ifdef THREADS
+ // lock_arena: Lock arena and make it the current one, then take back the
+ //  blocks other threads freed into it.
+ 
+ static void lock_arena(free_index_t *arena)
+ {
+     if (pthread_mutex_trylock(&arena->lock) != 0) {
+         pthread_mutex_lock(&arena->lock);
+         arena->contended++;
+     }
+     arena->locked++;
+     free_index = arena;
+     
+     void *ptr = __atomic_exchange_n(&arena->remote, NULL, __ATOMIC_ACQUIRE);
+     while (ptr != NULL) {
+         void *next = *(void **)ptr;
+         arena_free(ptr);
+         arena->remote_freed++;
+         ptr = next;
+     }
+ }
+ 
+ static void unlock_arena(free_index_t *arena)
+ {
+     pthread_mutex_unlock(&arena->lock);
+ }
+ 
+ 
+ // release: Return ptr to the arena it came from. This thread's own arena is
+ //  locked and freed into directly; another arena gets it on its remote list,
+ //  so the freeing thread never waits on another thread's lock.
+ 
+ static void release(void *ptr)
+ {
+     void *run = slab_run_of(ptr);
+     free_index_t *owner = heap_state->arenas[header_arena(hdrp((run != NULL) ? run : ptr))];
+     
+     if (owner == thread_arena) {
+         lock_arena(owner);
+         arena_free(ptr);
+         unlock_arena(owner);
+         return;
      }
+     
+     void *head = __atomic_load_n(&owner->remote, __ATOMIC_RELAXED);
+     do {
+         *(void **)ptr = head;
+     } while (!__atomic_compare_exchange_n(&owner->remote, &head, ptr, true,
+                                           __ATOMIC_RELEASE, __ATOMIC_RELAXED));
  }
  
  
- // get_list_index: Determine the appropriate free list bin based on block size.
+ static void tcache_push(int c, void *slot)
+ {
+     *(void **)slot = tcache.slots[c];
+     tcache.slots[c] = slot;
+     tcache.count[c]++;
+ }
  
- static int get_list_index(size_t size)
+ static void *tcache_pop(int c)
  {
-     if (size <= 32) return 0;
-     else if (size <= 64) return 1;
-     else if (size <= 128) return 2;
-     else if (size <= 256) return 3;
-     else if (size <= 512) return 4;
-     else if (size <= 1024) return 5;
-     else if (size <= 2048) return 6;
-     else if (size <= 4096) return 7;
-     else if (size <= 8192) return 8;
-     else if (size <= 16384) return 9;
-     else return 10;
+     void *slot = tcache.slots[c];
+     tcache.slots[c] = *(void **)slot;
+     tcache.count[c]--;
+     return slot;
+ }
+ 
+ 
+ // flush_tcache: Thread exit destructor; returns the thread's cached slots
+ //  unless the heap was reset since they were cached.
+ 
+ static void flush_tcache(void *unused)
+ {
+     if (thread_generation != heap_generation) {
+         return;
+     }
+     for (int c = 0; c < SLAB_CLASSES; c++) {
+         while (tcache.count[c] > 0) {
+             release(tcache_pop(c));
+         }
+     }
+ }
+ 
+ static void create_tcache_key(void)
+ {
+     pthread_key_create(&tcache_key, flush_tcache);
+ }
+ 
+ 
+ // attach_thread: Return the thread's arena, assigning arenas round-robin to
+ //  threads new to this heap (including threads from before the last mm_init,
+ //  whose cache is dropped along with that heap).
+ 
+ static free_index_t *attach_thread(void)
+ {
+     if (thread_generation != heap_generation) {
+         memset(&tcache, 0, sizeof(tcache));
+         lock_heap();
+         thread_arena = heap_state->arenas[heap_state->next_arena++ % MAX_ARENAS];
+         unlock_heap();
+         thread_generation = heap_generation;
+         pthread_setspecific(tcache_key, heap_state);
+     }
+     return thread_arena;
+ }
+ 
+ 
+ // mm_lock_stats: Sum the arenas' lock counters. The counters are only
+ //  written under their arena's lock, so the sum is exact once the threads
+ //  using the heap have stopped.
+ 
+ void mm_lock_stats(mm_lock_stats_t *stats)
+ {
+     memset(stats, 0, sizeof(*stats));
+     for (int id = 0; id < MAX_ARENAS; id++) {
+         free_index_t *arena = heap_state->arenas[id];
+         stats->locked += arena->locked;
+         stats->contended += arena->contended;
+         stats->remote_freed += arena->remote_freed;
+     }
  }
- 
\ No newline at end of file
+ #endif // THREADS
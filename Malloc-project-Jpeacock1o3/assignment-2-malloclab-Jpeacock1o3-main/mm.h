@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #ifdef DRIVER
 
@@ -17,9 +18,31 @@ extern void free (void* ptr);
 extern void* realloc(void* ptr, size_t size);
 extern void* calloc (size_t nmemb, size_t size);
 
+/* the rest of the C library's allocation interface, so a preloaded
+   libmm.so serves every allocation a program makes */
+extern void* memalign(size_t alignment, size_t size);
+extern int posix_memalign(void** memptr, size_t alignment, size_t size);
+extern void* aligned_alloc(size_t alignment, size_t size);
+extern void* valloc(size_t size);
+extern void* pvalloc(size_t size);
+extern size_t malloc_usable_size(void* ptr);
+
 #endif
 
 extern bool mm_init(void);
 
 /* This is for debugging.  Returns false if error encountered */
 extern bool mm_checkheap(int line_number);
+
+#ifdef THREADS
+
+/* Arena lock counters of the thread-safe build, summed since mm_init */
+typedef struct {
+    uint64_t locked;        /* arena lock acquisitions */
+    uint64_t contended;     /* acquisitions that had to wait */
+    uint64_t remote_freed;  /* blocks freed by a thread other than the owner's */
+} mm_lock_stats_t;
+
+extern void mm_lock_stats(mm_lock_stats_t *stats);
+
+#endif
@@ -0,0 +1,167 @@
+/*
+ * osmem.c - memlib's heap interface backed by real memory, for the
+ * shared library build of mm.c (libmm.so).
+ *
+ * The first mm_sbrk reserves OS_RESERVE bytes of address space with no
+ * access and no swap reservation. The break then moves through that range
+ * and is backed by read/write mmap chunks of OS_CHUNK bytes as it grows,
+ * so the heap stays contiguous, as mm.c requires, while only the chunks
+ * it has reached cost memory. When the break moves back down, the pages
+ * past it go back to the OS but stay mapped, so growing again is only a
+ * page fault. mm.c calls mm_sbrk under its heap lock.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+
+#include "memlib.h"
+
+#define OS_RESERVE (64UL << 30)  /* address space kept for the heap */
+#define OS_CHUNK   (1UL << 20)   /* granularity of backing the break */
+
+/* private global variables */
+static unsigned char *heap;       /* Starting address of heap */
+static unsigned char *mem_brk;    /* Current position of break */
+static unsigned char *mem_mapped; /* End of the memory backing the heap */
+
+/*
+ * os_reserve - reserve the heap's address range on first use
+ */
+static bool os_reserve(void) {
+    void *addr = mmap(NULL, OS_RESERVE, PROT_NONE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (addr == MAP_FAILED)
+        return false;
+    heap = mem_mapped = addr;
+    __atomic_store_n(&mem_brk, heap, __ATOMIC_RELEASE);
+    return true;
+}
+
+/* Returns the whole pages in lo..hi to the OS; they read as zero after */
+static void discard_pages(unsigned char *lo, unsigned char *hi) {
+    uintptr_t page = (uintptr_t) getpagesize();
+    uintptr_t start = ((uintptr_t) lo + page - 1) & ~(page - 1);
+    uintptr_t end = (uintptr_t) hi & ~(page - 1);
+    if (start < end)
+        madvise((void *) start, end - start, MADV_DONTNEED);
+}
+
+/*
+ * mm_sbrk - move the break by incr bytes and return its old position,
+ *           mapping more chunks when it passes the end of the mapped
+ *           ones. A negative incr shrinks the heap and discards the pages
+ *           past the new break.
+ */
+void *mm_sbrk(intptr_t incr) {
+    if (heap == NULL && !os_reserve()) {
+        errno = ENOMEM;
+        return (void *) -1;
+    }
+
+    unsigned char *old_brk = mem_brk;
+    if (incr < 0) {
+        if ((size_t)-incr > (size_t)(old_brk - heap)) {
+            errno = EINVAL;
+            return (void *) -1;
+        }
+        __atomic_store_n(&mem_brk, old_brk + incr, __ATOMIC_RELEASE);
+        discard_pages(old_brk + incr, old_brk + getpagesize() - 1);
+        return (void *) old_brk;
+    }
+    if ((size_t)incr > OS_RESERVE - (size_t)(old_brk - heap)) {
+        errno = ENOMEM;
+        return (void *) -1;
+    }
+
+    unsigned char *new_brk = old_brk + incr;
+    if (new_brk > mem_mapped) {
+        size_t grow = ((size_t)(new_brk - mem_mapped) + OS_CHUNK - 1) & ~(OS_CHUNK - 1);
+        if (grow > OS_RESERVE - (size_t)(mem_mapped - heap))
+            grow = OS_RESERVE - (size_t)(mem_mapped - heap);
+        if (mmap(mem_mapped, grow, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED) {
+            errno = ENOMEM;
+            return (void *) -1;
+        }
+        mem_mapped += grow;
+    }
+
+    /* readers outside the heap lock (free's pointer check) only ever see
+       a break whose memory is mapped */
+    __atomic_store_n(&mem_brk, new_brk, __ATOMIC_RELEASE);
+    return (void *) old_brk;
+}
+
+/*
+ * mm_heap_lo - return address of the first heap byte
+ */
+void *mm_heap_lo(void) {
+    return (void *) heap;
+}
+
+/*
+ * mm_heap_hi - return address of last heap byte
+ */
+void *mm_heap_hi(void) {
+    return (void *)(__atomic_load_n(&mem_brk, __ATOMIC_ACQUIRE) - 1);
+}
+
+/*
+ * mm_heapsize - returns the heap size in bytes
+ */
+size_t mm_heapsize(void) {
+    return (size_t)(__atomic_load_n(&mem_brk, __ATOMIC_ACQUIRE) - heap);
+}
+
+/*
+ * mm_pagesize - returns the page size of the system
+ */
+size_t mm_pagesize(void) {
+    return (size_t)getpagesize();
+}
+
+/*
+ * mm_discard - give the whole pages in ptr..ptr+len-1 back to the OS; they
+ *              stay mapped and read as zero when next touched
+ */
+void mm_discard(void *ptr, size_t len) {
+    discard_pages(ptr, (unsigned char *) ptr + len);
+}
+
+/*
+ * mm_map - map size bytes of zeroed, page-aligned memory outside the heap;
+ *          returns NULL on failure
+ */
+void *mm_map(size_t size) {
+    void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return (addr == MAP_FAILED) ? NULL : addr;
+}
+
+/*
+ * mm_unmap - release a mapping returned by mm_map or mm_remap
+ */
+bool mm_unmap(void *ptr, size_t size) {
+    return munmap(ptr, size) == 0;
+}
+
+/*
+ * mm_remap - resize a mapping, letting the kernel move its pages if it
+ *            can't grow in place; returns its address or NULL
+ */
+void *mm_remap(void *ptr, size_t old_size, size_t new_size) {
+    void *addr = mremap(ptr, old_size, new_size, MREMAP_MAYMOVE);
+    return (addr == MAP_FAILED) ? NULL : addr;
+}
+
+void *mm_memcpy(void *dst, const void *src, size_t n) {
+    return memcpy(dst, src, n);
+}
+
+void *mm_memset(void *dst, int c, size_t n) {
+    return memset(dst, c, n);
+}
@@ -0,0 +1,167 @@
+#define _GNU_SOURCE
+#include "affinity.h"
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    int cpu;
+    int package;
+    int core;
+    int smt_rank; // position among the hardware threads of its core
+} affinity_cpu_t;
+
+// Set once from the command line before any harness thread starts
+static enum affinity_policy policy = AFFINITY_NONE;
+static int order[CPU_SETSIZE];
+static size_t order_len;
+
+// Helper: reads an integer topology attribute of cpu, or returns fallback if it's unavailable
+static int _read_topology(int cpu, const char* attribute, int fallback)
+{
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, attribute);
+    FILE* file = fopen(path, "r");
+    if (!file) return fallback;
+    int value;
+    if (fscanf(file, "%d", &value) != 1) value = fallback;
+    fclose(file);
+    return value;
+}
+
+static int _compare_compact(const void* a, const void* b)
+{
+    const affinity_cpu_t* x = a;
+    const affinity_cpu_t* y = b;
+    if (x->package != y->package) return (x->package < y->package) ? -1 : 1;
+    if (x->core != y->core) return (x->core < y->core) ? -1 : 1;
+    return (x->cpu > y->cpu) - (x->cpu < y->cpu);
+}
+
+static int _compare_scatter(const void* a, const void* b)
+{
+    const affinity_cpu_t* x = a;
+    const affinity_cpu_t* y = b;
+    if (x->smt_rank != y->smt_rank) return (x->smt_rank < y->smt_rank) ? -1 : 1;
+    // alternate packages so consecutive threads land on different sockets
+    if (x->core != y->core) return (x->core < y->core) ? -1 : 1;
+    if (x->package != y->package) return (x->package < y->package) ? -1 : 1;
+    return (x->cpu > y->cpu) - (x->cpu < y->cpu);
+}
+
+// Helper: fills cpus with the CPUs the process may run on and their topology; returns how many there are
+static size_t _discover(affinity_cpu_t* cpus)
+{
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return 0;
+    size_t count = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET((size_t)cpu, &allowed)) continue;
+        // without topology information every CPU is its own core
+        cpus[count++] = (affinity_cpu_t){cpu, _read_topology(cpu, "physical_package_id", 0),
+                                         _read_topology(cpu, "core_id", cpu), 0};
+    }
+    // CPUs come in ascending order, so siblings seen earlier rank lower
+    for (size_t i = 0; i < count; i++) {
+        for (size_t j = 0; j < i; j++) {
+            if (cpus[j].package == cpus[i].package && cpus[j].core == cpus[i].core) cpus[i].smt_rank++;
+        }
+    }
+    return count;
+}
+
+// Helper: parses "a,b,c" into order, keeping only CPUs in cpus; returns how many were kept
+static size_t _parse_list(const char* list, const affinity_cpu_t* cpus, size_t count, int* out)
+{
+    size_t kept = 0;
+    const char* p = list;
+    while (*p) {
+        char* end;
+        long cpu = strtol(p, &end, 10);
+        if (end == p || cpu < 0 || (*end != ',' && *end != '\0')) return 0;
+        for (size_t i = 0; i < count; i++) {
+            if (cpus[i].cpu == cpu && kept < CPU_SETSIZE) {
+                out[kept++] = (int)cpu;
+                break;
+            }
+        }
+        p = (*end == ',') ? end + 1 : end;
+    }
+    return kept;
+}
+
+// Selects the policy from a spec
+bool affinity_configure(const char* spec)
+{
+    if (!spec) return false;
+    if (strcmp(spec, "none") == 0) {
+        policy = AFFINITY_NONE;
+        order_len = 0;
+        return true;
+    }
+    affinity_cpu_t* cpus = malloc(sizeof(affinity_cpu_t) * CPU_SETSIZE);
+    if (!cpus) return false;
+    size_t count = _discover(cpus);
+    int parsed[CPU_SETSIZE];
+    size_t parsed_len = 0;
+    enum affinity_policy parsed_policy;
+    if (strcmp(spec, "compact") == 0 || strcmp(spec, "scatter") == 0) {
+        parsed_policy = (spec[0] == 'c') ? AFFINITY_COMPACT : AFFINITY_SCATTER;
+        qsort(cpus, count, sizeof(affinity_cpu_t), (parsed_policy == AFFINITY_COMPACT) ? _compare_compact : _compare_scatter);
+        for (size_t i = 0; i < count; i++) {
+            parsed[parsed_len++] = cpus[i].cpu;
+        }
+    } else if (strncmp(spec, "list:", 5) == 0) {
+        parsed_policy = AFFINITY_LIST;
+        parsed_len = _parse_list(spec + 5, cpus, count, parsed);
+    } else {
+        free(cpus);
+        return false;
+    }
+    free(cpus);
+    if (parsed_len == 0) return false;
+    policy = parsed_policy;
+    memcpy(order, parsed, parsed_len * sizeof(int));
+    order_len = parsed_len;
+    return true;
+}
+
+enum affinity_policy affinity_policy(void)
+{
+    return policy;
+}
+
+// Returns the CPU thread index is pinned to
+int affinity_cpu_for(size_t index)
+{
+    if (policy == AFFINITY_NONE || order_len == 0) return -1;
+    return order[index % order_len];
+}
+
+// pthread_create that pins the new thread according to its index
+int affinity_thread_create(pthread_t* thread, void* (*start)(void*), void* arg, size_t index)
+{
+    int cpu = affinity_cpu_for(index);
+    if (cpu < 0) return pthread_create(thread, NULL, start, arg);
+    pthread_attr_t attr;
+    int status = pthread_attr_init(&attr);
+    if (status != 0) return status;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET((size_t)cpu, &set);
+    status = pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+    if (status == 0) status = pthread_create(thread, &attr, start, arg);
+    pthread_attr_destroy(&attr);
+    return status;
+}
+
+// Prints the policy and its CPU order
+void affinity_describe(FILE* out)
+{
+    static const char* names[] = {"none", "compact", "scatter", "list"};
+    fprintf(out, "affinity: %s", names[policy]);
+    for (size_t i = 0; i < order_len; i++) {
+        fprintf(out, "%s%d", i ? "," : " cpus ", order[i]);
+    }
+    fprintf(out, "\n");
+}
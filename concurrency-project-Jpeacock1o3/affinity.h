@@ -0,0 +1,42 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <pthread.h>
+
+// CPU affinity for harness and pool threads
+// Threads started through affinity_thread_create are pinned to CPUs by their index under the configured
+// policy, so repeated runs schedule the same threads on the same cores. The CPU order comes from the
+// SMT topology in /sys, restricted to the CPUs the process may run on:
+//   compact   fills a core's hardware threads before moving on, so threads 2k and 2k+1 share a core
+//             (pin producer/consumer pairs there to keep their handoffs in the core's caches)
+//   scatter   puts one thread on every physical core before using any SMT sibling
+//   list:a,b  uses the given CPUs in that order
+//   none      leaves placement to the scheduler (the default)
+// Thread i uses the (i mod n)-th CPU of the order, so more threads than CPUs wrap around.
+
+enum affinity_policy {
+    AFFINITY_NONE,
+    AFFINITY_COMPACT,
+    AFFINITY_SCATTER,
+    AFFINITY_LIST
+};
+
+// Selects the policy from a spec as described above
+// Returns false, leaving the previous configuration in place, if the spec is malformed or names no usable CPU
+bool affinity_configure(const char* spec);
+
+enum affinity_policy affinity_policy(void);
+
+// Returns the CPU thread index is pinned to, or -1 under AFFINITY_NONE
+int affinity_cpu_for(size_t index);
+
+// pthread_create that pins the new thread according to its index before it runs
+int affinity_thread_create(pthread_t* thread, void* (*start)(void*), void* arg, size_t index);
+
+// Prints the policy and its CPU order
+void affinity_describe(FILE* out);
+
+#endif // AFFINITY_H
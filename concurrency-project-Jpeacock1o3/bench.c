@@ -0,0 +1,754 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <assert.h>
+#include <stdatomic.h>
+#include "channel.h"
+#include "linked_list.h"
+#include "mpsc_queue.h"
+#include "pipeline.h"
+#include "trace.h"
+#include "channel_group.h"
+#include "affinity.h"
+#include "stress_send_recv.h"
+#include "rpc.h"
+
+// Microbenchmarks for the data structures behind the channel implementation
+// Run all benchmarks with ./bench, or a single one with ./bench <name> [iters]
+// Prefix either with --affinity=compact|scatter|list:<cpus> to pin the benchmark threads
+
+#define NS_PER_SEC 1000000000ull
+#define BENCH_DEPTH 64     // elements kept queued while measuring list operations
+#define BENCH_PRODUCERS 4  // producer threads in the cross-thread queue benchmarks
+
+// Every heap allocation made by the process is counted so benchmarks can report allocations per operation
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t count, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+static atomic_size_t bench_allocs;
+
+void* malloc(size_t size)
+{
+    atomic_fetch_add_explicit(&bench_allocs, 1, memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size)
+{
+    atomic_fetch_add_explicit(&bench_allocs, 1, memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size)
+{
+    atomic_fetch_add_explicit(&bench_allocs, 1, memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+
+size_t bench_alloc_count()
+{
+    return atomic_load_explicit(&bench_allocs, memory_order_relaxed);
+}
+
+typedef struct {
+    ilist_node_t node;
+    mpsc_node_t mpsc;
+    size_t value;
+} bench_item_t;
+
+typedef struct {
+    size_t iters;
+    bench_item_t* items;
+    mpsc_queue_t* mpsc;
+    ilist_t* list;
+    pthread_mutex_t* lock;
+} producer_args;
+
+uint64_t bench_time()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * NS_PER_SEC + (uint64_t)now.tv_nsec;
+}
+
+void bench_report(const char* name, size_t ops, uint64_t elapsed_ns)
+{
+    printf("%-32s %12zu ops %10.1f ns/op %12.0f ops/s\n", name, ops,
+           (double)elapsed_ns / (double)ops, (double)ops * (double)NS_PER_SEC / (double)elapsed_ns);
+}
+
+void bench_list(size_t iters)
+{
+    // list_insert allocates a node per call and list_remove frees it
+    list_t* list = list_create();
+    assert(list != NULL);
+    for (size_t i = 0; i < BENCH_DEPTH; i++) {
+        list_insert(list, (void*)i);
+    }
+    uint64_t start = bench_time();
+    for (size_t i = 0; i < iters; i++) {
+        list_remove(list, list_head(list));
+        list_insert(list, (void*)i);
+    }
+    uint64_t elapsed = bench_time() - start;
+    list_destroy(list);
+    bench_report(__func__, iters, elapsed);
+}
+
+void bench_ilist(size_t iters)
+{
+    // same FIFO pattern with nodes embedded in preallocated items
+    bench_item_t* items = malloc(sizeof(bench_item_t) * BENCH_DEPTH);
+    assert(items != NULL);
+    ilist_t list;
+    ilist_init(&list);
+    for (size_t i = 0; i < BENCH_DEPTH; i++) {
+        ilist_push_back(&list, &items[i].node);
+    }
+    uint64_t start = bench_time();
+    for (size_t i = 0; i < iters; i++) {
+        ilist_node_t* node = ilist_pop_front(&list);
+        ilist_entry(node, bench_item_t, node)->value = i;
+        ilist_push_back(&list, node);
+    }
+    uint64_t elapsed = bench_time() - start;
+    free(items);
+    bench_report(__func__, iters, elapsed);
+}
+
+void* mpsc_producer(void* arg)
+{
+    producer_args* args = arg;
+    for (size_t i = 0; i < args->iters; i++) {
+        mpsc_push(args->mpsc, &args->items[i].mpsc);
+    }
+    return NULL;
+}
+
+void* locked_producer(void* arg)
+{
+    producer_args* args = arg;
+    for (size_t i = 0; i < args->iters; i++) {
+        pthread_mutex_lock(args->lock);
+        ilist_push_back(args->list, &args->items[i].node);
+        pthread_mutex_unlock(args->lock);
+    }
+    return NULL;
+}
+
+// Runs BENCH_PRODUCERS producers against one consumer, either lock-free or through a mutex-protected ilist
+void bench_cross_thread(const char* name, size_t iters, bool lock_free)
+{
+    size_t total = iters * BENCH_PRODUCERS;
+    bench_item_t* items = malloc(sizeof(bench_item_t) * total);
+    assert(items != NULL);
+    mpsc_queue_t mpsc;
+    mpsc_init(&mpsc);
+    ilist_t list;
+    ilist_init(&list);
+    pthread_mutex_t lock;
+    pthread_mutex_init(&lock, NULL);
+    pthread_t pid[BENCH_PRODUCERS];
+    producer_args args[BENCH_PRODUCERS];
+
+    uint64_t start = bench_time();
+    for (size_t i = 0; i < BENCH_PRODUCERS; i++) {
+        args[i] = (producer_args){iters, &items[i * iters], &mpsc, &list, &lock};
+        pthread_create(&pid[i], NULL, lock_free ? mpsc_producer : locked_producer, &args[i]);
+    }
+    size_t popped = 0;
+    while (popped < total) {
+        if (lock_free) {
+            if (mpsc_pop(&mpsc) != NULL) popped++;
+        } else {
+            pthread_mutex_lock(&lock);
+            if (ilist_pop_front(&list) != NULL) popped++;
+            pthread_mutex_unlock(&lock);
+        }
+    }
+    uint64_t elapsed = bench_time() - start;
+    for (size_t i = 0; i < BENCH_PRODUCERS; i++) {
+        pthread_join(pid[i], NULL);
+    }
+    pthread_mutex_destroy(&lock);
+    free(items);
+    bench_report(name, total, elapsed);
+}
+
+void bench_mpsc_queue(size_t iters)
+{
+    bench_cross_thread(__func__, iters, true);
+}
+
+void bench_locked_ilist(size_t iters)
+{
+    bench_cross_thread(__func__, iters, false);
+}
+
+typedef struct {
+    channel_t* ping;
+    channel_t* pong;
+    size_t iters;
+} ping_pong_args;
+
+void* ping_pong_echo(void* arg)
+{
+    ping_pong_args* args = arg;
+    for (size_t i = 0; i < args->iters; i++) {
+        void* data;
+        enum channel_status status = channel_receive(args->ping, &data);
+        assert(status == SUCCESS);
+        status = channel_send(args->pong, data);
+        assert(status == SUCCESS);
+    }
+    return NULL;
+}
+
+// Bounces a message between two threads so nearly every send and receive blocks
+// Allocations are only counted after a warm-up round, so any steady-state allocation shows up as allocs/op > 0
+void bench_channel_ping_pong(size_t iters)
+{
+    size_t warmup = 1000;
+    ping_pong_args args = {channel_create(1), channel_create(1), warmup + iters};
+    assert(args.ping != NULL && args.pong != NULL);
+    pthread_t pid;
+    pthread_create(&pid, NULL, ping_pong_echo, &args);
+    uint64_t start = 0;
+    size_t allocs = 0;
+    for (size_t i = 0; i < warmup + iters; i++) {
+        if (i == warmup) {
+            start = bench_time();
+            allocs = bench_alloc_count();
+        }
+        void* data;
+        enum channel_status status = channel_send(args.ping, (void*)i);
+        assert(status == SUCCESS);
+        status = channel_receive(args.pong, &data);
+        assert(status == SUCCESS);
+    }
+    uint64_t elapsed = bench_time() - start;
+    allocs = bench_alloc_count() - allocs;
+    pthread_join(pid, NULL);
+    channel_close(args.ping);
+    channel_close(args.pong);
+    channel_destroy(args.ping);
+    channel_destroy(args.pong);
+    bench_report(__func__, iters, elapsed);
+    printf("%-32s %12zu allocs %9.3f allocs/op\n", __func__, allocs, (double)allocs / (double)iters);
+}
+
+#define BENCH_SENDERS 16 // contending senders in the wait-time benchmarks
+
+typedef struct {
+    channel_t* channel;
+    size_t iters;
+    uint64_t* waits; // time spent inside each channel_send
+} sender_args;
+
+void* timed_sender(void* arg)
+{
+    sender_args* args = arg;
+    for (size_t i = 0; i < args->iters; i++) {
+        uint64_t start = bench_time();
+        enum channel_status status = channel_send(args->channel, (void*)(i + 1));
+        assert(status == SUCCESS);
+        args->waits[i] = bench_time() - start;
+    }
+    return NULL;
+}
+
+int compare_u64(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+// Returns the value below which the given fraction of the sorted samples fall
+uint64_t percentile(const uint64_t* sorted, size_t count, double fraction)
+{
+    size_t index = (size_t)(fraction * (double)(count - 1));
+    return sorted[index];
+}
+
+// BENCH_SENDERS threads contend on a size 1 channel drained by this thread
+// Reports the distribution of time each send spent blocked; FIFO mode should shrink the tail
+void bench_send_wait(const char* name, size_t iters, unsigned int flags)
+{
+    size_t total = iters * BENCH_SENDERS;
+    uint64_t* waits = malloc(sizeof(uint64_t) * total);
+    assert(waits != NULL);
+    channel_t* channel = channel_create_ex(1, flags);
+    assert(channel != NULL);
+    pthread_t pid[BENCH_SENDERS];
+    sender_args args[BENCH_SENDERS];
+    uint64_t start = bench_time();
+    for (size_t i = 0; i < BENCH_SENDERS; i++) {
+        args[i] = (sender_args){channel, iters, &waits[i * iters]};
+        pthread_create(&pid[i], NULL, timed_sender, &args[i]);
+    }
+    for (size_t i = 0; i < total; i++) {
+        void* data;
+        enum channel_status status = channel_receive(channel, &data);
+        assert(status == SUCCESS);
+    }
+    uint64_t elapsed = bench_time() - start;
+    for (size_t i = 0; i < BENCH_SENDERS; i++) {
+        pthread_join(pid[i], NULL);
+    }
+    channel_close(channel);
+    channel_destroy(channel);
+    qsort(waits, total, sizeof(uint64_t), compare_u64);
+    bench_report(name, total, elapsed);
+    printf("%-32s p50 %8.1f us  p99 %8.1f us  p99.9 %8.1f us  max %8.1f us\n", name,
+           (double)percentile(waits, total, 0.5) / 1000.0, (double)percentile(waits, total, 0.99) / 1000.0,
+           (double)percentile(waits, total, 0.999) / 1000.0, (double)waits[total - 1] / 1000.0);
+    free(waits);
+}
+
+void bench_send_wait_default(size_t iters)
+{
+    bench_send_wait(__func__, iters, 0);
+}
+
+void bench_send_wait_fifo(size_t iters)
+{
+    bench_send_wait(__func__, iters, CHANNEL_FIFO);
+}
+
+// Cost of one tracepoint when channel tracing is compiled in
+void bench_trace_record(size_t iters)
+{
+    trace_record(TRACE_WAKE, NULL, 0); // the first record allocates the thread's ring
+    uint64_t start = bench_time();
+    for (size_t i = 0; i < iters; i++) {
+        trace_record(TRACE_WAKE, &iters, (uint32_t)i);
+    }
+    uint64_t elapsed = bench_time() - start;
+    trace_reset();
+    bench_report(__func__, iters, elapsed);
+}
+
+#define BENCH_CLOSE_WAITERS 256 // receivers parked on the channel when it is closed
+
+void* close_receiver(void* arg)
+{
+    void* data;
+    enum channel_status status = channel_receive(arg, &data);
+    assert(status == CLOSED_ERROR);
+    return NULL;
+}
+
+// Parks BENCH_CLOSE_WAITERS receivers on an empty channel and times closing it until all of them returned
+// Woken receivers get CLOSED_ERROR handed to them, so they don't serialize on the channel lock on the way out
+void bench_close_wakeup(size_t iters)
+{
+    pthread_t pid[BENCH_CLOSE_WAITERS];
+    uint64_t elapsed = 0;
+    for (size_t i = 0; i < iters; i++) {
+        channel_t* channel = channel_create(1);
+        assert(channel != NULL);
+        for (size_t t = 0; t < BENCH_CLOSE_WAITERS; t++) {
+            pthread_create(&pid[t], NULL, close_receiver, channel);
+        }
+        while (true) {
+            pthread_mutex_lock(&channel->lock);
+            size_t queued = ilist_count(&channel->recv_waiters);
+            pthread_mutex_unlock(&channel->lock);
+            if (queued == BENCH_CLOSE_WAITERS) break;
+            sched_yield();
+        }
+        uint64_t start = bench_time();
+        channel_close(channel);
+        for (size_t t = 0; t < BENCH_CLOSE_WAITERS; t++) {
+            pthread_join(pid[t], NULL);
+        }
+        elapsed += bench_time() - start;
+        channel_destroy(channel);
+    }
+    bench_report(__func__, iters * BENCH_CLOSE_WAITERS, elapsed);
+}
+
+// Busy-waits for roughly the given number of nanoseconds to simulate per-item work
+void bench_spin(uint64_t ns)
+{
+    uint64_t start = bench_time();
+    while (bench_time() - start < ns) {
+    }
+}
+
+typedef struct {
+    channel_t* channel;
+    atomic_bool stop;
+    atomic_size_t acked;    // control messages the consumer has seen
+    uint64_t* latencies;    // control message latency, indexed by its position
+} lane_args;
+
+void* lane_bulk_producer(void* arg)
+{
+    lane_args* args = arg;
+    while (!atomic_load(&args->stop)) {
+        if (channel_send(args->channel, NULL) != SUCCESS) break;
+    }
+    return NULL;
+}
+
+void* lane_consumer(void* arg)
+{
+    lane_args* args = arg;
+    void* data;
+    while (channel_receive(args->channel, &data) == SUCCESS) {
+        if (data) {
+            // control messages point at their send timestamp
+            uint64_t* stamp = data;
+            args->latencies[atomic_load(&args->acked)] = bench_time() - *stamp;
+            atomic_fetch_add(&args->acked, 1);
+        } else {
+            bench_spin(500); // bulk work
+        }
+    }
+    return NULL;
+}
+
+// A bulk producer keeps a 64-slot channel full while control messages are sent one at a time
+// With a single lane a control message waits behind the whole backlog; on lane 0 it skips it
+void bench_control_latency(const char* name, size_t iters, size_t lanes)
+{
+    lane_args args = {channel_create_lanes(64, lanes, 0), false, 0, malloc(sizeof(uint64_t) * iters)};
+    assert(args.channel != NULL && args.latencies != NULL);
+    pthread_t producer, consumer;
+    pthread_create(&producer, NULL, lane_bulk_producer, &args);
+    pthread_create(&consumer, NULL, lane_consumer, &args);
+    uint64_t stamp;
+    for (size_t i = 0; i < iters; i++) {
+        stamp = bench_time();
+        enum channel_status status = channel_send_priority(args.channel, &stamp, 0);
+        assert(status == SUCCESS);
+        while (atomic_load(&args.acked) <= i) {
+            sched_yield();
+        }
+    }
+    atomic_store(&args.stop, true);
+    channel_close(args.channel);
+    pthread_join(producer, NULL);
+    pthread_join(consumer, NULL);
+    channel_destroy(args.channel);
+    qsort(args.latencies, iters, sizeof(uint64_t), compare_u64);
+    printf("%-32s %12zu msgs  p50 %8.1f us  p99 %8.1f us  max %8.1f us\n", name, iters,
+           (double)percentile(args.latencies, iters, 0.5) / 1000.0,
+           (double)percentile(args.latencies, iters, 0.99) / 1000.0, (double)args.latencies[iters - 1] / 1000.0);
+    free(args.latencies);
+}
+
+void bench_control_latency_single_lane(size_t iters)
+{
+    bench_control_latency(__func__, iters, 1);
+}
+
+void bench_control_latency_priority(size_t iters)
+{
+    bench_control_latency(__func__, iters, 2);
+}
+
+#define BENCH_GROUP_MEMBERS 1024
+
+// One message at a time lands on a pseudo-random one of 1024 channels and the consumer has to find it
+// Scanning tries every channel in turn; the group finds it from its readiness mask
+void bench_group(const char* name, size_t iters, bool use_group)
+{
+    channel_t* channels[BENCH_GROUP_MEMBERS];
+    for (size_t i = 0; i < BENCH_GROUP_MEMBERS; i++) {
+        channels[i] = channel_create(1);
+        assert(channels[i] != NULL);
+    }
+    channel_group_t* group = use_group ? channel_group_create(channels, BENCH_GROUP_MEMBERS) : NULL;
+    assert(!use_group || group != NULL);
+    void* data;
+    uint64_t start = bench_time();
+    for (size_t i = 0; i < iters; i++) {
+        size_t target = (i * 7919) % BENCH_GROUP_MEMBERS;
+        enum channel_status status = channel_non_blocking_send(channels[target], NULL);
+        assert(status == SUCCESS);
+        size_t index = BENCH_GROUP_MEMBERS;
+        if (use_group) {
+            status = channel_group_receive(group, &data, &index);
+        } else {
+            for (size_t c = 0; c < BENCH_GROUP_MEMBERS; c++) {
+                status = channel_non_blocking_receive(channels[c], &data);
+                if (status == SUCCESS) {
+                    index = c;
+                    break;
+                }
+            }
+        }
+        assert(status == SUCCESS && index == target);
+    }
+    uint64_t elapsed = bench_time() - start;
+    bench_report(name, iters, elapsed);
+    channel_group_destroy(group);
+    for (size_t i = 0; i < BENCH_GROUP_MEMBERS; i++) {
+        channel_close(channels[i]);
+        channel_destroy(channels[i]);
+    }
+}
+
+void bench_group_scan(size_t iters)
+{
+    bench_group(__func__, iters, false);
+}
+
+void bench_group_mask(size_t iters)
+{
+    bench_group(__func__, iters, true);
+}
+
+// Offers iters messages per second of Poisson traffic to channels of growing capacity
+// Past the channel's saturation point the corrected percentiles keep growing while the uncorrected ones stay flat
+void bench_open_loop(size_t iters)
+{
+    size_t capacities[] = {1, 16, 256};
+    for (size_t i = 0; i < 3; i++) {
+        stress_open_loop_config_t config = {capacities[i], 2, 2, (double)iters, STRESS_ARRIVAL_POISSON, 64, 500000, 42};
+        stress_open_loop_report_t report;
+        bool ran = run_stress_open_loop(&config, &report);
+        assert(ran);
+        stress_print_open_loop(&config, &report, stdout);
+    }
+}
+
+// Fills and drains a 4M-slot (32MB) ring twice; creation prefaults a huge-page ring, so the first pass
+// over a heap ring pays the page faults the huge-page one already took
+void bench_huge_ring(const char* name, size_t iters, unsigned int flags)
+{
+    uint64_t start = bench_time();
+    channel_t* channel = channel_create_ex(iters, flags);
+    assert(channel != NULL);
+    uint64_t created = bench_time();
+    void* data;
+    for (size_t pass = 0; pass < 2; pass++) {
+        uint64_t pass_start = bench_time();
+        for (size_t i = 0; i < iters; i++) {
+            enum channel_status status = channel_non_blocking_send(channel, (void*)i);
+            assert(status == SUCCESS);
+        }
+        for (size_t i = 0; i < iters; i++) {
+            enum channel_status status = channel_non_blocking_receive(channel, &data);
+            assert(status == SUCCESS);
+        }
+        printf("%-32s pass %zu %8.1f ns/msg (create %6.1f ms, %s)\n", name, pass,
+               (double)(bench_time() - pass_start) / (double)iters, (double)(created - start) / 1e6,
+               (const char*[]){"heap", "hugetlb", "thp"}[buffer_backing(channel->buffer)]);
+    }
+    channel_close(channel);
+    channel_destroy(channel);
+}
+
+void bench_ring_heap(size_t iters)
+{
+    bench_huge_ring(__func__, iters, 0);
+}
+
+void bench_ring_huge_pages(size_t iters)
+{
+    bench_huge_ring(__func__, iters, CHANNEL_HUGE_PAGES);
+}
+
+typedef struct {
+    channel_t* reply;
+    size_t value;
+} bench_request_t;
+
+// Server for the ad-hoc pattern: every request carries its own reply channel
+void* bench_reply_channel_server(void* arg)
+{
+    channel_t* requests = arg;
+    bench_request_t* request;
+    while (channel_receive(requests, (void**)&request) == SUCCESS) {
+        channel_send(request->reply, (void*)(request->value + 1));
+    }
+    return NULL;
+}
+
+// Round trips where each call creates a reply channel, waits on it and destroys it
+void bench_rpc_reply_channel(size_t iters)
+{
+    channel_t* requests = channel_create(16);
+    assert(requests != NULL);
+    pthread_t server;
+    pthread_create(&server, NULL, bench_reply_channel_server, requests);
+    size_t allocs = bench_alloc_count();
+    uint64_t start = bench_time();
+    for (size_t i = 0; i < iters; i++) {
+        bench_request_t request = {channel_create(1), i};
+        enum channel_status status = channel_send(requests, &request);
+        assert(status == SUCCESS);
+        void* reply;
+        status = channel_receive(request.reply, &reply);
+        assert(status == SUCCESS && (size_t)reply == i + 1);
+        channel_close(request.reply);
+        channel_destroy(request.reply);
+    }
+    uint64_t elapsed = bench_time() - start;
+    allocs = bench_alloc_count() - allocs;
+    channel_close(requests);
+    pthread_join(server, NULL);
+    channel_destroy(requests);
+    bench_report(__func__, iters, elapsed);
+    printf("%-32s %12.2f allocs/call\n", "", (double)allocs / (double)iters);
+}
+
+void* bench_rpc_server(void* arg)
+{
+    rpc_t* rpc = arg;
+    rpc_call_t* calls[16];
+    void* replies[16];
+    size_t count;
+    while ((count = rpc_serve_batch(rpc, calls, 16)) > 0) {
+        for (size_t i = 0; i < count; i++) {
+            replies[i] = (void*)((size_t)rpc_call_request(calls[i]) + 1);
+        }
+        rpc_complete_batch(calls, replies, count);
+    }
+    return NULL;
+}
+
+// The same round trips through pooled reply slots
+void bench_rpc_pooled(size_t iters)
+{
+    rpc_t* rpc = rpc_create(16, 16);
+    assert(rpc != NULL);
+    pthread_t server;
+    pthread_create(&server, NULL, bench_rpc_server, rpc);
+    size_t allocs = bench_alloc_count();
+    uint64_t start = bench_time();
+    for (size_t i = 0; i < iters; i++) {
+        void* reply;
+        enum channel_status status = rpc_call(rpc, (void*)i, &reply);
+        assert(status == SUCCESS && (size_t)reply == i + 1);
+    }
+    uint64_t elapsed = bench_time() - start;
+    allocs = bench_alloc_count() - allocs;
+    rpc_close(rpc);
+    pthread_join(server, NULL);
+    rpc_destroy(rpc);
+    bench_report(__func__, iters, elapsed);
+    printf("%-32s %12.2f allocs/call\n", "", (double)allocs / (double)iters);
+}
+
+bool bench_stage_fast(void* input, void** output, void* arg)
+{
+    bench_spin(1000);
+    *output = input;
+    return true;
+}
+
+bool bench_stage_slow(void* input, void** output, void* arg)
+{
+    bench_spin(10000);
+    *output = input;
+    return true;
+}
+
+typedef struct {
+    pipeline_t* pipeline;
+    size_t iters;
+} pipeline_feed_args;
+
+void* pipeline_feed(void* arg)
+{
+    pipeline_feed_args* args = arg;
+    for (size_t i = 0; i < args->iters; i++) {
+        enum channel_status status = pipeline_push(args->pipeline, (void*)i);
+        assert(status == SUCCESS);
+    }
+    pipeline_close(args->pipeline);
+    return NULL;
+}
+
+// Unbalanced three-stage pipeline whose middle stage is ten times slower than its neighbours
+// The stage table should show backpressure on the first stage and starvation on the last one
+void bench_pipeline(size_t iters)
+{
+    pipeline_t* pipeline = pipeline_create(PIPELINE_ORDERED);
+    assert(pipeline != NULL);
+    pipeline_add_stage(pipeline, "fast_in", bench_stage_fast, NULL, 2, 16);
+    pipeline_add_stage(pipeline, "slow", bench_stage_slow, NULL, 4, 16);
+    pipeline_add_stage(pipeline, "fast_out", bench_stage_fast, NULL, 2, 16);
+    enum channel_status status = pipeline_start(pipeline, 16);
+    assert(status == SUCCESS);
+    pipeline_feed_args args = {pipeline, iters};
+    pthread_t pid;
+    uint64_t start = bench_time();
+    pthread_create(&pid, NULL, pipeline_feed, &args);
+    void* data;
+    size_t popped = 0;
+    while (pipeline_pop(pipeline, &data) == SUCCESS) {
+        popped++;
+    }
+    uint64_t elapsed = bench_time() - start;
+    pthread_join(pid, NULL);
+    assert(popped == iters);
+    bench_report(__func__, iters, elapsed);
+    pipeline_print_stats(pipeline, stdout);
+    pipeline_destroy(pipeline);
+}
+
+typedef void (*bench_fn_t)(size_t iters);
+typedef struct {
+    char* name;
+    bench_fn_t bench;
+    size_t iters;
+} bench_t;
+
+bench_t benches[] = {{"bench_list", bench_list, 10000000},
+                     {"bench_ilist", bench_ilist, 10000000},
+                     {"bench_mpsc_queue", bench_mpsc_queue, 2000000},
+                     {"bench_locked_ilist", bench_locked_ilist, 2000000},
+                     {"bench_channel_ping_pong", bench_channel_ping_pong, 200000},
+                     {"bench_send_wait_default", bench_send_wait_default, 20000},
+                     {"bench_send_wait_fifo", bench_send_wait_fifo, 20000},
+                     {"bench_pipeline", bench_pipeline, 20000},
+                     {"bench_close_wakeup", bench_close_wakeup, 20},
+                     {"bench_trace_record", bench_trace_record, 10000000},
+                     {"bench_control_latency_single_lane", bench_control_latency_single_lane, 2000},
+                     {"bench_control_latency_priority", bench_control_latency_priority, 2000},
+                     {"bench_group_scan", bench_group_scan, 200000},
+                     {"bench_group_mask", bench_group_mask, 200000},
+                     {"bench_open_loop", bench_open_loop, 100000},
+                     {"bench_ring_heap", bench_ring_heap, 4 << 20},
+                     {"bench_ring_huge_pages", bench_ring_huge_pages, 4 << 20},
+                     {"bench_rpc_reply_channel", bench_rpc_reply_channel, 200000},
+                     {"bench_rpc_pooled", bench_rpc_pooled, 200000},
+};
+
+size_t num_benches = sizeof(benches)/sizeof(benches[0]);
+
+int main(int argc, char** argv) {
+    // leading --affinity=<policy> options pin the harness threads (see affinity.h)
+    while (argc > 1 && strncmp(argv[1], "--affinity=", 11) == 0) {
+        if (!affinity_configure(argv[1] + 11)) {
+            printf("Invalid affinity %s\n", argv[1] + 11);
+            return 1;
+        }
+        affinity_describe(stdout);
+        argc--;
+        argv++;
+    }
+    if (argc == 1) {
+        for (size_t i = 0; i < num_benches; i++) {
+            benches[i].bench(benches[i].iters);
+        }
+        return 0;
+    }
+    for (size_t i = 0; i < num_benches; i++) {
+        if (strcmp(argv[1], benches[i].name) == 0) {
+            benches[i].bench(argc > 2 ? (size_t)atol(argv[2]) : benches[i].iters);
+            return 0;
+        }
+    }
+    printf("Did not find benchmark\n");
+    return 1;
+}
@@ -1,10 +1,62 @@
 #include "buffer.h"
+#include <sys/mman.h>
+#include <unistd.h>
+#include <stdint.h>
 
 // Creates a buffer with the given capacity
 buffer_t* buffer_create(size_t capacity)
+{
+    return buffer_create_ex(capacity, 0);
+}
+
+// Maps bytes (a multiple of the huge page size) for a ring and faults every page in
+// Returns NULL if neither hugetlbfs nor an ordinary mapping is available
+static void** map_huge(size_t bytes, enum buffer_backing* backing)
+{
+    void* data = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+    if (data != MAP_FAILED) {
+        *backing = BUFFER_HUGETLB;
+        return data;
+    }
+    // no reserved huge pages: over-map so the ring can start on a 2MB boundary, which THP needs
+    size_t span = bytes + BUFFER_HUGE_PAGE_SIZE;
+    char* raw = mmap(NULL, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) return NULL;
+    char* aligned = (char*)(((uintptr_t)raw + BUFFER_HUGE_PAGE_SIZE - 1) & ~(BUFFER_HUGE_PAGE_SIZE - 1));
+    if (aligned > raw) munmap(raw, (size_t)(aligned - raw));
+    size_t tail = (size_t)(raw + span - (aligned + bytes));
+    if (tail > 0) munmap(aligned + bytes, tail);
+    // advice only; where THP is disabled this still prefaults ordinary pages
+    madvise(aligned, bytes, MADV_HUGEPAGE);
+    long page = sysconf(_SC_PAGESIZE);
+    for (size_t offset = 0; offset < bytes; offset += (size_t)page) {
+        aligned[offset] = 0;
+    }
+    *backing = BUFFER_THP;
+    return (void**)aligned;
+}
+
+// Creates a buffer with the given capacity and buffer_flags
+buffer_t* buffer_create_ex(size_t capacity, unsigned int flags)
 {
     buffer_t* buffer = (buffer_t*) malloc(sizeof(buffer_t));
-    void** data  = (void**) malloc(capacity * sizeof(void*));
+    if (!buffer) return NULL;
+    size_t bytes = capacity * sizeof(void*);
+    void** data = NULL;
+    buffer->backing = BUFFER_HEAP;
+    buffer->mapped = 0;
+    if ((flags & BUFFER_HUGE_PAGES) && bytes >= BUFFER_HUGE_PAGE_SIZE) {
+        size_t rounded = (bytes + BUFFER_HUGE_PAGE_SIZE - 1) & ~(BUFFER_HUGE_PAGE_SIZE - 1);
+        data = map_huge(rounded, &buffer->backing);
+        if (data) buffer->mapped = rounded;
+    }
+    if (!data) {
+        data = (void**) malloc(capacity * sizeof(void*));
+        if (!data && capacity > 0) {
+            free(buffer);
+            return NULL;
+        }
+    }
     buffer->size = 0;
     buffer->next = 0;
     buffer->capacity = capacity;
@@ -49,7 +101,11 @@ enum buffer_status buffer_remove(buffer_t* buffer, void **data)
 // Frees the memory allocated to the buffer
 void buffer_free(buffer_t *buffer)
 {
-    free(buffer->data);
+    if (buffer->mapped) {
+        munmap(buffer->data, buffer->mapped);
+    } else {
+        free(buffer->data);
+    }
     free(buffer);
 }
 
@@ -59,6 +115,12 @@ size_t buffer_capacity(buffer_t* buffer)
     return buffer->capacity;
 }
 
+// Returns where the buffer's slots live
+enum buffer_backing buffer_backing(buffer_t* buffer)
+{
+    return buffer->backing;
+}
+
 // Returns the current number of elements in the buffer
 size_t buffer_current_size(buffer_t* buffer)
 {
@@ -3,11 +3,20 @@
 
 #include <stdlib.h>
 
+// Where a buffer's slots live
+enum buffer_backing {
+    BUFFER_HEAP,     // malloc
+    BUFFER_HUGETLB,  // explicit 2MB pages from the hugetlbfs pool
+    BUFFER_THP       // anonymous mapping the kernel is asked to back with transparent huge pages
+};
+
 typedef struct {
     size_t size;
     size_t next;
     size_t capacity;
     void** data;
+    enum buffer_backing backing;
+    size_t mapped;   // bytes mapped for data, 0 when it came from malloc
 } buffer_t;
 
 enum buffer_status {
@@ -15,9 +24,22 @@ enum buffer_status {
     BUFFER_ERROR = -1
 };
 
+// Options for buffer_create_ex
+enum buffer_flags {
+    // Back the slots with 2MB pages and fault them all in now, so a large ring costs few TLB entries and
+    // takes no page faults once it's in use. Falls back from hugetlbfs to transparent huge pages to malloc;
+    // rings smaller than a huge page always use malloc.
+    BUFFER_HUGE_PAGES = 1 << 0,
+};
+
+#define BUFFER_HUGE_PAGE_SIZE (2ul << 20)
+
 // Creates a buffer with the given capacity
 buffer_t* buffer_create(size_t capacity);
 
+// Creates a buffer with the given capacity and buffer_flags; returns NULL if out of memory
+buffer_t* buffer_create_ex(size_t capacity, unsigned int flags);
+
 // Adds the value into the buffer
 // Returns BUFFER_SUCCESS if the buffer is not full and value was added
 // Returns BUFFER_ERROR otherwise
@@ -34,6 +56,9 @@ void buffer_free(buffer_t* buffer);
 // Returns the total capacity of the buffer
 size_t buffer_capacity(buffer_t* buffer);
 
+// Returns where the buffer's slots live
+enum buffer_backing buffer_backing(buffer_t* buffer);
+
 // Returns the current number of elements in the buffer
 size_t buffer_current_size(buffer_t* buffer);
 
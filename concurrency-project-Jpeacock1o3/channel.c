@@ -1,44 +1,265 @@
 #include "channel.h"
 #include "buffer.h"
+#include "trace.h"
+#include "channel_group.h"
 #include <stdlib.h>
+#include <stdint.h>
 
 // Creates a new channel with the provided size and returns it to the caller
 channel_t* channel_create(size_t size)
 {
     /* IMPLEMENT THIS */
-    channel_t* ch = malloc(sizeof(channel_t));   // allocate channel struct
+    return channel_create_ex(size, 0);
+}
+
+struct channel_lane_counters {
+    uint64_t sent;
+    uint64_t received;
+};
+
+// Creates a new channel with the provided size and channel_flags
+channel_t* channel_create_ex(size_t size, unsigned int flags)
+{
+    return channel_create_lanes(size, 1, flags);
+}
+
+// Creates a priority channel with num_lanes lanes sharing a budget of size messages
+channel_t* channel_create_lanes(size_t size, size_t num_lanes, unsigned int flags)
+{
+    if (num_lanes == 0) return NULL;
+    channel_t* ch = calloc(1, sizeof(channel_t));   // allocate channel struct
     if (!ch) return NULL;
-    ch->buffer = buffer_create(size);            // create underlying buffer
-    if (!ch->buffer) { free(ch); return NULL; }
-    if (pthread_mutex_init(&ch->lock, NULL) != 0) { // init mutex
-        buffer_free(ch->buffer);
-        free(ch);
-        return NULL;
-    }
-    pthread_cond_init(&ch->not_full, NULL);     // signal when buffer has space
-    pthread_cond_init(&ch->not_empty, NULL);    // signal when buffer has data
+    ch->num_lanes = num_lanes;
+    ch->lane_counters = calloc(num_lanes, sizeof(struct channel_lane_counters));
+    // every lane can hold the whole budget, so any mix of lanes fits
+    ch->lanes = (num_lanes == 1) ? &ch->buffer : calloc(num_lanes, sizeof(buffer_t*));
+    if (!ch->lane_counters || !ch->lanes) goto fail;
+    for (size_t i = 0; i < num_lanes; i++) {
+        // create underlying buffers
+        ch->lanes[i] = buffer_create_ex(size, (flags & CHANNEL_HUGE_PAGES) ? BUFFER_HUGE_PAGES : 0);
+        if (!ch->lanes[i]) goto fail;
+    }
+    ch->buffer = ch->lanes[num_lanes - 1];
+    if (pthread_mutex_init(&ch->lock, NULL) != 0) goto fail; // init mutex
+    ilist_init(&ch->send_waiters);              // senders waiting for space
+    ilist_init(&ch->recv_waiters);              // receivers waiting for data
+    ch->length = 0;
     ch->closed = false;                         // channel starts open
+    ch->send_closed = false;
+    ch->fifo = (flags & CHANNEL_FIFO) != 0;
     return ch;
+
+fail:
+    if (ch->lanes) {
+        for (size_t i = 0; i < num_lanes; i++) {
+            if (ch->lanes[i]) buffer_free(ch->lanes[i]);
+        }
+        if (ch->lanes != &ch->buffer) free(ch->lanes);
+    }
+    free(ch->lane_counters);
+    free(ch);
+    return NULL;
+}
+
+// Helper: publish the channel's readiness to its group when it changes; called with ch->lock held
+// A channel is ready while a receive would not block: it holds messages or is closed
+// Only empty <-> non-empty transitions touch the group, so busy channels don't bounce its mask around
+static void _group_update(channel_t* ch) {
+    if (!ch->group) return;
+    bool ready = ch->length > 0 || ch->closed || ch->send_closed;
+    if (ready == ch->group_ready) return;
+    ch->group_ready = ready;
+    channel_group_set_ready(ch->group, ch->group_index, ready);
+}
+
+// Helper: buffer data on the given lane; called with ch->lock held
+// Returns false if the channel's shared capacity is used up
+static bool _push(channel_t* ch, void* data, size_t lane) {
+    if (ch->length >= buffer_capacity(ch->buffer)) return false;
+    buffer_add(ch->lanes[lane], data);
+    ch->length++;
+    ch->lane_counters[lane].sent++;
+    _group_update(ch);
+    return true;
 }
 
-// Helper: block until there is room to send or channel is closed
-static enum channel_status _wait_and_check_send(channel_t* ch) {
-    while (buffer_current_size(ch->buffer) == buffer_capacity(ch->buffer) && !ch->closed) {
-        pthread_cond_wait(&ch->not_full, &ch->lock);
+// Helper: take the oldest message of the highest-priority non-empty lane; called with ch->lock held
+// Returns false if every lane is empty
+static bool _pop(channel_t* ch, void** data) {
+    if (ch->length == 0) return false;
+    for (size_t lane = 0; lane < ch->num_lanes; lane++) {
+        if (buffer_remove(ch->lanes[lane], data) == BUFFER_SUCCESS) {
+            ch->length--;
+            ch->lane_counters[lane].received++;
+            _group_update(ch);
+            return true;
+        }
     }
-    if (ch->closed) return CLOSED_ERROR;
+    return false;
+}
+
+// Helper: claim the oldest waiter in queue that was not already woken through another channel
+// Returns NULL if there is none; the caller must waiter_release the claimed waiter
+static waiter_link_t* _claim_one(ilist_t* queue) {
+    ilist_node_t* node;
+    while ((node = ilist_pop_front(queue)) != NULL) {
+        waiter_link_t* link = ilist_entry(node, waiter_link_t, node);
+        if (waiter_claim(link)) return link;
+    }
+    return NULL;
+}
+
+// Helper: claim the oldest waiter in queue that expects a hand-off
+// Waiters that only asked to be notified are released on the way so they retry by themselves
+static waiter_link_t* _claim_handoff(ilist_t* queue) {
+    waiter_link_t* link;
+    while ((link = _claim_one(queue)) != NULL) {
+        if (link->handoff) return link;
+        waiter_release(link->waiter);
+    }
+    return NULL;
+}
+
+// Helper: wake the oldest receiver after a message was buffered
+// A hand-off registration (a blocked select) takes the message itself, so no other receiver can
+// barge in between the wake-up and the select committing; plain receivers just retry
+static void _wake_receiver(channel_t* ch) {
+    waiter_link_t* link = _claim_one(&ch->recv_waiters);
+    if (!link) return;
+    if (link->handoff) {
+        _pop(ch, &link->data);
+        link->waiter->result = SUCCESS;
+    }
+    TRACE(link->handoff ? TRACE_HANDOFF : TRACE_WAKE, ch, TRACE_BLOCK_RECV);
+    waiter_release(link->waiter);
+}
+
+// Helper: wake the oldest sender after a slot was freed; a hand-off registration fills the slot itself
+static void _wake_sender(channel_t* ch) {
+    waiter_link_t* link = _claim_one(&ch->send_waiters);
+    if (!link) return;
+    if (link->handoff) {
+        _push(ch, link->data, link->lane);
+        link->waiter->result = SUCCESS;
+    }
+    TRACE(link->handoff ? TRACE_HANDOFF : TRACE_WAKE, ch, TRACE_BLOCK_SEND);
+    waiter_release(link->waiter);
+}
+
+// Helper: wake every waiter in queue with CLOSED_ERROR and return how many were woken
+// The result is set before each waiter is released, so woken threads return straight away instead of
+// all re-taking the channel lock just to find out it is closed
+static size_t _wake_all(ilist_t* queue) {
+    waiter_link_t* link;
+    size_t woken = 0;
+    while ((link = _claim_one(queue)) != NULL) {
+        link->waiter->result = CLOSED_ERROR;
+        waiter_release(link->waiter);
+        woken++;
+    }
+    return woken;
+}
+
+// Helper: park the calling thread on queue until a waker pops it
+// Called with ch->lock held; the thread's cached waiter is used so nothing is allocated
+// Returns SUCCESS with ch->lock re-acquired so the caller retries, or CLOSED_ERROR with it released
+static enum channel_status _block_on(channel_t* ch, ilist_t* queue) {
+    waiter_t* w = waiter_get(1);
+    w->result = SUCCESS;
+    waiter_prepare(w);
+    ilist_push_back(queue, &w->links[0].node);
+    pthread_mutex_unlock(&ch->lock);
+    TRACE(TRACE_BLOCK_BEGIN, ch, queue == &ch->send_waiters ? TRACE_BLOCK_SEND : TRACE_BLOCK_RECV);
+    waiter_park(w);
+    TRACE(TRACE_BLOCK_END, ch, queue == &ch->send_waiters ? TRACE_BLOCK_SEND : TRACE_BLOCK_RECV);
+    if (w->result == CLOSED_ERROR) return CLOSED_ERROR;
+    pthread_mutex_lock(&ch->lock);
     return SUCCESS;
 }
 
-// Helper: block until there is data to receive or channel is closed
-static enum channel_status _wait_and_check_recv(channel_t* ch) {
-    while (buffer_current_size(ch->buffer) == 0 && !ch->closed) {
-        pthread_cond_wait(&ch->not_empty, &ch->lock);
+// Helper: queue the calling thread on a FIFO channel and wait for a waker to complete the operation for it
+// Called with ch->lock held and returns with it released; *data is sent from (on lane) or received into
+static enum channel_status _park_handoff(channel_t* ch, ilist_t* queue, void** data, size_t lane) {
+    waiter_t* w = waiter_get(1);
+    waiter_link_t* link = &w->links[0];
+    link->handoff = true;
+    link->data = *data;
+    link->lane = lane;
+    waiter_prepare(w);
+    ilist_push_back(queue, &link->node);
+    pthread_mutex_unlock(&ch->lock);
+    TRACE(TRACE_BLOCK_BEGIN, ch, queue == &ch->send_waiters ? TRACE_BLOCK_SEND : TRACE_BLOCK_RECV);
+    waiter_park(w);
+    TRACE(TRACE_BLOCK_END, ch, queue == &ch->send_waiters ? TRACE_BLOCK_SEND : TRACE_BLOCK_RECV);
+    *data = link->data;
+    return (enum channel_status)w->result;
+}
+
+// Helper: send without blocking; called with ch->lock held
+// Returns SUCCESS, CHANNEL_FULL or CLOSED_ERROR
+static enum channel_status _try_send(channel_t* ch, void* data, size_t lane) {
+    if (ch->closed || ch->send_closed) return CLOSED_ERROR;
+    if (ch->fifo) {
+        // receivers only queue on an empty buffer, so the oldest one gets the message directly
+        waiter_link_t* link = _claim_handoff(&ch->recv_waiters);
+        if (link) {
+            link->data = data;
+            link->waiter->result = SUCCESS;
+            ch->lane_counters[lane].sent++;
+            ch->lane_counters[lane].received++;
+            TRACE(TRACE_HANDOFF, ch, TRACE_BLOCK_RECV);
+            waiter_release(link->waiter);
+            return SUCCESS;
+        }
     }
-    if (buffer_current_size(ch->buffer) == 0 && ch->closed) return CLOSED_ERROR;
+    if (!_push(ch, data, lane)) return CHANNEL_FULL;
+    if (!ch->fifo) _wake_receiver(ch); // notify receivers
     return SUCCESS;
 }
 
+// Helper: receive without blocking; called with ch->lock held
+// Returns SUCCESS, CHANNEL_EMPTY or CLOSED_ERROR
+static enum channel_status _try_recv(channel_t* ch, void** data) {
+    if (ch->closed) return CLOSED_ERROR;
+    if (_pop(ch, data)) {
+        if (ch->send_closed) {
+            // nothing will refill the buffer; once it is drained the remaining receivers are done
+            if (ch->length == 0) {
+                size_t woken = _wake_all(&ch->recv_waiters);
+                TRACE(TRACE_CLOSE, ch, woken);
+            }
+            return SUCCESS;
+        }
+        if (!ch->fifo) {
+            _wake_sender(ch); //-- notify senders
+            return SUCCESS;
+        }
+        // refill the freed slot from the oldest queued sender so later senders can't barge ahead of it
+        waiter_link_t* link = _claim_handoff(&ch->send_waiters);
+        if (link) {
+            _push(ch, link->data, link->lane);
+            link->waiter->result = SUCCESS;
+            TRACE(TRACE_HANDOFF, ch, TRACE_BLOCK_SEND);
+            waiter_release(link->waiter);
+        }
+        return SUCCESS;
+    }
+    if (ch->fifo) {
+        // unbuffered FIFO channels rendezvous with a queued sender
+        waiter_link_t* link = _claim_handoff(&ch->send_waiters);
+        if (link) {
+            *data = link->data;
+            link->waiter->result = SUCCESS;
+            ch->lane_counters[link->lane].sent++;
+            ch->lane_counters[link->lane].received++;
+            TRACE(TRACE_HANDOFF, ch, TRACE_BLOCK_SEND);
+            waiter_release(link->waiter);
+            return SUCCESS;
+        }
+    }
+    return ch->send_closed ? CLOSED_ERROR : CHANNEL_EMPTY;
+}
+
 // Writes data to the given channel
 // This is a blocking call i.e., the function only returns on a successful completion of send
 // In case the channel is full, the function waits till the channel has space to write the new data
@@ -49,19 +270,21 @@ enum channel_status channel_send(channel_t *channel, void* data)
 {
     /* IMPLEMENT THIS */
     if (!channel) return GENERIC_ERROR;
+    return channel_send_priority(channel, data, channel->num_lanes - 1);
+}
+
+// Like channel_send, but puts data on the given priority lane
+enum channel_status channel_send_priority(channel_t* channel, void* data, size_t lane)
+{
+    if (!channel || lane >= channel->num_lanes) return GENERIC_ERROR;
     pthread_mutex_lock(&channel->lock);
-    enum channel_status st = _wait_and_check_send(channel);
-    if (st != SUCCESS) {
-        pthread_mutex_unlock(&channel->lock);
-        return st;          // channel closed
+    enum channel_status st;
+    while ((st = _try_send(channel, data, lane)) == CHANNEL_FULL) {
+        if (channel->fifo) return _park_handoff(channel, &channel->send_waiters, &data, lane);
+        if (_block_on(channel, &channel->send_waiters) == CLOSED_ERROR) return CLOSED_ERROR;
     }
-    if (buffer_add(channel->buffer, data) != BUFFER_SUCCESS) {
-        pthread_mutex_unlock(&channel->lock);
-        return GENERIC_ERROR;
-    }
-    pthread_cond_signal(&channel->not_empty); // notify receivers
     pthread_mutex_unlock(&channel->lock);
-    return SUCCESS;
+    return st;
 }
 
 // Reads data from the given channel and stores it in the function's input parameter, data (Note that it is a double pointer)
@@ -75,18 +298,13 @@ enum channel_status channel_receive(channel_t* channel, void** data)
     /* IMPLEMENT THIS */
     if (!channel || !data) return GENERIC_ERROR;
     pthread_mutex_lock(&channel->lock);
-    enum channel_status st = _wait_and_check_recv(channel);
-    if (st != SUCCESS) {
-        pthread_mutex_unlock(&channel->lock);
-        return st;          // channel closed or error
+    enum channel_status st;
+    while ((st = _try_recv(channel, data)) == CHANNEL_EMPTY) {
+        if (channel->fifo) return _park_handoff(channel, &channel->recv_waiters, data, 0);
+        if (_block_on(channel, &channel->recv_waiters) == CLOSED_ERROR) return CLOSED_ERROR;
     }
-    if (buffer_remove(channel->buffer, data) != BUFFER_SUCCESS) {
-        pthread_mutex_unlock(&channel->lock);
-        return GENERIC_ERROR;
-    }
-    pthread_cond_signal(&channel->not_full); //-- notify senders
     pthread_mutex_unlock(&channel->lock);
-    return SUCCESS;
+    return st;
 }
 
 // Writes data to the given channel
@@ -99,19 +317,17 @@ enum channel_status channel_non_blocking_send(channel_t* channel, void* data)
 {
     /* IMPLEMENT THIS */
     if (!channel) return GENERIC_ERROR;
+    return channel_non_blocking_send_priority(channel, data, channel->num_lanes - 1);
+}
+
+// Like channel_non_blocking_send, but puts data on the given priority lane
+enum channel_status channel_non_blocking_send_priority(channel_t* channel, void* data, size_t lane)
+{
+    if (!channel || lane >= channel->num_lanes) return GENERIC_ERROR;
     pthread_mutex_lock(&channel->lock);
-    if (channel->closed) { pthread_mutex_unlock(&channel->lock); return CLOSED_ERROR; }
-    if (buffer_current_size(channel->buffer) == buffer_capacity(channel->buffer)) {
-        pthread_mutex_unlock(&channel->lock);
-        return CHANNEL_FULL; //channel is full
-    }
-    if (buffer_add(channel->buffer, data) != BUFFER_SUCCESS) {
-        pthread_mutex_unlock(&channel->lock);
-        return GENERIC_ERROR;
-    }
-    pthread_cond_signal(&channel->not_empty);
+    enum channel_status st = _try_send(channel, data, lane);
     pthread_mutex_unlock(&channel->lock);
-    return SUCCESS;
+    return st;
 }
 
 // Reads data from the given channel and stores it in the function's input parameter data (Note that it is a double pointer)
@@ -125,17 +341,9 @@ enum channel_status channel_non_blocking_receive(channel_t* channel, void** data
     /* IMPLEMENT THIS */
     if (!channel || !data) return GENERIC_ERROR;
     pthread_mutex_lock(&channel->lock);
-    if (buffer_current_size(channel->buffer) == 0) {
-        pthread_mutex_unlock(&channel->lock);
-        return channel->closed ? CLOSED_ERROR : CHANNEL_EMPTY;
-    }
-    if (buffer_remove(channel->buffer, data) != BUFFER_SUCCESS) {
-        pthread_mutex_unlock(&channel->lock);
-        return GENERIC_ERROR;
-    }
-    pthread_cond_signal(&channel->not_full);
+    enum channel_status st = _try_recv(channel, data);
     pthread_mutex_unlock(&channel->lock);
-    return SUCCESS;
+    return st;
 }
 
 // Closes the channel and informs all the blocking send/receive/select calls to return with CLOSED_ERROR
@@ -151,8 +359,32 @@ enum channel_status channel_close(channel_t* channel)
     if (channel->closed) { pthread_mutex_unlock(&channel->lock); return CLOSED_ERROR; //already closed
      }
     channel->closed = true;
-    pthread_cond_broadcast(&channel->not_empty);
-    pthread_cond_broadcast(&channel->not_full);
+    size_t woken = _wake_all(&channel->recv_waiters);
+    woken += _wake_all(&channel->send_waiters);
+    TRACE(TRACE_CLOSE, channel, woken);
+    _group_update(channel);
+    pthread_mutex_unlock(&channel->lock);
+    return SUCCESS;
+}
+
+// Closes the channel for sending; receivers drain buffered messages before seeing CLOSED_ERROR
+// Returns SUCCESS if close is successful,
+// CLOSED_ERROR if the channel is already closed in either mode, and
+// GENERIC_ERROR in any other error case
+enum channel_status channel_close_send(channel_t* channel)
+{
+    if (!channel) return GENERIC_ERROR;
+    pthread_mutex_lock(&channel->lock);
+    if (channel->closed || channel->send_closed) {
+        pthread_mutex_unlock(&channel->lock);
+        return CLOSED_ERROR;
+    }
+    channel->send_closed = true;
+    size_t woken = _wake_all(&channel->send_waiters);
+    // receivers only stay queued while the buffer is empty; otherwise the last drain wakes them
+    if (channel->length == 0) woken += _wake_all(&channel->recv_waiters);
+    TRACE(TRACE_CLOSE, channel, woken);
+    _group_update(channel);
     pthread_mutex_unlock(&channel->lock);
     return SUCCESS;
 }
@@ -166,15 +398,66 @@ enum channel_status channel_destroy(channel_t* channel)
 {
     /* IMPLEMENT THIS */
     if (!channel) return GENERIC_ERROR;
-    if (!channel->closed) return DESTROY_ERROR;
+    if (!channel->closed && !channel->send_closed) return DESTROY_ERROR;
     pthread_mutex_destroy(&channel->lock);
-    pthread_cond_destroy(&channel->not_empty);
-    pthread_cond_destroy(&channel->not_full);
-    buffer_free(channel->buffer);
+    for (size_t i = 0; i < channel->num_lanes; i++) {
+        buffer_free(channel->lanes[i]);
+    }
+    if (channel->lanes != &channel->buffer) free(channel->lanes);
+    free(channel->lane_counters);
     free(channel);
     return SUCCESS;
 }
 
+// Returns the number of messages currently buffered in the channel, across all lanes
+size_t channel_length(channel_t* channel)
+{
+    pthread_mutex_lock(&channel->lock);
+    size_t length = channel->length;
+    pthread_mutex_unlock(&channel->lock);
+    return length;
+}
+
+// Fills in the counters of the given lane
+enum channel_status channel_lane_stats(channel_t* channel, size_t lane, channel_lane_stats_t* stats)
+{
+    if (!channel || !stats || lane >= channel->num_lanes) return GENERIC_ERROR;
+    pthread_mutex_lock(&channel->lock);
+    stats->sent = channel->lane_counters[lane].sent;
+    stats->received = channel->lane_counters[lane].received;
+    stats->length = buffer_current_size(channel->lanes[lane]);
+    pthread_mutex_unlock(&channel->lock);
+    return SUCCESS;
+}
+
+// Helper: orders select registrations by channel address so every thread locks channels in the same order
+static int _compare_owner(const void* a, const void* b) {
+    uintptr_t x = (uintptr_t)((const waiter_link_t*)a)->owner;
+    uintptr_t y = (uintptr_t)((const waiter_link_t*)b)->owner;
+    return (x > y) - (x < y);
+}
+
+// Helper: lock (or unlock) every distinct channel of the address-sorted registrations
+// A channel listed more than once is only locked once
+static void _lock_all(waiter_link_t* links, size_t count, bool lock) {
+    for (size_t i = 0; i < count; i++) {
+        if (i > 0 && links[i].owner == links[i - 1].owner) continue;
+        channel_t* ch = links[i].owner;
+        if (lock) pthread_mutex_lock(&ch->lock);
+        else pthread_mutex_unlock(&ch->lock);
+    }
+}
+
+// Helper: attempt entry i of a select on its channel; called with the channel's lock held
+// Returns SUCCESS or CLOSED_ERROR if the select is done, CHANNEL_FULL/CHANNEL_EMPTY otherwise
+static enum channel_status _try_select(select_t* entry) {
+    if (entry->dir == SEND) return _try_send(entry->channel, entry->data, entry->channel->num_lanes - 1);
+    void* msg = NULL;
+    enum channel_status st = _try_recv(entry->channel, &msg);
+    if (st == SUCCESS) entry->data = msg;
+    return st;
+}
+
 // Takes an array of channels (channel_list) of type select_t and the array length (channel_count) as inputs
 // This API iterates over the provided list and finds the set of possible channels which can be used to invoke the required operation (send or receive) specified in select_t
 // If multiple options are available, it selects the first option and performs its corresponding action
@@ -185,51 +468,70 @@ enum channel_status channel_destroy(channel_t* channel)
 enum channel_status channel_select(select_t* channel_list, size_t channel_count, size_t* selected_index) {
     if (!channel_list || channel_count == 0 || !selected_index)
         return GENERIC_ERROR;
-    size_t idx = 0;
-    while (true) {
-        // try each channel in turn
-        for (size_t i = 0; i < channel_count; i++) {
-            channel_t* ch = channel_list[i].channel;
-            if (!ch) continue;
-            pthread_mutex_lock(&ch->lock);
-            bool closed = ch->closed;
-            size_t curr = buffer_current_size(ch->buffer);
-            size_t cap  = buffer_capacity(ch->buffer);
-            pthread_mutex_unlock(&ch->lock);
-            if (channel_list[i].dir == SEND) {
-                if (closed) { *selected_index = i; return CLOSED_ERROR; }
-                if (curr < cap) {
-                    enum channel_status st = channel_send(ch, channel_list[i].data);
-                    *selected_index = i;
-                    return st;      // sent
-                }
-            } else {
-                if (curr > 0) {
-                    void* msg = NULL;
-                    enum channel_status st = channel_receive(ch, &msg);
-                    channel_list[i].data = msg;
-                    *selected_index = i;
-                    return st;      // received
-                }
-                if (closed) { *selected_index = i; return CLOSED_ERROR; }
-            }
+    for (size_t i = 0; i < channel_count; i++) {
+        if (!channel_list[i].channel) return GENERIC_ERROR;
+    }
+
+    // fast path: each channel is checked and, if ready, operated on under a single lock acquisition
+    for (size_t i = 0; i < channel_count; i++) {
+        channel_t* ch = channel_list[i].channel;
+        pthread_mutex_lock(&ch->lock);
+        enum channel_status st = _try_select(&channel_list[i]);
+        pthread_mutex_unlock(&ch->lock);
+        if (st != CHANNEL_FULL) {
+            *selected_index = i;
+            return st;
         }
-        // none ready: block on current index
-        channel_t* ch_wait = channel_list[idx].channel;
-        pthread_mutex_lock(&ch_wait->lock);
-        if (channel_list[idx].dir == SEND) {
-            while (buffer_current_size(ch_wait->buffer) == buffer_capacity(ch_wait->buffer)
-                   && !ch_wait->closed) {
-                pthread_cond_wait(&ch_wait->not_full, &ch_wait->lock);
-            }
-        } else {
-            while (buffer_current_size(ch_wait->buffer) == 0 && !ch_wait->closed) {
-                pthread_cond_wait(&ch_wait->not_empty, &ch_wait->lock);
-            }
+    }
+
+    // slow path: lock every channel in address order, re-check, and register on all of them at once
+    // The registrations are hand-offs, so whichever waker claims this thread first completes the
+    // operation on its channel and the select can never commit on two channels
+    waiter_t* w = waiter_get(channel_count);
+    if (!w) return GENERIC_ERROR;
+    waiter_link_t* links = w->links;
+    for (size_t i = 0; i < channel_count; i++) {
+        links[i].index = i;
+        links[i].owner = channel_list[i].channel;
+        links[i].handoff = true;
+        links[i].data = channel_list[i].data;
+        links[i].lane = channel_list[i].channel->num_lanes - 1;
+    }
+    qsort(links, channel_count, sizeof(waiter_link_t), _compare_owner);
+    _lock_all(links, channel_count, true);
+    for (size_t i = 0; i < channel_count; i++) {
+        enum channel_status st = _try_select(&channel_list[i]);
+        if (st != CHANNEL_FULL) {
+            _lock_all(links, channel_count, false);
+            *selected_index = i;
+            return st;
         }
-        pthread_mutex_unlock(&ch_wait->lock);
-        idx = (idx + 1) % channel_count;
     }
-    return GENERIC_ERROR; // unreachable
-}
+    waiter_prepare(w);
+    for (size_t i = 0; i < channel_count; i++) {
+        channel_t* ch = links[i].owner;
+        ilist_t* queue = (channel_list[links[i].index].dir == SEND) ? &ch->send_waiters : &ch->recv_waiters;
+        ilist_push_back(queue, &links[i].node);
+    }
+    _lock_all(links, channel_count, false);
+    TRACE(TRACE_BLOCK_BEGIN, channel_list[0].channel, TRACE_BLOCK_SELECT);
+    waiter_park(w);
+    TRACE(TRACE_BLOCK_END, w->fired->owner, TRACE_BLOCK_SELECT);
 
+    // withdraw the registrations no waker popped
+    _lock_all(links, channel_count, true);
+    for (size_t i = 0; i < channel_count; i++) {
+        if (!ilist_linked(&links[i].node)) continue;
+        channel_t* ch = links[i].owner;
+        ilist_t* queue = (channel_list[links[i].index].dir == SEND) ? &ch->send_waiters : &ch->recv_waiters;
+        ilist_remove(queue, &links[i].node);
+    }
+    _lock_all(links, channel_count, false);
+
+    waiter_link_t* fired = w->fired;
+    *selected_index = fired->index;
+    if (w->result == SUCCESS && channel_list[fired->index].dir == RECV) {
+        channel_list[fired->index].data = fired->data;
+    }
+    return (enum channel_status)w->result;
+}
@@ -9,7 +9,9 @@
 #include <stddef.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include "linked_list.h"
+#include "waiter.h"
 
 // Defines possible return values from channel functions
 enum channel_status {
@@ -30,12 +32,39 @@ typedef struct {
 
     /* ADD ANY STRUCT ENTRIES YOU NEED HERE */
     /* IMPLEMENT THIS */
-    pthread_mutex_t lock;    // guards buffer and state
-    pthread_cond_t not_full; // signaled when space becomes available
-    pthread_cond_t not_empty;// signaled when items arrive
-    bool closed;             
+    pthread_mutex_t lock;    // guards buffer, lanes, waiter queues and state
+    buffer_t** lanes;        // priority lanes, lanes[0] drains first; the last lane is buffer
+    size_t num_lanes;
+    size_t length;           // messages across all lanes, bounded by buffer's capacity
+    struct channel_lane_counters* lane_counters; // per-lane sent/received totals
+    ilist_t send_waiters;    // waiter_link_t of senders blocked on a full buffer
+    ilist_t recv_waiters;    // waiter_link_t of receivers blocked on an empty buffer
+    struct channel_group* group; // group the channel belongs to, if any (see channel_group.h)
+    size_t group_index;      // the channel's bit in the group's readiness mask
+    bool group_ready;        // last readiness published to the group
+    bool closed;             // channel_close: every operation fails
+    bool send_closed;        // channel_close_send: sends fail, receives drain the buffer first
+    bool fifo;               // CHANNEL_FIFO: waiters are served in arrival order by direct hand-off
 } channel_t;
 
+// Defines options for channel_create_ex
+enum channel_flags {
+    // Blocked senders and receivers are served strictly in arrival order
+    // The waking thread completes the oldest waiter's operation for it, so woken threads never
+    // race newcomers for the buffer slot; a size 0 FIFO channel is a rendezvous channel
+    CHANNEL_FIFO = 1 << 0,
+    // Rings of at least 2MB come from prefaulted huge pages (see BUFFER_HUGE_PAGES in buffer.h)
+    // Meant for very large batching channels; every lane of a priority channel gets its own ring
+    CHANNEL_HUGE_PAGES = 1 << 1,
+};
+
+// Per-lane counters reported by channel_lane_stats
+typedef struct {
+    uint64_t sent;      // messages sent on the lane (including ones handed straight to a receiver)
+    uint64_t received;  // messages received from the lane
+    size_t length;      // messages waiting in the lane right now
+} channel_lane_stats_t;
+
 // Defines channel list structure for channel_select function
 enum direction {
     SEND,
@@ -54,6 +83,15 @@ typedef struct {
 // Creates a new channel with the provided size and returns it to the caller
 channel_t* channel_create(size_t size);
 
+// Creates a new channel with the provided size and channel_flags (0 behaves like channel_create)
+channel_t* channel_create_ex(size_t size, unsigned int flags);
+
+// Creates a priority channel with num_lanes lanes sharing a budget of size messages
+// Receives always take the oldest message of the highest-priority non-empty lane (lane 0 first), so
+// messages sent on a high-priority lane never wait behind lower lanes; plain sends go to the last lane
+// Returns NULL if num_lanes is 0 or allocation failed
+channel_t* channel_create_lanes(size_t size, size_t num_lanes, unsigned int flags);
+
 // Writes data to the given channel
 // This is a blocking call i.e., the function only returns on a successful completion of send
 // In case the channel is full, the function waits till the channel has space to write the new data
@@ -86,6 +124,15 @@ enum channel_status channel_non_blocking_send(channel_t* channel, void* data);
 // GENERIC_ERROR on encountering any other generic error of any sort
 enum channel_status channel_non_blocking_receive(channel_t* channel, void** data);
 
+// Like channel_send and channel_non_blocking_send, but put data on the given priority lane
+// Return GENERIC_ERROR if the lane doesn't exist
+enum channel_status channel_send_priority(channel_t* channel, void* data, size_t lane);
+enum channel_status channel_non_blocking_send_priority(channel_t* channel, void* data, size_t lane);
+
+// Fills in the counters of the given lane
+// Returns SUCCESS, or GENERIC_ERROR if the lane doesn't exist
+enum channel_status channel_lane_stats(channel_t* channel, size_t lane, channel_lane_stats_t* stats);
+
 // Closes the channel and informs all the blocking send/receive/select calls to return with CLOSED_ERROR
 // Once the channel is closed, send/receive/select operations will cease to function and just return CLOSED_ERROR
 // Returns SUCCESS if close is successful,
@@ -93,13 +140,24 @@ enum channel_status channel_non_blocking_receive(channel_t* channel, void** data
 // GENERIC_ERROR in any other error case
 enum channel_status channel_close(channel_t* channel);
 
+// Closes the channel for sending only
+// Blocked and future sends return CLOSED_ERROR, while receives keep draining buffered messages and
+// only return CLOSED_ERROR once the buffer is empty; channel_close may still be called afterwards
+// Returns SUCCESS if close is successful,
+// CLOSED_ERROR if the channel is already closed in either mode, and
+// GENERIC_ERROR in any other error case
+enum channel_status channel_close_send(channel_t* channel);
+
 // Frees all the memory allocated to the channel
-// The caller is responsible for calling channel_close and waiting for all threads to finish their tasks before calling channel_destroy
+// The caller is responsible for calling channel_close (or channel_close_send) and waiting for all threads to finish their tasks before calling channel_destroy
 // Returns SUCCESS if destroy is successful,
 // DESTROY_ERROR if channel_destroy is called on an open channel, and
 // GENERIC_ERROR in any other error case
 enum channel_status channel_destroy(channel_t* channel);
 
+// Returns the number of messages currently buffered in the channel
+size_t channel_length(channel_t* channel);
+
 // Takes an array of channels (channel_list) of type select_t and the array length (channel_count) as inputs
 // This API iterates over the provided list and finds the set of possible channels which can be used to invoke the required operation (send or receive) specified in select_t
 // If multiple options are available, it selects the first option and performs its corresponding action
@@ -0,0 +1,136 @@
+#include "channel_group.h"
+#include <stdlib.h>
+
+// Helper: detaches the first count members; each is locked so no transition is published mid-detach
+static void _detach(channel_group_t* group, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        channel_t* ch = group->members[i];
+        pthread_mutex_lock(&ch->lock);
+        ch->group = NULL;
+        ch->group_ready = false;
+        pthread_mutex_unlock(&ch->lock);
+    }
+}
+
+// Creates a group over count channels
+channel_group_t* channel_group_create(channel_t** channels, size_t count)
+{
+    if (!channels || count == 0) return NULL;
+    channel_group_t* group = calloc(1, sizeof(channel_group_t));
+    if (!group) return NULL;
+    group->count = count;
+    group->words = (count + 63) / 64;
+    group->members = malloc(count * sizeof(channel_t*));
+    group->ready = calloc(group->words, sizeof(_Atomic uint64_t));
+    if (!group->members || !group->ready) goto fail;
+    for (size_t i = 0; i < count; i++) {
+        channel_t* ch = channels[i];
+        if (!ch || buffer_capacity(ch->buffer) == 0) {
+            _detach(group, i);
+            goto fail;
+        }
+        pthread_mutex_lock(&ch->lock);
+        if (ch->group) {
+            pthread_mutex_unlock(&ch->lock);
+            _detach(group, i);
+            goto fail;
+        }
+        group->members[i] = ch;
+        ch->group = group;
+        ch->group_index = i;
+        // seed the mask with the channel's current state; later changes arrive through channel_group_set_ready
+        ch->group_ready = ch->length > 0 || ch->closed || ch->send_closed;
+        if (ch->group_ready) atomic_fetch_or(&group->ready[i / 64], 1ull << (i % 64));
+        pthread_mutex_unlock(&ch->lock);
+    }
+    return group;
+
+fail:
+    free(group->ready);
+    free(group->members);
+    free(group);
+    return NULL;
+}
+
+// Called by a member channel, with its lock held, when its readiness changes
+void channel_group_set_ready(channel_group_t* group, size_t index, bool ready)
+{
+    uint64_t bit = 1ull << (index % 64);
+    if (!ready) {
+        atomic_fetch_and_explicit(&group->ready[index / 64], ~bit, memory_order_relaxed);
+        return;
+    }
+    atomic_fetch_or_explicit(&group->ready[index / 64], bit, memory_order_release);
+    // pairs with channel_group_wait: either the waiter sees the new sequence or we see it sleeping
+    atomic_fetch_add(&group->sequence, 1);
+    if (atomic_load(&group->sleepers) > 0) futex_wake_all(&group->sequence);
+}
+
+// Helper: returns the lowest ready member at or above from, or group->count if there is none
+static size_t _next_ready(channel_group_t* group, size_t from)
+{
+    if (from >= group->count) return group->count;
+    size_t word = from / 64;
+    uint64_t bits = atomic_load_explicit(&group->ready[word], memory_order_acquire) & (~0ull << (from % 64));
+    while (!bits) {
+        if (++word == group->words) return group->count;
+        bits = atomic_load_explicit(&group->ready[word], memory_order_acquire);
+    }
+    return word * 64 + (size_t)__builtin_ctzll(bits);
+}
+
+// Stores the indices of up to max ready members in indices, lowest first
+size_t channel_group_ready(channel_group_t* group, size_t* indices, size_t max)
+{
+    if (!group || !indices) return 0;
+    size_t found = 0;
+    for (size_t i = _next_ready(group, 0); i < group->count && found < max; i = _next_ready(group, i + 1)) {
+        indices[found++] = i;
+    }
+    return found;
+}
+
+// Receives from a ready member without blocking
+enum channel_status channel_group_receive(channel_group_t* group, void** data, size_t* index)
+{
+    if (!group || !data || !index) return GENERIC_ERROR;
+    size_t start = atomic_load_explicit(&group->cursor, memory_order_relaxed);
+    // scan [start, count) and then wrap around to [0, start)
+    for (int pass = 0; pass < 2; pass++) {
+        size_t end = pass ? start : group->count;
+        for (size_t i = _next_ready(group, pass ? 0 : start); i < end; i = _next_ready(group, i + 1)) {
+            enum channel_status st = channel_non_blocking_receive(group->members[i], data);
+            if (st == CHANNEL_EMPTY) continue; // another consumer drained it after we saw the bit
+            *index = i;
+            atomic_store_explicit(&group->cursor, (i + 1 < group->count) ? i + 1 : 0, memory_order_relaxed);
+            return st;
+        }
+    }
+    return CHANNEL_EMPTY;
+}
+
+// Receives from a ready member, blocking until there is one
+enum channel_status channel_group_wait(channel_group_t* group, void** data, size_t* index)
+{
+    if (!group || !data || !index) return GENERIC_ERROR;
+    while (true) {
+        uint32_t seen = atomic_load(&group->sequence);
+        enum channel_status st = channel_group_receive(group, data, index);
+        if (st != CHANNEL_EMPTY) return st;
+        atomic_fetch_add(&group->sleepers, 1);
+        // a member that became ready since the scan has bumped the sequence, so futex_wait returns at once
+        if (atomic_load(&group->sequence) == seen) futex_wait(&group->sequence, seen);
+        atomic_fetch_sub(&group->sleepers, 1);
+    }
+}
+
+// Detaches the members and frees the group
+void channel_group_destroy(channel_group_t* group)
+{
+    if (!group) return;
+    _detach(group, group->count);
+    free(group->ready);
+    free(group->members);
+    free(group);
+}
@@ -0,0 +1,52 @@
+#ifndef CHANNEL_GROUP_H
+#define CHANNEL_GROUP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "channel.h"
+
+// Channel groups: receive from whichever of many channels has a message
+// Every member channel owns one bit of the group's readiness mask, which the channel sets when it goes
+// from empty to non-empty (or is closed) and clears when it drains. Finding ready members is then a load
+// and a count-trailing-zeros per 64 channels instead of locking all N of them, so a consumer pays for the
+// channels that have work rather than for every channel it watches.
+//
+// A channel belongs to at most one group at a time, and the group must be destroyed before its members.
+// Rendezvous (size 0) channels never hold messages and cannot join a group.
+
+typedef struct channel_group {
+    channel_t** members;
+    size_t count;
+    size_t words;               // 64-bit words in ready
+    _Atomic uint64_t* ready;    // bit i is set while members[i] has messages or is closed
+    _Atomic uint32_t sequence;  // bumped on every empty -> ready transition; futex word for channel_group_wait
+    atomic_uint sleepers;       // threads blocked in channel_group_wait
+    atomic_size_t cursor;       // member the next scan starts at, so busy low members can't starve the rest
+} channel_group_t;
+
+// Creates a group over count channels; returns NULL if a channel is NULL, has size 0 or is already in a group
+channel_group_t* channel_group_create(channel_t** channels, size_t count);
+
+// Stores the indices of up to max ready members in indices, lowest first, and returns how many were stored
+// The result is a snapshot: another consumer may drain a reported member before the caller gets to it
+size_t channel_group_ready(channel_group_t* group, size_t* indices, size_t max);
+
+// Receives from a ready member without blocking and stores its index in *index
+// Returns SUCCESS with the message in *data,
+// CHANNEL_EMPTY if no member is ready,
+// CLOSED_ERROR if the member reached first is closed (it keeps being reported until the group is destroyed), and
+// GENERIC_ERROR in any other error case
+enum channel_status channel_group_receive(channel_group_t* group, void** data, size_t* index);
+
+// Like channel_group_receive, but blocks until some member is ready instead of returning CHANNEL_EMPTY
+enum channel_status channel_group_wait(channel_group_t* group, void** data, size_t* index);
+
+// Detaches the members and frees the group; no thread may still be using it
+void channel_group_destroy(channel_group_t* group);
+
+// Called by a member channel, with its lock held, when its readiness changes
+void channel_group_set_ready(channel_group_t* group, size_t index, bool ready);
+
+#endif // CHANNEL_GROUP_H
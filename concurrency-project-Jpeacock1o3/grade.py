@@ -47,6 +47,17 @@ def add_test_cases(test_name, iters=0, timeout=0):
 
 add_test_cases("test_initialization")
 add_test_cases("test_free")
+add_test_cases("test_linked_list")
+add_test_cases("test_mpsc_queue", iters_slow)
+add_test_cases("test_waiter_reuse", iters_slow)
+add_test_cases("test_trace", iters_one)
+add_test_cases("test_fifo_ordering", iters_slow)
+add_test_cases("test_priority_lanes", iters_slow)
+add_test_cases("test_channel_group", iters_slow)
+add_test_cases("test_affinity", iters_slow)
+add_test_cases("test_huge_page_ring", iters_one)
+add_test_cases("test_rpc", iters_slow)
+add_test_cases("test_pipeline", iters_slow)
 add_test_cases("test_send_correctness", iters_slow)
 add_test_cases("test_receive_correctness", iters_slow)
 add_test_cases("test_non_blocking_send", iters_one)
@@ -56,6 +67,8 @@ add_test_case_channel("test_overall_send_receive", iters_one)
 add_test_case_sanitize("test_overall_send_receive", iters_one)
 add_test_case_valgrind("test_overall_send_receive", iters_one, timeout_valgrind * 5)
 add_test_cases("test_stress_send_recv", iters_one, timeout_stress_send_recv)
+add_test_cases("test_stress_open_loop", iters_one, timeout_stress_send_recv)
+add_test_cases("test_linearizability", iters_one, timeout_stress_send_recv)
 add_test_cases("test_response_time", iters_one, timeout_response_time)
 add_test_cases("test_cpu_utilization_send", iters_one, timeout_cpu_utilization)
 add_test_cases("test_cpu_utilization_receive", iters_one, timeout_cpu_utilization)
@@ -65,6 +78,7 @@ add_test_case_valgrind("test_channel_close_with_send", iters_slow, timeout_valgr
 add_test_case_channel("test_channel_close_with_receive", iters_slow)
 add_test_case_sanitize("test_channel_close_with_receive", iters_slow)
 add_test_case_valgrind("test_channel_close_with_receive", iters_slow, timeout_valgrind * 2)
+add_test_cases("test_channel_close_send", iters_slow)
 add_test_cases("test_select", iters_slow)
 add_test_cases("test_select_close", iters_slow)
 add_test_cases("test_select_and_non_blocking_send_size1", iters_slow)
@@ -73,9 +87,13 @@ add_test_cases("test_select_with_select_size1", iters_slow)
 add_test_cases("test_select_with_same_channel_size1")
 add_test_cases("test_select_with_send_receive_on_same_channel_size1")
 add_test_cases("test_select_with_duplicate_channel_size1", iters_slow)
+add_test_cases("test_select_atomic_commit", iters_slow)
 add_test_case_channel("test_stress", iters_one, timeout_channel * 5)
 add_test_case_sanitize("test_stress", iters_one, timeout_sanitize * 5)
 add_test_case_valgrind("test_stress", iters_one, timeout_valgrind * 5)
+add_test_case_channel("test_binary_topology", iters_one, timeout_channel * 5)
+add_test_case_sanitize("test_binary_topology", iters_one, timeout_sanitize * 5)
+add_test_case_valgrind("test_binary_topology", iters_one, timeout_valgrind * 5)
 add_test_cases("test_select_response_time", iters_one, timeout_response_time)
 add_test_cases("test_cpu_utilization_select", iters_one, timeout_cpu_utilization)
 add_test_cases("test_cpu_utilization_overall", iters_one, timeout_cpu_utilization)
@@ -4,70 +4,77 @@
 // Creates and returns a new list
 list_t* list_create()
 {
-    /* IMPLEMENT THIS IF YOU WANT TO USE LINKED LISTS */
-    return NULL;
+    list_t* list = malloc(sizeof(list_t));
+    if (!list) return NULL;
+    list->head = NULL;
+    list->tail = NULL;
+    list->count = 0;
+    return list;
 }
 
 // Destroys a list
 void list_destroy(list_t* list)
 {
-    /* IMPLEMENT THIS IF YOU WANT TO USE LINKED LISTS */
+    if (!list) return;
+    list_node_t* node = list->head;
+    while (node) {
+        list_node_t* next = node->next;
+        free(node);
+        node = next;
+    }
+    free(list);
 }
 
 // Returns head of the list
 list_node_t* list_head(list_t* list)
 {
-    /* IMPLEMENT THIS IF YOU WANT TO USE LINKED LISTS */
-    return NULL;
+    return list ? list->head : NULL;
 }
 
 // Returns tail of the list
 list_node_t* list_tail(list_t* list)
 {
-    /* IMPLEMENT THIS IF YOU WANT TO USE LINKED LISTS */
-    return NULL;
+    return list ? list->tail : NULL;
 }
 
 // Returns next element in the list
 list_node_t* list_next(list_node_t* node)
 {
-    /* IMPLEMENT THIS IF YOU WANT TO USE LINKED LISTS */
-    return NULL;
+    return node ? node->next : NULL;
 }
 
 // Returns prev element in the list
 list_node_t* list_prev(list_node_t* node)
 {
-    /* IMPLEMENT THIS IF YOU WANT TO USE LINKED LISTS */
-    return NULL;
+    return node ? node->prev : NULL;
 }
 
 // Returns end of the list marker
 list_node_t* list_end(list_t* list)
 {
-    /* IMPLEMENT THIS IF YOU WANT TO USE LINKED LISTS */
     return NULL;
 }
 
 // Returns data in the given list node
 void* list_data(list_node_t* node)
 {
-    /* IMPLEMENT THIS IF YOU WANT TO USE LINKED LISTS */
-    return NULL;
+    return node ? node->data : NULL;
 }
 
 // Returns the number of elements in the list
 size_t list_count(list_t* list)
 {
-    /* IMPLEMENT THIS IF YOU WANT TO USE LINKED LISTS */
-    return 0;
+    return list ? list->count : 0;
 }
 
 // Finds the first node in the list with the given data
 // Returns NULL if data could not be found
 list_node_t* list_find(list_t* list, void* data)
 {
-    /* IMPLEMENT THIS IF YOU WANT TO USE LINKED LISTS */
+    if (!list) return NULL;
+    for (list_node_t* node = list->head; node; node = node->next) {
+        if (node->data == data) return node;
+    }
     return NULL;
 }
 
@@ -75,12 +82,120 @@ list_node_t* list_find(list_t* list, void* data)
 // Returns new node inserted
 list_node_t* list_insert(list_t* list, void* data)
 {
-    /* IMPLEMENT THIS IF YOU WANT TO USE LINKED LISTS */
-    return NULL;
+    if (!list) return NULL;
+    list_node_t* node = malloc(sizeof(list_node_t));
+    if (!node) return NULL;
+    node->data = data;
+    node->next = NULL;
+    node->prev = list->tail;    // append at the tail
+    if (list->tail) {
+        list->tail->next = node;
+    } else {
+        list->head = node;
+    }
+    list->tail = node;
+    list->count++;
+    return node;
 }
 
 // Removes a node from the list and frees the node resources
 void list_remove(list_t* list, list_node_t* node)
 {
-    /* IMPLEMENT THIS IF YOU WANT TO USE LINKED LISTS */
+    if (!list || !node) return;
+    if (node->prev) {
+        node->prev->next = node->next;
+    } else {
+        list->head = node->next;
+    }
+    if (node->next) {
+        node->next->prev = node->prev;
+    } else {
+        list->tail = node->prev;
+    }
+    list->count--;
+    free(node);
+}
+
+// Initializes an empty list
+void ilist_init(ilist_t* list)
+{
+    list->sentinel.next = &list->sentinel;
+    list->sentinel.prev = &list->sentinel;
+    list->count = 0;
+}
+
+// Marks a node as not being on any list
+void ilist_node_init(ilist_node_t* node)
+{
+    node->next = NULL;
+    node->prev = NULL;
+}
+
+// Returns true if the node is currently on a list
+bool ilist_linked(const ilist_node_t* node)
+{
+    return node->next != NULL;
+}
+
+// Returns true if the list has no nodes
+bool ilist_empty(const ilist_t* list)
+{
+    return list->sentinel.next == &list->sentinel;
+}
+
+// Returns the number of nodes in the list
+size_t ilist_count(const ilist_t* list)
+{
+    return list->count;
+}
+
+// Returns the head of the list, or NULL if the list is empty
+ilist_node_t* ilist_front(ilist_t* list)
+{
+    return ilist_empty(list) ? NULL : list->sentinel.next;
+}
+
+// Returns the node after node, or NULL if node is the tail
+ilist_node_t* ilist_next(ilist_t* list, ilist_node_t* node)
+{
+    return (node->next == &list->sentinel) ? NULL : node->next;
+}
+
+// Links node between prev and next
+static void ilist_link(ilist_t* list, ilist_node_t* node, ilist_node_t* prev, ilist_node_t* next)
+{
+    node->prev = prev;
+    node->next = next;
+    prev->next = node;
+    next->prev = node;
+    list->count++;
+}
+
+// Appends node at the tail of the list
+void ilist_push_back(ilist_t* list, ilist_node_t* node)
+{
+    ilist_link(list, node, list->sentinel.prev, &list->sentinel);
+}
+
+// Inserts node at the head of the list
+void ilist_push_front(ilist_t* list, ilist_node_t* node)
+{
+    ilist_link(list, node, &list->sentinel, list->sentinel.next);
+}
+
+// Removes and returns the head of the list, or NULL if the list is empty
+ilist_node_t* ilist_pop_front(ilist_t* list)
+{
+    ilist_node_t* node = ilist_front(list);
+    if (node) ilist_remove(list, node);
+    return node;
+}
+
+// Unlinks node from the list; the node must be on this list
+void ilist_remove(ilist_t* list, ilist_node_t* node)
+{
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    ilist_node_init(node);
+    list->count--;
 }
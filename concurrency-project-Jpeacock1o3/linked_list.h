@@ -2,6 +2,7 @@
 #define LINKED_LIST_H
 
 #include <stddef.h>
+#include <stdbool.h>
 
 typedef struct list_node {
     struct list_node* next; // next node in list
@@ -53,4 +54,53 @@ list_node_t* list_insert(list_t* list, void* data);
 // Removes a node from the list and frees the node resources
 void list_remove(list_t* list, list_node_t* node);
 
+// Intrusive doubly-linked list
+// The ilist_node_t is embedded in the element being queued, so insert and remove never allocate
+// The list is circular around a sentinel node; an unlinked node has NULL next/prev
+typedef struct ilist_node {
+    struct ilist_node* next;
+    struct ilist_node* prev;
+} ilist_node_t;
+
+typedef struct {
+    ilist_node_t sentinel; // sentinel.next is the head and sentinel.prev is the tail
+    size_t count;
+} ilist_t;
+
+// Returns the element of the given type that embeds node as member
+#define ilist_entry(node, type, member) ((type*)((char*)(node) - offsetof(type, member)))
+
+// Initializes an empty list
+void ilist_init(ilist_t* list);
+
+// Marks a node as not being on any list
+void ilist_node_init(ilist_node_t* node);
+
+// Returns true if the node is currently on a list
+bool ilist_linked(const ilist_node_t* node);
+
+// Returns true if the list has no nodes
+bool ilist_empty(const ilist_t* list);
+
+// Returns the number of nodes in the list
+size_t ilist_count(const ilist_t* list);
+
+// Returns the head of the list, or NULL if the list is empty
+ilist_node_t* ilist_front(ilist_t* list);
+
+// Returns the node after node, or NULL if node is the tail
+ilist_node_t* ilist_next(ilist_t* list, ilist_node_t* node);
+
+// Appends node at the tail of the list
+void ilist_push_back(ilist_t* list, ilist_node_t* node);
+
+// Inserts node at the head of the list
+void ilist_push_front(ilist_t* list, ilist_node_t* node);
+
+// Removes and returns the head of the list, or NULL if the list is empty
+ilist_node_t* ilist_pop_front(ilist_t* list);
+
+// Unlinks node from the list; the node must be on this list
+void ilist_remove(ilist_t* list, ilist_node_t* node);
+
 #endif // LINKED_LIST_H
@@ -0,0 +1,60 @@
+#include <stddef.h>
+#include "mpsc_queue.h"
+
+// Initializes an empty queue
+void mpsc_init(mpsc_queue_t* queue)
+{
+    atomic_store_explicit(&queue->stub.next, NULL, memory_order_relaxed);
+    atomic_store_explicit(&queue->head, &queue->stub, memory_order_relaxed);
+    queue->tail = &queue->stub;
+}
+
+// Appends node to the queue; safe to call from any thread
+void mpsc_push(mpsc_queue_t* queue, mpsc_node_t* node)
+{
+    atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+    // claim the head position, then link the previous head to us
+    // between the two steps the queue is briefly disconnected, which mpsc_pop reports as empty
+    mpsc_node_t* prev = atomic_exchange_explicit(&queue->head, node, memory_order_acq_rel);
+    atomic_store_explicit(&prev->next, node, memory_order_release);
+}
+
+// Removes and returns the oldest node, or NULL if the queue is empty
+mpsc_node_t* mpsc_pop(mpsc_queue_t* queue)
+{
+    mpsc_node_t* tail = queue->tail;
+    mpsc_node_t* next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    if (tail == &queue->stub) {
+        // skip over the stub
+        if (next == NULL) {
+            return NULL;
+        }
+        queue->tail = next;
+        tail = next;
+        next = atomic_load_explicit(&next->next, memory_order_acquire);
+    }
+    if (next != NULL) {
+        queue->tail = next;
+        return tail;
+    }
+    // tail is the last linked node; it can only be taken once something follows it
+    mpsc_node_t* head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    if (tail != head) {
+        // a producer swapped head but has not linked it yet
+        return NULL;
+    }
+    mpsc_push(queue, &queue->stub);
+    next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    if (next != NULL) {
+        queue->tail = next;
+        return tail;
+    }
+    return NULL;
+}
+
+// Returns true if no pushed node is waiting to be popped
+bool mpsc_empty(mpsc_queue_t* queue)
+{
+    mpsc_node_t* tail = queue->tail;
+    return (tail == &queue->stub) && (atomic_load_explicit(&tail->next, memory_order_acquire) == NULL);
+}
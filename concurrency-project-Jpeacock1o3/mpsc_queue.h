@@ -0,0 +1,36 @@
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+// Lock-free intrusive multi-producer single-consumer queue
+// Any thread may push; only one thread at a time may pop
+// Like ilist_node_t, the node is embedded in the queued element so push never allocates
+
+typedef struct mpsc_node {
+    _Atomic(struct mpsc_node*) next;
+} mpsc_node_t;
+
+typedef struct {
+    _Atomic(mpsc_node_t*) head; // producers swap themselves in here
+    mpsc_node_t* tail;          // owned by the consumer
+    mpsc_node_t stub;           // keeps the queue non-empty so push is a single exchange
+} mpsc_queue_t;
+
+// Initializes an empty queue
+void mpsc_init(mpsc_queue_t* queue);
+
+// Appends node to the queue; safe to call from any thread
+void mpsc_push(mpsc_queue_t* queue, mpsc_node_t* node);
+
+// Removes and returns the oldest node, or NULL if the queue is empty
+// May also return NULL while a concurrent push is half way done; the pushed node shows up on a later pop
+// Only the consumer thread may call this
+mpsc_node_t* mpsc_pop(mpsc_queue_t* queue);
+
+// Returns true if no pushed node is waiting to be popped
+// Only the consumer thread may call this
+bool mpsc_empty(mpsc_queue_t* queue);
+
+#endif // MPSC_QUEUE_H
@@ -0,0 +1,353 @@
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <assert.h>
+#include "pipeline.h"
+#include "affinity.h"
+
+#define NS_PER_SEC 1000000000ull
+#define DEPTH_SAMPLE_INTERVAL 64 // a worker samples its input depth once per this many items
+
+// Carries an item through the stages together with its push order
+// A fixed pool of envelopes circulates through free_envelopes, which bounds the items in flight
+typedef struct {
+    uint64_t seq;
+    bool dropped;
+    void* data;
+} envelope_t;
+
+typedef struct stage stage_t;
+
+// Counters of one worker thread; only that worker writes them
+typedef struct {
+    stage_t* stage;
+    pthread_t pid;
+    atomic_uint_fast64_t items;
+    atomic_uint_fast64_t dropped;
+    atomic_uint_fast64_t starved_ns;
+    atomic_uint_fast64_t backpressure_ns;
+    atomic_uint_fast64_t busy_ns;
+    atomic_uint_fast64_t depth_sum;
+    atomic_uint_fast64_t depth_samples;
+} stage_worker_t;
+
+struct stage {
+    const char* name;
+    stage_fn_t fn;
+    void* arg;
+    size_t capacity;
+    size_t num_workers;
+    stage_worker_t* workers;
+    atomic_size_t active_workers; // the last worker to exit closes output
+    channel_t* input;
+    channel_t* output;
+    pipeline_t* pipeline;
+};
+
+struct pipeline {
+    enum pipeline_mode mode;
+    stage_t* stages;
+    size_t num_stages;
+    bool started;
+    channel_t* output;
+    channel_t* free_envelopes;
+    envelope_t* envelopes;
+    size_t num_envelopes;
+    atomic_uint_fast64_t next_seq;  // sequence number of the next pushed item
+    uint64_t next_pop;              // ordered mode: sequence number pipeline_pop returns next
+    envelope_t** reorder;           // ordered mode: finished envelopes indexed by seq % num_envelopes
+    uint64_t start_time;
+};
+
+static uint64_t pipeline_time()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * NS_PER_SEC + (uint64_t)now.tv_nsec;
+}
+
+static void counter_add(atomic_uint_fast64_t* counter, uint64_t value)
+{
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value, memory_order_relaxed);
+}
+
+static uint64_t counter_get(atomic_uint_fast64_t* counter)
+{
+    return atomic_load_explicit(counter, memory_order_relaxed);
+}
+
+static void* stage_worker(void* arg)
+{
+    stage_worker_t* worker = arg;
+    stage_t* stage = worker->stage;
+    pipeline_t* pipeline = stage->pipeline;
+    uint64_t count = 0;
+    while (true) {
+        envelope_t* envelope;
+        uint64_t t0 = pipeline_time();
+        enum channel_status status = channel_receive(stage->input, (void**)&envelope);
+        uint64_t t1 = pipeline_time();
+        counter_add(&worker->starved_ns, t1 - t0);
+        if (status != SUCCESS) {
+            // input closed and drained
+            break;
+        }
+        if (++count % DEPTH_SAMPLE_INTERVAL == 0) {
+            counter_add(&worker->depth_sum, channel_length(stage->input));
+            counter_add(&worker->depth_samples, 1);
+        }
+        if (!envelope->dropped) {
+            void* output = NULL;
+            if (stage->fn(envelope->data, &output, stage->arg)) {
+                envelope->data = output;
+            } else {
+                envelope->dropped = true;
+                counter_add(&worker->dropped, 1);
+            }
+        }
+        uint64_t t2 = pipeline_time();
+        counter_add(&worker->busy_ns, t2 - t1);
+        counter_add(&worker->items, 1);
+        if (envelope->dropped && pipeline->mode == PIPELINE_UNORDERED) {
+            // nothing downstream needs to see it; free_envelopes has room for every envelope
+            status = channel_send(pipeline->free_envelopes, envelope);
+        } else {
+            // ordered mode forwards dropped envelopes so pipeline_pop can advance past them
+            status = channel_send(stage->output, envelope);
+            counter_add(&worker->backpressure_ns, pipeline_time() - t2);
+        }
+        if (status != SUCCESS) {
+            // pipeline_destroy is tearing the pipeline down
+            break;
+        }
+    }
+    if (atomic_fetch_sub(&stage->active_workers, 1) == 1) {
+        // later stages still drain what this stage already produced
+        channel_close_send(stage->output);
+    }
+    return NULL;
+}
+
+pipeline_t* pipeline_create(enum pipeline_mode mode)
+{
+    pipeline_t* pipeline = calloc(1, sizeof(pipeline_t));
+    if (!pipeline) return NULL;
+    pipeline->mode = mode;
+    return pipeline;
+}
+
+int pipeline_add_stage(pipeline_t* pipeline, const char* name, stage_fn_t fn, void* arg, size_t workers, size_t capacity)
+{
+    if (!pipeline || pipeline->started || !fn || workers == 0) return -1;
+    stage_t* stages = realloc(pipeline->stages, sizeof(stage_t) * (pipeline->num_stages + 1));
+    if (!stages) return -1;
+    pipeline->stages = stages;
+    stage_t* stage = &stages[pipeline->num_stages];
+    stage->name = name;
+    stage->fn = fn;
+    stage->arg = arg;
+    stage->capacity = capacity;
+    stage->num_workers = workers;
+    stage->workers = NULL;
+    stage->input = NULL;
+    stage->output = NULL;
+    return (int)pipeline->num_stages++;
+}
+
+// Frees everything created by pipeline_start; workers must not be running
+static void pipeline_free_resources(pipeline_t* pipeline)
+{
+    for (size_t i = 0; i < pipeline->num_stages; i++) {
+        stage_t* stage = &pipeline->stages[i];
+        if (stage->input) {
+            channel_close(stage->input);
+            channel_destroy(stage->input);
+        }
+        free(stage->workers);
+    }
+    if (pipeline->output) {
+        channel_close(pipeline->output);
+        channel_destroy(pipeline->output);
+    }
+    if (pipeline->free_envelopes) {
+        channel_close(pipeline->free_envelopes);
+        channel_destroy(pipeline->free_envelopes);
+    }
+    free(pipeline->envelopes);
+    free(pipeline->reorder);
+    free(pipeline->stages);
+    free(pipeline);
+}
+
+enum channel_status pipeline_start(pipeline_t* pipeline, size_t output_capacity)
+{
+    if (!pipeline || pipeline->started || pipeline->num_stages == 0) return GENERIC_ERROR;
+    // enough envelopes to fill every channel and keep every worker busy
+    size_t num_envelopes = output_capacity + 1;
+    for (size_t i = 0; i < pipeline->num_stages; i++) {
+        stage_t* stage = &pipeline->stages[i];
+        num_envelopes += stage->capacity + stage->num_workers;
+        // FIFO hand-off keeps workers of a stage evenly fed and allows unbuffered (capacity 0) stages
+        stage->input = channel_create_ex(stage->capacity, CHANNEL_FIFO);
+        stage->workers = calloc(stage->num_workers, sizeof(stage_worker_t));
+        if (!stage->input || !stage->workers) return GENERIC_ERROR;
+        if (i > 0) pipeline->stages[i - 1].output = stage->input;
+    }
+    pipeline->output = channel_create_ex(output_capacity, CHANNEL_FIFO);
+    pipeline->free_envelopes = channel_create(num_envelopes);
+    pipeline->envelopes = malloc(sizeof(envelope_t) * num_envelopes);
+    pipeline->reorder = calloc(num_envelopes, sizeof(envelope_t*));
+    if (!pipeline->output || !pipeline->free_envelopes || !pipeline->envelopes || !pipeline->reorder) {
+        return GENERIC_ERROR;
+    }
+    pipeline->stages[pipeline->num_stages - 1].output = pipeline->output;
+    pipeline->num_envelopes = num_envelopes;
+    for (size_t i = 0; i < num_envelopes; i++) {
+        channel_send(pipeline->free_envelopes, &pipeline->envelopes[i]);
+    }
+    atomic_store(&pipeline->next_seq, 0);
+    pipeline->next_pop = 0;
+    pipeline->start_time = pipeline_time();
+    pipeline->started = true;
+    size_t thread_index = 0; // workers are numbered across stages, so neighbouring stages get neighbouring CPUs
+    for (size_t i = 0; i < pipeline->num_stages; i++) {
+        stage_t* stage = &pipeline->stages[i];
+        stage->pipeline = pipeline;
+        atomic_store(&stage->active_workers, stage->num_workers);
+        for (size_t w = 0; w < stage->num_workers; w++) {
+            stage->workers[w].stage = stage;
+            int pthread_status = affinity_thread_create(&stage->workers[w].pid, stage_worker, &stage->workers[w],
+                                                        thread_index++);
+            assert(pthread_status == 0);
+        }
+    }
+    return SUCCESS;
+}
+
+enum channel_status pipeline_push(pipeline_t* pipeline, void* item)
+{
+    if (!pipeline || !pipeline->started) return GENERIC_ERROR;
+    envelope_t* envelope;
+    // blocks while every envelope is in flight
+    enum channel_status status = channel_receive(pipeline->free_envelopes, (void**)&envelope);
+    if (status != SUCCESS) return status;
+    envelope->dropped = false;
+    envelope->data = item;
+    // every unpopped sequence number holds an envelope, so they always fit the reorder window
+    envelope->seq = atomic_fetch_add(&pipeline->next_seq, 1);
+    status = channel_send(pipeline->stages[0].input, envelope);
+    if (status != SUCCESS) {
+        channel_send(pipeline->free_envelopes, envelope);
+    }
+    return status;
+}
+
+enum channel_status pipeline_pop(pipeline_t* pipeline, void** item)
+{
+    if (!pipeline || !pipeline->started || !item) return GENERIC_ERROR;
+    envelope_t* envelope;
+    while (true) {
+        if (pipeline->mode == PIPELINE_ORDERED) {
+            envelope_t** slot = &pipeline->reorder[pipeline->next_pop % pipeline->num_envelopes];
+            while (*slot == NULL) {
+                enum channel_status status = channel_receive(pipeline->output, (void**)&envelope);
+                if (status == SUCCESS) {
+                    pipeline->reorder[envelope->seq % pipeline->num_envelopes] = envelope;
+                    continue;
+                }
+                // a push that lost the race with pipeline_close leaves a hole; skip to the next finished item
+                size_t skipped = 0;
+                while (*slot == NULL && ++skipped < pipeline->num_envelopes) {
+                    pipeline->next_pop++;
+                    slot = &pipeline->reorder[pipeline->next_pop % pipeline->num_envelopes];
+                }
+                if (*slot == NULL) return status;
+            }
+            envelope = *slot;
+            *slot = NULL;
+            pipeline->next_pop++;
+        } else {
+            enum channel_status status = channel_receive(pipeline->output, (void**)&envelope);
+            if (status != SUCCESS) return status;
+        }
+        bool dropped = envelope->dropped;
+        *item = envelope->data;
+        channel_send(pipeline->free_envelopes, envelope);
+        if (!dropped) return SUCCESS;
+    }
+}
+
+enum channel_status pipeline_close(pipeline_t* pipeline)
+{
+    if (!pipeline || !pipeline->started) return GENERIC_ERROR;
+    // workers drain what is buffered, then each stage closes the next one behind its last item
+    return channel_close_send(pipeline->stages[0].input);
+}
+
+size_t pipeline_stage_count(pipeline_t* pipeline)
+{
+    return pipeline->num_stages;
+}
+
+void pipeline_stats(pipeline_t* pipeline, size_t index, stage_stats_t* stats)
+{
+    stage_t* stage = &pipeline->stages[index];
+    uint64_t depth_sum = 0, depth_samples = 0;
+    uint64_t starved = 0, backpressure = 0, busy = 0;
+    stats->name = stage->name;
+    stats->workers = stage->num_workers;
+    stats->items = 0;
+    stats->dropped = 0;
+    for (size_t w = 0; w < stage->num_workers; w++) {
+        stage_worker_t* worker = &stage->workers[w];
+        stats->items += counter_get(&worker->items);
+        stats->dropped += counter_get(&worker->dropped);
+        starved += counter_get(&worker->starved_ns);
+        backpressure += counter_get(&worker->backpressure_ns);
+        busy += counter_get(&worker->busy_ns);
+        depth_sum += counter_get(&worker->depth_sum);
+        depth_samples += counter_get(&worker->depth_samples);
+    }
+    double elapsed = (double)(pipeline_time() - pipeline->start_time) / (double)NS_PER_SEC;
+    stats->throughput = (double)stats->items / elapsed;
+    stats->queue_depth = channel_length(stage->input);
+    stats->queue_capacity = stage->capacity;
+    stats->avg_queue_depth = depth_samples ? (double)depth_sum / (double)depth_samples : (double)stats->queue_depth;
+    stats->starved_sec = (double)starved / (double)NS_PER_SEC;
+    stats->backpressure_sec = (double)backpressure / (double)NS_PER_SEC;
+    stats->busy_sec = (double)busy / (double)NS_PER_SEC;
+}
+
+void pipeline_print_stats(pipeline_t* pipeline, FILE* out)
+{
+    fprintf(out, "%-16s %7s %10s %12s %13s %10s %10s %10s\n", "stage", "workers", "items", "items/s",
+            "depth(avg)", "busy(s)", "starved(s)", "backpr.(s)");
+    for (size_t i = 0; i < pipeline->num_stages; i++) {
+        stage_stats_t stats;
+        pipeline_stats(pipeline, i, &stats);
+        fprintf(out, "%-16s %7zu %10lu %12.0f %5zu/%-3zu(%3.1f) %10.3f %10.3f %10.3f\n", stats.name, stats.workers,
+                (unsigned long)stats.items, stats.throughput, stats.queue_depth, stats.queue_capacity,
+                stats.avg_queue_depth, stats.busy_sec, stats.starved_sec, stats.backpressure_sec);
+    }
+}
+
+enum channel_status pipeline_destroy(pipeline_t* pipeline)
+{
+    if (!pipeline) return GENERIC_ERROR;
+    if (pipeline->started) {
+        // closing every channel releases workers blocked anywhere; items still in flight are discarded
+        for (size_t i = 0; i < pipeline->num_stages; i++) {
+            channel_close(pipeline->stages[i].input);
+        }
+        channel_close(pipeline->output);
+        channel_close(pipeline->free_envelopes);
+        for (size_t i = 0; i < pipeline->num_stages; i++) {
+            stage_t* stage = &pipeline->stages[i];
+            for (size_t w = 0; w < stage->num_workers; w++) {
+                pthread_join(stage->workers[w].pid, NULL);
+            }
+        }
+    }
+    pipeline_free_resources(pipeline);
+    return SUCCESS;
+}
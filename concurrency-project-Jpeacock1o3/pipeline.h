@@ -0,0 +1,87 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "channel.h"
+
+// Multi-stage processing pipeline built from channels
+// Every stage runs a pool of worker threads that receive from the stage's input channel, apply the
+// stage function and send the result to the next stage's input channel
+//
+// Typical use:
+//   pipeline_t* p = pipeline_create(PIPELINE_ORDERED);
+//   pipeline_add_stage(p, "parse", parse_fn, NULL, 4, 16);
+//   pipeline_add_stage(p, "store", store_fn, db, 1, 64);
+//   pipeline_start(p, 16);
+//   ... pipeline_push(p, item) from any thread, pipeline_pop(p, &out) from one consumer ...
+//   pipeline_close(p); drain pipeline_pop until CLOSED_ERROR; pipeline_destroy(p);
+
+// Stage function: transforms input into *output
+// Returns false to drop the item, in which case it is not passed to later stages
+typedef bool (*stage_fn_t)(void* input, void** output, void* arg);
+
+enum pipeline_mode {
+    PIPELINE_UNORDERED, // items leave the pipeline as soon as the last stage finishes them
+    PIPELINE_ORDERED    // items leave the pipeline in the order they were pushed
+};
+
+// Per-stage metrics reported by pipeline_stats
+typedef struct {
+    const char* name;
+    size_t workers;
+    uint64_t items;            // items received by the stage, including dropped ones
+    uint64_t dropped;          // items the stage function dropped
+    double throughput;         // items per second since pipeline_start
+    size_t queue_depth;        // items waiting in the stage's input channel right now
+    size_t queue_capacity;     // capacity of the stage's input channel
+    double avg_queue_depth;    // input channel depth averaged over samples taken while receiving
+    double starved_sec;        // worker time spent waiting for input (upstream is the bottleneck)
+    double backpressure_sec;   // worker time spent waiting for space downstream (downstream is the bottleneck)
+    double busy_sec;           // worker time spent in the stage function
+} stage_stats_t;
+
+typedef struct pipeline pipeline_t;
+
+// Creates an empty pipeline
+pipeline_t* pipeline_create(enum pipeline_mode mode);
+
+// Appends a stage with the given number of worker threads whose input channel holds capacity items
+// Stages can only be added before pipeline_start
+// Returns the stage index, or -1 on error
+int pipeline_add_stage(pipeline_t* pipeline, const char* name, stage_fn_t fn, void* arg, size_t workers, size_t capacity);
+
+// Creates the channels and starts the worker threads; output_capacity sizes the final output channel
+// Workers are numbered across stages in order and pinned by that index under the affinity.h policy
+// Returns SUCCESS or GENERIC_ERROR
+enum channel_status pipeline_start(pipeline_t* pipeline, size_t output_capacity);
+
+// Feeds an item into the first stage, blocking while the pipeline is full
+// May be called from any number of threads
+// Returns SUCCESS, or CLOSED_ERROR once pipeline_close was called
+enum channel_status pipeline_push(pipeline_t* pipeline, void* item);
+
+// Takes the next finished item, blocking until one is available
+// Only one thread may pop at a time
+// Returns SUCCESS, or CLOSED_ERROR once the pipeline is closed and fully drained
+enum channel_status pipeline_pop(pipeline_t* pipeline, void** item);
+
+// Stops accepting new items; items already pushed still flow through every stage and can be popped
+enum channel_status pipeline_close(pipeline_t* pipeline);
+
+// Returns the number of stages
+size_t pipeline_stage_count(pipeline_t* pipeline);
+
+// Fills in the metrics of the given stage
+void pipeline_stats(pipeline_t* pipeline, size_t stage, stage_stats_t* stats);
+
+// Prints a table of the metrics of every stage
+void pipeline_print_stats(pipeline_t* pipeline, FILE* out);
+
+// Stops the worker threads and frees the pipeline
+// Call pipeline_close and drain pipeline_pop first; items still in flight are discarded
+enum channel_status pipeline_destroy(pipeline_t* pipeline);
+
+#endif // PIPELINE_H
@@ -0,0 +1,152 @@
+#include "rpc.h"
+#include <stdlib.h>
+
+enum rpc_call_state {
+    RPC_IDLE,     // in the pool
+    RPC_PENDING,  // sent, caller not parked yet
+    RPC_PARKED,   // caller parked on the state word
+    RPC_DONE      // reply stored
+};
+
+// Creates a request channel and a pool of slots
+rpc_t* rpc_create(size_t capacity, size_t slots)
+{
+    if (slots == 0) return NULL;
+    rpc_t* rpc = calloc(1, sizeof(rpc_t));
+    if (!rpc) return NULL;
+    rpc->requests = channel_create_ex(capacity, CHANNEL_FIFO);
+    rpc->free_calls = channel_create(slots);
+    rpc->calls = calloc(slots, sizeof(rpc_call_t));
+    if (!rpc->requests || !rpc->free_calls || !rpc->calls) {
+        if (rpc->requests) {
+            channel_close(rpc->requests);
+            channel_destroy(rpc->requests);
+        }
+        if (rpc->free_calls) {
+            channel_close(rpc->free_calls);
+            channel_destroy(rpc->free_calls);
+        }
+        free(rpc->calls);
+        free(rpc);
+        return NULL;
+    }
+    rpc->num_calls = slots;
+    for (size_t i = 0; i < slots; i++) {
+        rpc->calls[i].rpc = rpc;
+        channel_send(rpc->free_calls, &rpc->calls[i]);
+    }
+    return rpc;
+}
+
+// Sends request and returns the slot its reply will arrive in
+rpc_call_t* rpc_send(rpc_t* rpc, void* request)
+{
+    if (!rpc) return NULL;
+    rpc_call_t* call;
+    // blocks while every slot is in flight
+    if (channel_receive(rpc->free_calls, (void**)&call) != SUCCESS) return NULL;
+    call->id = atomic_fetch_add_explicit(&rpc->next_id, 1, memory_order_relaxed);
+    call->request = request;
+    call->reply = NULL;
+    atomic_store_explicit(&call->state, RPC_PENDING, memory_order_relaxed);
+    if (channel_send(rpc->requests, call) != SUCCESS) {
+        atomic_store_explicit(&call->state, RPC_IDLE, memory_order_relaxed);
+        channel_send(rpc->free_calls, call);
+        return NULL;
+    }
+    return call;
+}
+
+// Waits for the reply to call and returns the slot to the pool
+enum channel_status rpc_wait(rpc_call_t* call, void** reply)
+{
+    if (!call || !reply) return GENERIC_ERROR;
+    uint32_t state = RPC_PENDING;
+    // park only if the server hasn't replied yet; a failed CAS has read RPC_DONE and synchronized with
+    // the server's exchange, so the reply is visible either way
+    if (atomic_compare_exchange_strong(&call->state, &state, RPC_PARKED)) {
+        while (atomic_load_explicit(&call->state, memory_order_acquire) != RPC_DONE) {
+            futex_wait(&call->state, RPC_PARKED);
+        }
+    }
+    *reply = call->reply;
+    atomic_store_explicit(&call->state, RPC_IDLE, memory_order_relaxed);
+    channel_send(call->rpc->free_calls, call);
+    return SUCCESS;
+}
+
+// rpc_send followed by rpc_wait
+enum channel_status rpc_call(rpc_t* rpc, void* request, void** reply)
+{
+    if (!rpc || !reply) return GENERIC_ERROR;
+    rpc_call_t* call = rpc_send(rpc, request);
+    if (!call) return CLOSED_ERROR;
+    return rpc_wait(call, reply);
+}
+
+// Receives the next call
+enum channel_status rpc_serve(rpc_t* rpc, rpc_call_t** call)
+{
+    if (!rpc || !call) return GENERIC_ERROR;
+    return channel_receive(rpc->requests, (void**)call);
+}
+
+// Blocks for one call, then takes up to max - 1 more that are already queued
+size_t rpc_serve_batch(rpc_t* rpc, rpc_call_t** calls, size_t max)
+{
+    if (!rpc || !calls || max == 0) return 0;
+    if (channel_receive(rpc->requests, (void**)&calls[0]) != SUCCESS) return 0;
+    size_t count = 1;
+    while (count < max && channel_non_blocking_receive(rpc->requests, (void**)&calls[count]) == SUCCESS) {
+        count++;
+    }
+    return count;
+}
+
+// Helper: publishes the reply; returns true if the caller is parked and needs a wake-up
+static bool _store_reply(rpc_call_t* call, void* reply)
+{
+    call->reply = reply;
+    return atomic_exchange_explicit(&call->state, RPC_DONE, memory_order_acq_rel) == RPC_PARKED;
+}
+
+// Completes call with reply and wakes its caller
+void rpc_complete(rpc_call_t* call, void* reply)
+{
+    if (_store_reply(call, reply)) futex_wake_all(&call->state);
+}
+
+// Stores the replies of each chunk of up to 64 calls before waking any of their callers
+void rpc_complete_batch(rpc_call_t** calls, void** replies, size_t count)
+{
+    for (size_t base = 0; base < count; base += 64) {
+        size_t chunk = (count - base < 64) ? count - base : 64;
+        uint64_t parked = 0; // bit i: the caller of calls[base + i] needs a wake-up
+        for (size_t i = 0; i < chunk; i++) {
+            if (_store_reply(calls[base + i], replies[base + i])) parked |= (uint64_t)1 << i;
+        }
+        for (size_t i = 0; i < chunk; i++) {
+            if (parked & ((uint64_t)1 << i)) futex_wake_all(&calls[base + i]->state);
+        }
+    }
+}
+
+// Stops accepting calls
+enum channel_status rpc_close(rpc_t* rpc)
+{
+    if (!rpc) return GENERIC_ERROR;
+    return channel_close_send(rpc->requests);
+}
+
+// Frees the rpc
+enum channel_status rpc_destroy(rpc_t* rpc)
+{
+    if (!rpc) return GENERIC_ERROR;
+    enum channel_status status = channel_destroy(rpc->requests);
+    if (status != SUCCESS) return status;
+    channel_close(rpc->free_calls);
+    channel_destroy(rpc->free_calls);
+    free(rpc->calls);
+    free(rpc);
+    return SUCCESS;
+}
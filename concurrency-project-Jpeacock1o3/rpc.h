@@ -0,0 +1,74 @@
+#ifndef RPC_H
+#define RPC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include "channel.h"
+
+// Request/reply over one request channel and a pool of reply slots
+// A caller takes a slot from the pool, sends it as the request and parks on the slot's own futex word;
+// the server fills in the reply and wakes it directly. Slots go back to the pool after the reply is read,
+// so a call costs no allocation and no per-request channel. The pool bounds the calls in flight: callers
+// block in rpc_send while every slot is taken.
+//
+// Typical use:
+//   server: while (rpc_serve(rpc, &call) == SUCCESS) rpc_complete(call, handle(rpc_call_request(call)));
+//   client: rpc_call(rpc, request, &reply);  or  call = rpc_send(rpc, request); ...; rpc_wait(call, &reply);
+
+typedef struct rpc_call {
+    struct rpc* rpc;
+    uint64_t id;             // correlation id, unique per call even though slots are reused
+    void* request;
+    void* reply;
+    _Atomic uint32_t state;  // enum rpc_call_state, the futex word the caller parks on
+} rpc_call_t;
+
+typedef struct rpc {
+    channel_t* requests;     // rpc_call_t* from callers to the server
+    channel_t* free_calls;   // pool of idle slots
+    rpc_call_t* calls;
+    size_t num_calls;
+    atomic_uint_fast64_t next_id;
+} rpc_t;
+
+// Creates a request channel holding capacity requests and a pool of slots calls in flight at once
+rpc_t* rpc_create(size_t capacity, size_t slots);
+
+// Sends request and returns the slot its reply will arrive in, or NULL once the rpc is closed
+rpc_call_t* rpc_send(rpc_t* rpc, void* request);
+
+// Waits for the reply to call, stores it in *reply and returns the slot to the pool
+// Returns SUCCESS, or GENERIC_ERROR if call is NULL
+enum channel_status rpc_wait(rpc_call_t* call, void** reply);
+
+// rpc_send followed by rpc_wait; returns CLOSED_ERROR once the rpc is closed
+enum channel_status rpc_call(rpc_t* rpc, void* request, void** reply);
+
+// Server side: receives the next call
+// Returns SUCCESS, or CLOSED_ERROR once the rpc is closed and every queued call has been handed out
+enum channel_status rpc_serve(rpc_t* rpc, rpc_call_t** call);
+
+// Server side: blocks for one call, then takes up to max - 1 more that are already queued
+// Returns how many calls were stored in calls, 0 once the rpc is closed and drained
+size_t rpc_serve_batch(rpc_t* rpc, rpc_call_t** calls, size_t max);
+
+static inline void* rpc_call_request(const rpc_call_t* call)
+{
+    return call->request;
+}
+
+// Server side: completes call with reply and wakes its caller
+void rpc_complete(rpc_call_t* call, void* reply);
+
+// Server side: stores the replies of up to 64 calls at a time before waking any of their callers, so the
+// woken callers don't preempt the server halfway through a batch; the stack use stays fixed for any count
+void rpc_complete_batch(rpc_call_t** calls, void** replies, size_t count);
+
+// Stops accepting calls; calls already sent are still served
+enum channel_status rpc_close(rpc_t* rpc);
+
+// Frees the rpc; it must be closed, drained and no thread may still use it
+enum channel_status rpc_destroy(rpc_t* rpc);
+
+#endif // RPC_H
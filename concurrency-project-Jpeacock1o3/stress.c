@@ -5,16 +5,16 @@
 #include <stdbool.h>
 #include "channel.h"
 #include "stress.h"
+#include "topology.h"
+#include "affinity.h"
 
-typedef unsigned int distance_t;
 typedef struct {
     size_t src;
     size_t epoch;
     distance_t dist[0];
 } distance_vector_t;
 
-static const distance_t inf_distance = 0x7fffffff;
-static distance_t* topology;
+static topology_t topology;
 static distance_t* solution;
 static size_t num_channel;
 static channel_t** channels;
@@ -22,11 +22,7 @@ static channel_t* done_channel;
 static channel_t* completed_channel;
 
 distance_t get_link_distance(size_t src, size_t dst) {
-    return topology[src * num_channel + dst];
-}
-
-void set_link_distance(size_t src, size_t dst, distance_t distance) {
-    topology[src * num_channel + dst] = distance;
+    return topology_distance(&topology, src, dst);
 }
 
 distance_t get_solution_distance(size_t src, size_t dst) {
@@ -39,7 +35,14 @@ void set_solution_distance(size_t src, size_t dst, distance_t distance) {
 
 void floyd_warshall()
 {
-    memcpy(solution, topology, sizeof(distance_t) * num_channel * num_channel);
+    for (size_t i = 0; i < num_channel * num_channel; i++) {
+        solution[i] = inf_distance;
+    }
+    for (size_t src = 0; src < num_channel; src++) {
+        for (uint64_t edge = topology.row_offsets[src]; edge < topology.row_offsets[src + 1]; edge++) {
+            set_solution_distance(src, topology.cols[edge], topology.weights[edge]);
+        }
+    }
     for (size_t intermediate = 0; intermediate < num_channel; intermediate++) {
         for (size_t src = 0; src < num_channel; src++) {
             for (size_t dst = 0; dst < num_channel; dst++) {
@@ -85,32 +88,15 @@ void print_solution()
 
 bool create_topology(const char* filename)
 {
-    FILE* file = fopen(filename, "r");
-    if (file == NULL) {
+    // accepts both the NxN text matrix and the binary CSR format (see topology.h)
+    if (!topology_load(&topology, filename)) {
         printf("Could not open topology file: %s\n", filename);
         return false;
     }
-    int num_scanned = fscanf(file, "%zu", &num_channel);
-    assert(num_scanned == 1);
+    num_channel = topology.num_nodes;
     assert(num_channel > 0);
-    topology = malloc(sizeof(distance_t) * num_channel * num_channel);
-    assert(topology != NULL);
     solution = malloc(sizeof(distance_t) * num_channel * num_channel);
     assert(solution != NULL);
-    // populate topology
-    for (size_t src = 0; src < num_channel; src++) {
-        for (size_t dst = 0; dst < num_channel; dst++) {
-            distance_t distance;
-            num_scanned = fscanf(file, "%d", (int*)&distance);
-            assert(num_scanned == 1);
-            // negative values get converted to inf_distance
-            if (distance > inf_distance) {
-                distance = inf_distance;
-            }
-            set_link_distance(src, dst, distance);
-        }
-    }
-    fclose(file);
     // calculate solution using Floyd-Warshall algorithm
     floyd_warshall();
     return true;
@@ -118,7 +104,7 @@ bool create_topology(const char* filename)
 
 void destroy_topology()
 {
-    free(topology);
+    topology_destroy(&topology);
     free(solution);
 }
 
@@ -321,7 +307,7 @@ void run_stress(size_t main_buffer_size, size_t secondary_buffer_size, const cha
     pthread_t* pid = malloc(sizeof(pthread_t) * num_channel);
     assert(pid != NULL);
     for (size_t i = 0; i < num_channel; i++) {
-        pthread_status = pthread_create(&pid[i], NULL, router, (void*)i);
+        pthread_status = affinity_thread_create(&pid[i], router, (void*)i, i);
         assert(pthread_status == 0);
     }
 
@@ -1,6 +1,8 @@
 #ifndef STRESS_H
 #define STRESS_H
 
+// Runs the distance-vector routing stress test over the topology in filename
+// The topology may be a text matrix or a binary file produced by topology_convert
 void run_stress(size_t main_buffer_size, size_t secondary_buffer_size, const char* filename);
 
 #endif // STRESS_H
@@ -0,0 +1,393 @@
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "channel.h"
+#include "stress_linearizability.h"
+#include "affinity.h"
+
+// Sequential model of a bounded FIFO channel
+typedef struct {
+    size_t len;
+    bool closed;
+    bool send_closed;
+    size_t vals[LIN_MAX_CAPACITY];
+} lin_state_t;
+
+// Search node: an operation's call or return event in the time-ordered event list
+typedef struct lin_event {
+    bool is_call;
+    size_t op;
+    struct lin_event* match;  // the call's return event
+    struct lin_event* prev;
+    struct lin_event* next;
+} lin_event_t;
+
+// Visited (linearized set, model state) pairs; revisiting one can't lead anywhere new
+typedef struct {
+    uint64_t linearized;
+    lin_state_t state;
+    bool used;
+} lin_cache_slot_t;
+
+typedef struct {
+    lin_cache_slot_t* slots;
+    size_t capacity;
+    size_t count;
+} lin_cache_t;
+
+static const char* lin_op_names[] = {"send", "recv", "nb_send", "nb_recv", "close", "close_send"};
+
+// Applies op to state if the model allows op to return what it returned; state is left untouched otherwise
+static bool lin_apply(lin_state_t* state, size_t capacity, const lin_op_t* op)
+{
+    switch (op->kind) {
+    case LIN_SEND:
+    case LIN_NB_SEND:
+        if (state->closed || state->send_closed) return op->status == CLOSED_ERROR;
+        if (state->len == capacity) {
+            // a blocking send can't complete on a full channel, so it must linearize later
+            return op->kind == LIN_NB_SEND && op->status == CHANNEL_FULL;
+        }
+        if (op->status != SUCCESS) return false;
+        state->vals[state->len++] = op->value;
+        return true;
+    case LIN_RECV:
+    case LIN_NB_RECV:
+        if (state->closed) return op->status == CLOSED_ERROR;
+        if (state->len == 0) {
+            if (state->send_closed) return op->status == CLOSED_ERROR;
+            return op->kind == LIN_NB_RECV && op->status == CHANNEL_EMPTY;
+        }
+        if (op->status != SUCCESS || op->value != state->vals[0]) return false;
+        memmove(&state->vals[0], &state->vals[1], sizeof(size_t) * (state->len - 1));
+        state->vals[--state->len] = 0;
+        return true;
+    case LIN_CLOSE:
+        if (state->closed) return op->status == CLOSED_ERROR;
+        if (op->status != SUCCESS) return false;
+        state->closed = true;
+        return true;
+    case LIN_CLOSE_SEND:
+        if (state->closed || state->send_closed) return op->status == CLOSED_ERROR;
+        if (op->status != SUCCESS) return false;
+        state->send_closed = true;
+        return true;
+    }
+    return false;
+}
+
+static bool lin_state_equal(const lin_state_t* a, const lin_state_t* b)
+{
+    return a->len == b->len && a->closed == b->closed && a->send_closed == b->send_closed &&
+           memcmp(a->vals, b->vals, sizeof(size_t) * a->len) == 0;
+}
+
+static uint64_t lin_hash(uint64_t linearized, const lin_state_t* state)
+{
+    uint64_t h = linearized * 0x9e3779b97f4a7c15ull;
+    h ^= (uint64_t)state->len | ((uint64_t)state->closed << 8) | ((uint64_t)state->send_closed << 9);
+    for (size_t i = 0; i < state->len; i++) {
+        h = (h ^ state->vals[i]) * 0x100000001b3ull;
+    }
+    return h ^ (h >> 29);
+}
+
+static void lin_cache_put(lin_cache_t* cache, uint64_t linearized, const lin_state_t* state)
+{
+    size_t mask = cache->capacity - 1;
+    size_t i = (size_t)lin_hash(linearized, state) & mask;
+    while (cache->slots[i].used) i = (i + 1) & mask;
+    cache->slots[i] = (lin_cache_slot_t){linearized, *state, true};
+    cache->count++;
+}
+
+// Returns false if the pair was already visited, otherwise records it and returns true
+static bool lin_cache_insert(lin_cache_t* cache, uint64_t linearized, const lin_state_t* state)
+{
+    size_t mask = cache->capacity - 1;
+    for (size_t i = (size_t)lin_hash(linearized, state) & mask; cache->slots[i].used; i = (i + 1) & mask) {
+        if (cache->slots[i].linearized == linearized && lin_state_equal(&cache->slots[i].state, state)) return false;
+    }
+    if ((cache->count + 1) * 2 > cache->capacity) {
+        // keep the load factor at or below one half
+        lin_cache_t grown = {calloc(cache->capacity * 2, sizeof(lin_cache_slot_t)), cache->capacity * 2, 0};
+        assert(grown.slots != NULL);
+        for (size_t i = 0; i < cache->capacity; i++) {
+            if (cache->slots[i].used) lin_cache_put(&grown, cache->slots[i].linearized, &cache->slots[i].state);
+        }
+        free(cache->slots);
+        *cache = grown;
+    }
+    lin_cache_put(cache, linearized, state);
+    return true;
+}
+
+static int lin_compare_events(const void* a, const void* b)
+{
+    uint64_t x = ((const uint64_t*)a)[0];
+    uint64_t y = ((const uint64_t*)b)[0];
+    return (x > y) - (x < y);
+}
+
+// Removes a call event and its return event from the event list
+static void lin_lift(lin_event_t* call)
+{
+    call->prev->next = call->next;
+    if (call->next) call->next->prev = call->prev;
+    lin_event_t* ret = call->match;
+    ret->prev->next = ret->next;
+    if (ret->next) ret->next->prev = ret->prev;
+}
+
+// Undoes lin_lift; events must be restored in the reverse order they were lifted
+static void lin_unlift(lin_event_t* call)
+{
+    lin_event_t* ret = call->match;
+    ret->prev->next = ret;
+    if (ret->next) ret->next->prev = ret;
+    call->prev->next = call;
+    if (call->next) call->next->prev = call;
+}
+
+// Wing & Gong search with Lowe's memoization: repeatedly linearize the earliest call the model accepts,
+// and backtrack when a return event is reached before its call could be linearized
+bool lin_check(const lin_history_t* history)
+{
+    size_t n = history->count;
+    assert(n <= LIN_MAX_OPS);
+    lin_event_t events[2 * LIN_MAX_OPS];
+    uint64_t order[2 * LIN_MAX_OPS][2]; // (timestamp, event index) pairs sorted by timestamp
+    for (size_t i = 0; i < n; i++) {
+        events[2 * i] = (lin_event_t){true, i, &events[2 * i + 1], NULL, NULL};
+        events[2 * i + 1] = (lin_event_t){false, i, NULL, NULL, NULL};
+        order[2 * i][0] = history->ops[i].invoke;
+        order[2 * i][1] = 2 * i;
+        order[2 * i + 1][0] = history->ops[i].response;
+        order[2 * i + 1][1] = 2 * i + 1;
+    }
+    qsort(order, 2 * n, sizeof(order[0]), lin_compare_events);
+    lin_event_t head = {false, 0, NULL, NULL, NULL};
+    lin_event_t* last = &head;
+    for (size_t i = 0; i < 2 * n; i++) {
+        lin_event_t* event = &events[order[i][1]];
+        event->prev = last;
+        last->next = event;
+        last = event;
+    }
+
+    struct {
+        lin_event_t* call;
+        lin_state_t state;
+    } stack[LIN_MAX_OPS];
+    size_t depth = 0;
+    lin_cache_t cache = {calloc(1024, sizeof(lin_cache_slot_t)), 1024, 0};
+    assert(cache.slots != NULL);
+    lin_state_t state;
+    memset(&state, 0, sizeof(state));
+    uint64_t linearized = 0;
+    bool ok = true;
+    lin_event_t* event = head.next;
+    while (head.next != NULL) {
+        if (event->is_call) {
+            lin_state_t next = state;
+            if (lin_apply(&next, history->capacity, &history->ops[event->op]) &&
+                lin_cache_insert(&cache, linearized | (1ull << event->op), &next)) {
+                stack[depth].call = event;
+                stack[depth].state = state;
+                depth++;
+                state = next;
+                linearized |= 1ull << event->op;
+                lin_lift(event);
+                event = head.next;
+            } else {
+                event = event->next;
+            }
+        } else {
+            // an operation returned before anything we tried let it linearize: undo the latest choice
+            if (depth == 0) {
+                ok = false;
+                break;
+            }
+            depth--;
+            lin_event_t* call = stack[depth].call;
+            state = stack[depth].state;
+            linearized &= ~(1ull << call->op);
+            lin_unlift(call);
+            event = call->next;
+        }
+    }
+    free(cache.slots);
+    return ok;
+}
+
+static int lin_compare_invoke(const void* a, const void* b)
+{
+    uint64_t x = ((const lin_op_t*)a)->invoke;
+    uint64_t y = ((const lin_op_t*)b)->invoke;
+    return (x > y) - (x < y);
+}
+
+// Prints the history, one operation per line in invoke order
+void lin_print_history(const lin_history_t* history)
+{
+    lin_op_t sorted[LIN_MAX_OPS];
+    memcpy(sorted, history->ops, sizeof(lin_op_t) * history->count);
+    qsort(sorted, history->count, sizeof(lin_op_t), lin_compare_invoke);
+    printf("history (capacity %zu):\n", history->capacity);
+    for (size_t i = 0; i < history->count; i++) {
+        lin_op_t* op = &sorted[i];
+        printf("  [%4lu, %4lu] thread %2zu %-10s value %#8zx status %d\n", (unsigned long)op->invoke,
+               (unsigned long)op->response, op->thread, lin_op_names[op->kind], op->value, op->status);
+    }
+}
+
+// Shared state of the round being run
+static _Atomic uint64_t lin_clock;       // logical clock; fetch_add gives every event a unique timestamp
+static atomic_size_t lin_completed;      // operations finished by the workers so far
+
+typedef struct {
+    channel_t* channel;
+    size_t thread;
+    size_t num_ops;
+    uint64_t rng;
+    lin_op_t* ops;
+} lin_worker_args;
+
+static uint64_t lin_random(uint64_t* rng)
+{
+    // xorshift64*: cheap, and reproducible from the round's seed
+    *rng ^= *rng >> 12;
+    *rng ^= *rng << 25;
+    *rng ^= *rng >> 27;
+    return *rng * 0x2545f4914f6cdd1dull;
+}
+
+// Randomly yields, spins or sleeps so rounds explore different interleavings
+static void lin_perturb(uint64_t* rng)
+{
+    uint64_t r = lin_random(rng);
+    switch (r % 8) {
+    case 0:
+        sched_yield();
+        break;
+    case 1:
+        for (uint64_t i = (r >> 8) % 512; i > 0; i--) {
+            atomic_signal_fence(memory_order_seq_cst);
+        }
+        break;
+    case 2:
+        usleep((useconds_t)((r >> 8) % 20));
+        break;
+    default:
+        break;
+    }
+}
+
+static void* lin_worker(void* arg)
+{
+    lin_worker_args* args = arg;
+    for (size_t i = 0; i < args->num_ops; i++) {
+        lin_perturb(&args->rng);
+        lin_op_t* op = &args->ops[i];
+        op->kind = (enum lin_op_kind)(lin_random(&args->rng) % 4);
+        op->thread = args->thread;
+        op->value = ((args->thread + 1) << 16) | (i + 1); // unique and never NULL
+        void* data = NULL;
+        op->invoke = atomic_fetch_add(&lin_clock, 1);
+        switch (op->kind) {
+        case LIN_SEND:
+            op->status = channel_send(args->channel, (void*)op->value);
+            break;
+        case LIN_NB_SEND:
+            op->status = channel_non_blocking_send(args->channel, (void*)op->value);
+            break;
+        case LIN_RECV:
+            op->status = channel_receive(args->channel, &data);
+            break;
+        default:
+            op->status = channel_non_blocking_receive(args->channel, &data);
+            break;
+        }
+        op->response = atomic_fetch_add(&lin_clock, 1);
+        if (op->kind == LIN_RECV || op->kind == LIN_NB_RECV) {
+            op->value = (op->status == SUCCESS) ? (size_t)data : 0;
+        }
+        atomic_fetch_add(&lin_completed, 1);
+    }
+    return NULL;
+}
+
+// Runs one round and fills in its history
+static void lin_run_round(lin_history_t* history, unsigned int flags, size_t num_threads, size_t ops_per_thread,
+                          uint64_t seed)
+{
+    uint64_t rng = seed | 1;
+    channel_t* channel = channel_create_ex(history->capacity, flags);
+    assert(channel != NULL);
+    atomic_store(&lin_clock, 0);
+    atomic_store(&lin_completed, 0);
+    pthread_t pid[num_threads];
+    lin_worker_args args[num_threads];
+    for (size_t i = 0; i < num_threads; i++) {
+        args[i] = (lin_worker_args){channel, i, ops_per_thread, lin_random(&rng) | 1, &history->ops[i * ops_per_thread]};
+        int pthread_status = affinity_thread_create(&pid[i], lin_worker, &args[i], i);
+        assert(pthread_status == 0);
+    }
+
+    // close once the workers are done or stuck on blocking calls, or sometimes early to race the close
+    size_t total = num_threads * ops_per_thread;
+    size_t close_after = (lin_random(&rng) % 4 == 0) ? (size_t)(lin_random(&rng) % total) : total;
+    size_t previous = SIZE_MAX;
+    size_t idle_polls = 0;
+    while (true) {
+        size_t completed = atomic_load(&lin_completed);
+        if (completed >= close_after) break;
+        idle_polls = (completed == previous) ? idle_polls + 1 : 0;
+        if (idle_polls >= 3) break;
+        previous = completed;
+        usleep(200);
+    }
+    lin_op_t* close_op = &history->ops[total];
+    close_op->kind = (lin_random(&rng) % 2) ? LIN_CLOSE : LIN_CLOSE_SEND;
+    close_op->thread = num_threads;
+    close_op->value = 0;
+    close_op->invoke = atomic_fetch_add(&lin_clock, 1);
+    close_op->status = (close_op->kind == LIN_CLOSE) ? channel_close(channel) : channel_close_send(channel);
+    close_op->response = atomic_fetch_add(&lin_clock, 1);
+
+    for (size_t i = 0; i < num_threads; i++) {
+        pthread_join(pid[i], NULL);
+    }
+    history->count = total + 1;
+    channel_close(channel);
+    channel_destroy(channel);
+}
+
+bool run_stress_linearizability(size_t capacity, unsigned int flags, size_t num_threads, size_t ops_per_thread,
+                                size_t rounds, uint64_t seed)
+{
+    assert(num_threads * ops_per_thread < LIN_MAX_OPS);
+    assert(capacity >= 1 && capacity <= LIN_MAX_CAPACITY);
+    lin_history_t* history = malloc(sizeof(lin_history_t));
+    assert(history != NULL);
+    history->capacity = capacity;
+    uint64_t rng = seed | 1;
+    bool ok = true;
+    for (size_t round = 0; round < rounds && ok; round++) {
+        uint64_t round_seed = lin_random(&rng);
+        lin_run_round(history, flags, num_threads, ops_per_thread, round_seed);
+        if (!lin_check(history)) {
+            printf("Non-linearizable history in round %zu (capacity %zu, flags %#x, round seed %#lx)\n", round,
+                   capacity, flags, (unsigned long)round_seed);
+            lin_print_history(history);
+            ok = false;
+        }
+    }
+    free(history);
+    return ok;
+}
@@ -0,0 +1,55 @@
+#ifndef STRESS_LINEARIZABILITY_H
+#define STRESS_LINEARIZABILITY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Linearizability stress harness for channel implementations
+// Worker threads run random sends and receives with randomized schedule perturbation while every call
+// is recorded with logical invoke/response timestamps; each round's history is then checked against a
+// sequential bounded FIFO channel model. Only the public channel API is used, so any backend can be checked.
+
+#define LIN_MAX_OPS 64      // operations per checked history (the checker tracks them in a 64-bit set)
+#define LIN_MAX_CAPACITY 8  // largest channel capacity the model supports
+
+enum lin_op_kind {
+    LIN_SEND,         // channel_send
+    LIN_RECV,         // channel_receive
+    LIN_NB_SEND,      // channel_non_blocking_send
+    LIN_NB_RECV,      // channel_non_blocking_receive
+    LIN_CLOSE,        // channel_close
+    LIN_CLOSE_SEND    // channel_close_send
+};
+
+// One completed call
+typedef struct {
+    enum lin_op_kind kind;
+    size_t thread;
+    size_t value;     // message sent, or message received when a receive returned SUCCESS
+    int status;       // enum channel_status the call returned
+    uint64_t invoke;  // logical time just before the call
+    uint64_t response; // logical time just after it returned
+} lin_op_t;
+
+typedef struct {
+    size_t capacity;
+    size_t count;
+    lin_op_t ops[LIN_MAX_OPS];
+} lin_history_t;
+
+// Returns true if some sequential order of the history's operations, consistent with their real-time
+// order, is accepted by the FIFO channel model
+bool lin_check(const lin_history_t* history);
+
+// Prints the history, one operation per line in invoke order
+void lin_print_history(const lin_history_t* history);
+
+// Runs rounds of num_threads threads doing ops_per_thread random operations each on a fresh channel
+// created with channel_create_ex(capacity, flags), and checks every round's history
+// num_threads * ops_per_thread must be below LIN_MAX_OPS; 1 <= capacity <= LIN_MAX_CAPACITY
+// Returns true if every history was linearizable; the first violation is printed with its seed
+bool run_stress_linearizability(size_t capacity, unsigned int flags, size_t num_threads, size_t ops_per_thread,
+                                size_t rounds, uint64_t seed);
+
+#endif // STRESS_LINEARIZABILITY_H
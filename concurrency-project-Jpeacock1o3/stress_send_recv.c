@@ -2,15 +2,29 @@
 #include <pthread.h>
 #include <assert.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
 #include <stdatomic.h>
+#include <sched.h>
+#include <math.h>
+#include <time.h>
 #include "channel.h"
 #include "stress_send_recv.h"
+#include "affinity.h"
 
 static size_t num_channel;
 static channel_t** channels;
 static atomic_bool done;
 static channel_t* main_channel;
+static atomic_size_t hops;
+
+static uint64_t stress_time(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
 
 void* worker_thread(void* arg)
 {
@@ -22,6 +36,7 @@ void* worker_thread(void* arg)
     channel_t* my_channel = channels[index];
     channel_t* next_channel = channels[next_index];
     bool start = true;
+    size_t my_hops = 0;
     enum channel_status status;
     while (true) {
         void* data = NULL;
@@ -49,17 +64,20 @@ void* worker_thread(void* arg)
             // Pass along message to next thread in ring
             status = channel_send(next_channel, data);
             assert(status == SUCCESS);
+            my_hops++;
         }
     }
+    atomic_fetch_add(&hops, my_hops);
     return NULL;
 }
 
-void run_stress_send_recv(size_t buffer_size, size_t num_threads, double load, useconds_t duration_usec)
+double run_stress_send_recv(size_t buffer_size, size_t num_threads, double load, useconds_t duration_usec)
 {
     enum channel_status status;
     // setup
     num_channel = num_threads;
     atomic_store(&done, false);
+    atomic_store(&hops, 0);
     size_t num_msgs = (size_t)(((double)(num_channel * (buffer_size + 1))) * load);
     bool* msg_check = calloc(num_msgs + 1, sizeof(bool));
     assert(msg_check != NULL);
@@ -76,7 +94,7 @@ void run_stress_send_recv(size_t buffer_size, size_t num_threads, double load, u
     pthread_t* pid = malloc(sizeof(pthread_t) * num_channel);
     assert(pid != NULL);
     for (size_t i = 0; i < num_channel; i++) {
-        int pthread_status = pthread_create(&pid[i], NULL, worker_thread, (void*)i);
+        int pthread_status = affinity_thread_create(&pid[i], worker_thread, (void*)i, i);
         assert(pthread_status == 0);
     }
 
@@ -93,10 +111,12 @@ void run_stress_send_recv(size_t buffer_size, size_t num_threads, double load, u
     }
 
     // wait for duration
+    uint64_t start = stress_time();
     usleep(duration_usec);
 
     // stop test
     atomic_store(&done, true);
+    uint64_t elapsed = stress_time() - start;
     for (size_t msg = 1; msg <= num_msgs; msg++) {
         // pull data from threads
         size_t data = 0;
@@ -133,4 +153,218 @@ void run_stress_send_recv(size_t buffer_size, size_t num_threads, double load, u
     free(msg_check);
     free(pid);
     free(channels);
+    // hops made while the messages were being pulled out are counted too, which is noise at these durations
+    return (double)atomic_load(&hops) * 1e9 / (double)elapsed;
+}
+
+// Open-loop generator
+
+typedef struct {
+    uint64_t scheduled; // when the schedule said to send it
+    uint64_t sent;      // when channel_send was called
+    size_t id;          // producer * per_producer + sequence
+} ol_header_t;
+
+typedef struct {
+    const stress_open_loop_config_t* config;
+    channel_t* channel;
+    size_t producer;
+    size_t per_producer;   // message slots the producer may use
+    unsigned char* pool;   // per_producer messages of message_size bytes
+    uint64_t start;
+    uint64_t end;
+    size_t sent;
+} ol_producer_args;
+
+typedef struct {
+    const stress_open_loop_config_t* config;
+    channel_t* channel;
+    bool* seen;            // indexed by message id
+    uint64_t* corrected;   // latency from the scheduled time, indexed by message id
+    uint64_t* raw;         // latency from the actual send, indexed by message id
+    size_t received;
+    uint64_t last;         // time of the last receipt
+} ol_consumer_args;
+
+static double ol_uniform(uint64_t* state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return ((double)(*state >> 11) + 1.0) / 9007199254740993.0; // (0, 1]
+}
+
+// Helper: waits for the deadline, sleeping while it is far away and yielding once it is close
+static void ol_wait_until(uint64_t deadline)
+{
+    uint64_t now;
+    while ((now = stress_time()) < deadline) {
+        if (deadline - now > 200000) {
+            usleep((useconds_t)((deadline - now - 100000) / 1000));
+        } else {
+            sched_yield();
+        }
+    }
+}
+
+static void* ol_producer(void* arg)
+{
+    ol_producer_args* args = arg;
+    const stress_open_loop_config_t* config = args->config;
+    double mean_gap = 1e9 * (double)config->producers / config->rate;
+    uint64_t rng = (config->seed + args->producer + 1) * 0x9E3779B97F4A7C15ull | 1;
+    // producers' constant schedules interleave instead of firing together
+    double scheduled = (double)args->start + mean_gap * (double)args->producer / (double)config->producers;
+    for (size_t i = 0; i < args->per_producer; i++) {
+        scheduled += (config->arrival == STRESS_ARRIVAL_POISSON) ? -log(ol_uniform(&rng)) * mean_gap : mean_gap;
+        if ((uint64_t)scheduled >= args->end) break;
+        // a producer held up by a full channel doesn't wait here, it catches up on its backlog
+        ol_wait_until((uint64_t)scheduled);
+        unsigned char* message = args->pool + i * config->message_size;
+        ol_header_t* header = (ol_header_t*)message;
+        header->scheduled = (uint64_t)scheduled;
+        header->id = args->producer * args->per_producer + i;
+        memset(message + sizeof(ol_header_t), (int)(header->id & 0xff), config->message_size - sizeof(ol_header_t));
+        header->sent = stress_time();
+        enum channel_status status = channel_send(args->channel, message);
+        assert(status == SUCCESS);
+        args->sent++;
+    }
+    return NULL;
+}
+
+static void* ol_consumer(void* arg)
+{
+    ol_consumer_args* args = arg;
+    size_t payload = args->config->message_size - sizeof(ol_header_t);
+    void* data;
+    while (channel_receive(args->channel, &data) == SUCCESS) {
+        uint64_t now = stress_time();
+        ol_header_t* header = data;
+        unsigned char* body = (unsigned char*)data + sizeof(ol_header_t);
+        // touch the payload the way a real consumer would read it
+        for (size_t b = 0; b < payload; b++) {
+            assert(body[b] == (unsigned char)(header->id & 0xff));
+        }
+        assert(!args->seen[header->id]);
+        args->seen[header->id] = true;
+        args->corrected[header->id] = now - header->scheduled;
+        args->raw[header->id] = now - header->sent;
+        args->received++;
+        args->last = now;
+    }
+    return NULL;
+}
+
+static int ol_compare(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static uint64_t ol_percentile(const uint64_t* sorted, size_t count, double fraction)
+{
+    if (count == 0) return 0;
+    size_t index = (size_t)(fraction * (double)count);
+    return sorted[(index < count) ? index : count - 1];
+}
+
+bool run_stress_open_loop(const stress_open_loop_config_t* config, stress_open_loop_report_t* report)
+{
+    if (!config || !report || config->producers == 0 || config->consumers == 0 || !(config->rate > 0) ||
+        config->message_size < sizeof(ol_header_t) || config->duration_usec == 0) {
+        return false;
+    }
+    // enough slots for the expected arrivals plus a Poisson tail several standard deviations long
+    double expected = config->rate * (double)config->duration_usec / 1e6 / (double)config->producers;
+    size_t per_producer = (size_t)(expected + 6.0 * sqrt(expected)) + 16;
+    size_t total = per_producer * config->producers;
+    channel_t* channel = channel_create(config->buffer_size);
+    unsigned char* pool = malloc(total * config->message_size);
+    bool* seen = calloc(total, sizeof(bool));
+    uint64_t* corrected = malloc(total * sizeof(uint64_t));
+    uint64_t* raw = malloc(total * sizeof(uint64_t));
+    pthread_t* pid = malloc((config->producers + config->consumers) * sizeof(pthread_t));
+    ol_producer_args* producers = calloc(config->producers, sizeof(ol_producer_args));
+    ol_consumer_args* consumers = calloc(config->consumers, sizeof(ol_consumer_args));
+    assert(channel && pool && seen && corrected && raw && pid && producers && consumers);
+
+    // consumers take the low thread indices so compact affinity pairs them with producers
+    for (size_t c = 0; c < config->consumers; c++) {
+        consumers[c] = (ol_consumer_args){config, channel, seen, corrected, raw, 0, 0};
+        int pthread_status = affinity_thread_create(&pid[c], ol_consumer, &consumers[c], 2 * c + 1);
+        assert(pthread_status == 0);
+    }
+    uint64_t start = stress_time() + 1000000; // leaves the threads a millisecond to start
+    for (size_t p = 0; p < config->producers; p++) {
+        producers[p] = (ol_producer_args){config, channel, p, per_producer, pool + p * per_producer * config->message_size,
+                                          start, start + (uint64_t)config->duration_usec * 1000, 0};
+        int pthread_status = affinity_thread_create(&pid[config->consumers + p], ol_producer, &producers[p], 2 * p);
+        assert(pthread_status == 0);
+    }
+    size_t sent = 0;
+    for (size_t p = 0; p < config->producers; p++) {
+        pthread_join(pid[config->consumers + p], NULL);
+        sent += producers[p].sent;
+    }
+    // consumers drain what is buffered and then see CLOSED_ERROR
+    enum channel_status status = channel_close_send(channel);
+    assert(status == SUCCESS);
+    size_t received = 0;
+    uint64_t last = start;
+    for (size_t c = 0; c < config->consumers; c++) {
+        pthread_join(pid[c], NULL);
+        received += consumers[c].received;
+        if (consumers[c].last > last) last = consumers[c].last;
+    }
+    assert(received == sent);
+
+    // gather the latencies of the slots that were used
+    size_t count = 0;
+    for (size_t id = 0; id < total; id++) {
+        if (!seen[id]) continue;
+        corrected[count] = corrected[id];
+        raw[count] = raw[id];
+        count++;
+    }
+    qsort(corrected, count, sizeof(uint64_t), ol_compare);
+    qsort(raw, count, sizeof(uint64_t), ol_compare);
+    *report = (stress_open_loop_report_t){
+        .sent = sent,
+        .received = received,
+        .offered_rate = config->rate,
+        .throughput = (last > start) ? (double)received * 1e9 / (double)(last - start) : 0,
+        .p50 = ol_percentile(corrected, count, 0.5),
+        .p90 = ol_percentile(corrected, count, 0.9),
+        .p99 = ol_percentile(corrected, count, 0.99),
+        .p999 = ol_percentile(corrected, count, 0.999),
+        .max = count ? corrected[count - 1] : 0,
+        .raw_p50 = ol_percentile(raw, count, 0.5),
+        .raw_p99 = ol_percentile(raw, count, 0.99),
+        .raw_max = count ? raw[count - 1] : 0,
+    };
+
+    status = channel_close(channel);
+    assert(status == SUCCESS);
+    status = channel_destroy(channel);
+    assert(status == SUCCESS);
+    free(consumers);
+    free(producers);
+    free(pid);
+    free(raw);
+    free(corrected);
+    free(seen);
+    free(pool);
+    return true;
+}
+
+void stress_print_open_loop(const stress_open_loop_config_t* config, const stress_open_loop_report_t* report, FILE* out)
+{
+    fprintf(out, "open loop %-7s cap %4zu %zup/%zuc %5zuB: offered %9.0f/s got %9.0f/s  "
+            "p50 %8.1f p90 %8.1f p99 %8.1f p99.9 %8.1f max %8.1f us (uncorrected p99 %8.1f us)\n",
+            config->arrival == STRESS_ARRIVAL_POISSON ? "poisson" : "const", config->buffer_size, config->producers,
+            config->consumers, config->message_size, report->offered_rate, report->throughput,
+            (double)report->p50 / 1e3, (double)report->p90 / 1e3, (double)report->p99 / 1e3,
+            (double)report->p999 / 1e3, (double)report->max / 1e3, (double)report->raw_p99 / 1e3);
 }
@@ -1,6 +1,52 @@
 #ifndef STRESS_SEND_RECV_H
 #define STRESS_SEND_RECV_H
 
-void run_stress_send_recv(size_t buffer_size, size_t num_threads, double load, useconds_t duration_usec);
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+// Closed loop: num_threads workers pass load * (num_threads * (buffer_size + 1)) messages around a ring of
+// channels for duration_usec and check none is lost or duplicated
+// Returns the ring's throughput in hops (send + receive pairs) per second
+double run_stress_send_recv(size_t buffer_size, size_t num_threads, double load, useconds_t duration_usec);
+
+// Open loop: producers send on a schedule that doesn't wait for the channel, so a slow channel shows up
+// as latency instead of silently lowering the offered load
+enum stress_arrival {
+    STRESS_ARRIVAL_CONSTANT, // evenly spaced sends
+    STRESS_ARRIVAL_POISSON   // exponentially distributed gaps with the same mean
+};
+
+typedef struct {
+    size_t buffer_size;        // capacity of the channel under test
+    size_t producers;
+    size_t consumers;
+    double rate;               // offered messages per second across all producers
+    enum stress_arrival arrival;
+    size_t message_size;       // bytes per message, timestamp header included
+    useconds_t duration_usec;  // how long producers keep sending
+    uint64_t seed;
+} stress_open_loop_config_t;
+
+// Latencies are nanoseconds from a message's scheduled send time to its receipt. A producer that falls
+// behind (because send blocked) still stamps each late message with the time it should have gone out, so the
+// queueing delay it caused counts against every message it held up (coordinated omission correction).
+// raw_* measure from the actual send instead, which is what a closed-loop client would report.
+typedef struct {
+    size_t sent;
+    size_t received;
+    double offered_rate;       // messages per second the schedule asked for
+    double throughput;         // messages per second received
+    uint64_t p50, p90, p99, p999, max;
+    uint64_t raw_p50, raw_p99, raw_max;
+} stress_open_loop_report_t;
+
+// Runs the open-loop generator against a fresh channel; returns false if the configuration is invalid
+// Every sent message must be received exactly once, which is asserted
+bool run_stress_open_loop(const stress_open_loop_config_t* config, stress_open_loop_report_t* report);
+
+// Prints one line summarizing the report
+void stress_print_open_loop(const stress_open_loop_config_t* config, const stress_open_loop_report_t* report, FILE* out);
 
 #endif // STRESS_SEND_RECV_H
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include "channel.h"
 #include <assert.h>
@@ -10,6 +11,14 @@
 #include <stdbool.h>
 #include "stress.h"
 #include "stress_send_recv.h"
+#include "topology.h"
+#include "mpsc_queue.h"
+#include "pipeline.h"
+#include "stress_linearizability.h"
+#include "trace.h"
+#include "channel_group.h"
+#include "affinity.h"
+#include "rpc.h"
 
 #define mu_str_(text) #text
 #define mu_str(text) mu_str_(text)
@@ -46,6 +55,7 @@ typedef struct {
 
 int tests_run = 0;
 int tests_passed = 0;
+const char* affinity_spec = "none"; // policy given with --affinity=, which test_affinity restores
 
 int string_equal(const char* str1, const char* str2) {
     if ((str1 == NULL) && (str2 == NULL)) {
@@ -107,6 +117,15 @@ void* helper_select(select_args *myargs) {
     return NULL; 
 }
 
+// Sends on the highest-priority lane
+void* helper_send_control(send_args *myargs) {
+    myargs->out = channel_send_priority(myargs->channel, myargs->data, 0);
+    if (myargs->done) {
+        sem_post(myargs->done);
+    }
+    return NULL;
+}
+
 void* helper_non_blocking_send(send_args *myargs) {
     myargs->out = channel_non_blocking_send(myargs->channel, myargs->data);
     if (myargs->done) {
@@ -640,6 +659,78 @@ char* test_channel_close_with_receive() {
     return NULL;
 }
 
+// Waits until count threads are queued on the channel's send (or receive) waiter list
+void wait_for_waiters(channel_t* channel, ilist_t* queue, size_t count) {
+    while (true) {
+        pthread_mutex_lock(&channel->lock);
+        size_t queued = ilist_count(queue);
+        pthread_mutex_unlock(&channel->lock);
+        if (queued >= count) return;
+        usleep(1000);
+    }
+}
+
+char* test_channel_close_send() {
+    print_test_details(__func__, "Testing close for send with draining receivers");
+
+    size_t capacity = 4;
+    size_t SEND_THREAD = 3;
+    size_t RECEIVE_THREAD = 10;
+    channel_t* channel = channel_create(capacity);
+    for (size_t i = 0; i < capacity; i++) {
+        mu_assert("test_channel_close_send: Send failed", channel_send(channel, "Message") == SUCCESS);
+    }
+
+    // these senders block on the full buffer and must be released by the close
+    send_args data_send[SEND_THREAD];
+    pthread_t send_pid[SEND_THREAD];
+    for (size_t i = 0; i < SEND_THREAD; i++) {
+        init_object_for_send_api(&data_send[i], channel, "Blocked", NULL);
+        pthread_create(&send_pid[i], NULL, (void *)helper_send, &data_send[i]);
+    }
+    wait_for_waiters(channel, &channel->send_waiters, SEND_THREAD);
+    mu_assert("test_channel_close_send: Close for send failed", channel_close_send(channel) == SUCCESS);
+    for (size_t i = 0; i < SEND_THREAD; i++) {
+        pthread_join(send_pid[i], NULL);
+        mu_assert("test_channel_close_send: Blocked send should fail", data_send[i].out == CLOSED_ERROR);
+    }
+    mu_assert("test_channel_close_send: Send after close should fail", channel_send(channel, "Message") == CLOSED_ERROR);
+    mu_assert("test_channel_close_send: Send after close should fail", channel_non_blocking_send(channel, "Message") == CLOSED_ERROR);
+
+    // buffered messages are still delivered, everyone else sees CLOSED_ERROR once the buffer is empty
+    receive_args data_rec[RECEIVE_THREAD];
+    pthread_t rec_pid[RECEIVE_THREAD];
+    for (size_t i = 0; i < RECEIVE_THREAD; i++) {
+        init_object_for_receive_api(&data_rec[i], channel, NULL);
+        pthread_create(&rec_pid[i], NULL, (void *)helper_receive, &data_rec[i]);
+    }
+    size_t received = 0;
+    for (size_t i = 0; i < RECEIVE_THREAD; i++) {
+        pthread_join(rec_pid[i], NULL);
+        if (data_rec[i].out == SUCCESS) {
+            mu_assert("test_channel_close_send: Invalid message", string_equal(data_rec[i].data, "Message"));
+            received++;
+        } else {
+            mu_assert("test_channel_close_send: Drained receive should fail", data_rec[i].out == CLOSED_ERROR);
+        }
+    }
+    mu_assert("test_channel_close_send: Buffered messages were not drained", received == capacity);
+    void* data = NULL;
+    mu_assert("test_channel_close_send: Receive after drain should fail", channel_non_blocking_receive(channel, &data) == CLOSED_ERROR);
+    mu_assert("test_channel_close_send: Double close should fail", channel_close_send(channel) == CLOSED_ERROR);
+    mu_assert("test_channel_close_send: Full close after close for send failed", channel_close(channel) == SUCCESS);
+    mu_assert("test_channel_close_send: Destroy failed", channel_destroy(channel) == SUCCESS);
+
+    // a full close drops buffered messages
+    channel = channel_create(capacity);
+    mu_assert("test_channel_close_send: Send failed", channel_send(channel, "Message") == SUCCESS);
+    mu_assert("test_channel_close_send: Close failed", channel_close(channel) == SUCCESS);
+    mu_assert("test_channel_close_send: Receive after close should fail", channel_receive(channel, &data) == CLOSED_ERROR);
+    mu_assert("test_channel_close_send: Close for send after close should fail", channel_close_send(channel) == CLOSED_ERROR);
+    channel_destroy(channel);
+    return NULL;
+}
+
 char* test_multiple_channels() {
     print_test_details(__func__, "Testing creating multiple channels");
 
@@ -1139,6 +1230,676 @@ char* test_free() {
 
 
 
+typedef struct {
+    ilist_node_t node;
+    mpsc_node_t mpsc;
+    size_t value;
+} list_item;
+
+char* test_linked_list() {
+    print_test_details(__func__, "Testing the allocating and intrusive linked lists");
+
+    size_t ITEMS = 16;
+    list_t* list = list_create();
+    mu_assert("test_linked_list: Could not create list", list != NULL);
+    for (size_t i = 0; i < ITEMS; i++) {
+        mu_assert("test_linked_list: Could not insert", list_insert(list, (void*)(i + 1)) != NULL);
+    }
+    mu_assert("test_linked_list: Count doesn't match", list_count(list) == ITEMS);
+    mu_assert("test_linked_list: Head doesn't match", list_data(list_head(list)) == (void*)1);
+    mu_assert("test_linked_list: Tail doesn't match", list_data(list_tail(list)) == (void*)ITEMS);
+    list_remove(list, list_find(list, (void*)5));
+    mu_assert("test_linked_list: Found removed data", list_find(list, (void*)5) == NULL);
+    size_t expected = 1;
+    for (list_node_t* node = list_head(list); node != list_end(list); node = list_next(node)) {
+        if (expected == 5) expected++;
+        mu_assert("test_linked_list: Order doesn't match", list_data(node) == (void*)expected);
+        expected++;
+    }
+    list_destroy(list);
+
+    list_item items[ITEMS];
+    ilist_t ilist;
+    ilist_init(&ilist);
+    mu_assert("test_linked_list: Intrusive list isn't empty", ilist_empty(&ilist) && ilist_front(&ilist) == NULL);
+    for (size_t i = 0; i < ITEMS; i++) {
+        items[i].value = i;
+        ilist_node_init(&items[i].node);
+        ilist_push_back(&ilist, &items[i].node);
+    }
+    ilist_remove(&ilist, &items[3].node);
+    mu_assert("test_linked_list: Removed node is still linked", !ilist_linked(&items[3].node));
+    mu_assert("test_linked_list: Intrusive count doesn't match", ilist_count(&ilist) == ITEMS - 1);
+    ilist_push_front(&ilist, &items[3].node);
+    mu_assert("test_linked_list: Push front didn't become head", ilist_pop_front(&ilist) == &items[3].node);
+    for (size_t i = 0; i < ITEMS; i++) {
+        if (i == 3) continue;
+        ilist_node_t* node = ilist_pop_front(&ilist);
+        mu_assert("test_linked_list: Intrusive order doesn't match", ilist_entry(node, list_item, node)->value == i);
+    }
+    mu_assert("test_linked_list: Intrusive list isn't empty", ilist_empty(&ilist) && ilist_pop_front(&ilist) == NULL);
+    return NULL;
+}
+
+typedef struct {
+    enum trace_event event;
+    size_t count;
+} trace_args;
+
+void* helper_trace(trace_args* myargs) {
+    for (size_t i = 0; i < myargs->count; i++) {
+        trace_record(myargs->event, myargs, (uint32_t)i);
+    }
+    return NULL;
+}
+
+// Returns the number of non-overlapping occurrences of needle in haystack
+size_t count_substrings(const char* haystack, const char* needle) {
+    size_t count = 0;
+    for (const char* p = strstr(haystack, needle); p; p = strstr(p + strlen(needle), needle)) {
+        count++;
+    }
+    return count;
+}
+
+char* test_trace() {
+    print_test_details(__func__, "Testing per-thread trace rings and the Chrome trace dump");
+
+    trace_reset();
+    // one thread stays within its ring, the other wraps and keeps only its newest records
+    trace_args args[2] = {{TRACE_WAKE, 10}, {TRACE_HANDOFF, TRACE_RING_SIZE + 5}};
+    pthread_t pid[2];
+    for (size_t i = 0; i < 2; i++) {
+        pthread_create(&pid[i], NULL, (void *)helper_trace, &args[i]);
+    }
+    for (size_t i = 0; i < 2; i++) {
+        pthread_join(pid[i], NULL);
+    }
+
+    if (trace_enabled()) {
+        // a receive that has to wait shows up as a block span on the channel
+        channel_t* channel = channel_create(1);
+        receive_args data_rec;
+        init_object_for_receive_api(&data_rec, channel, NULL);
+        pthread_t rec_pid;
+        pthread_create(&rec_pid, NULL, (void *)helper_receive, &data_rec);
+        wait_for_waiters(channel, &channel->recv_waiters, 1);
+        mu_assert("test_trace: Send failed", channel_send(channel, "Message") == SUCCESS);
+        pthread_join(rec_pid, NULL);
+        channel_close(channel);
+        channel_destroy(channel);
+    }
+
+    char* json = NULL;
+    size_t length = 0;
+    FILE* out = open_memstream(&json, &length);
+    trace_dump_chrome(out);
+    fclose(out);
+    mu_assert("test_trace: Dump isn't a trace object", strncmp(json, "{\"traceEvents\":[", 16) == 0);
+    mu_assert("test_trace: Wrong number of wake records", count_substrings(json, "\"name\":\"wake\"") == 10 + (trace_enabled() ? 1 : 0));
+    mu_assert("test_trace: Wrapped ring kept the wrong number of records", count_substrings(json, "\"name\":\"handoff\"") == TRACE_RING_SIZE);
+    if (trace_enabled()) {
+        mu_assert("test_trace: Missing block begin", count_substrings(json, "\"name\":\"recv\",\"cat\":\"channel\",\"ph\":\"B\"") == 1);
+        mu_assert("test_trace: Missing block end", count_substrings(json, "\"name\":\"recv\",\"cat\":\"channel\",\"ph\":\"E\"") == 1);
+    }
+    free(json);
+    trace_shutdown();
+    return NULL;
+}
+
+char* test_waiter_reuse() {
+    print_test_details(__func__, "Testing that blocking calls reuse the thread's cached waiter");
+
+    waiter_t* waiter = waiter_get(1);
+    mu_assert("test_waiter_reuse: Could not get waiter", waiter != NULL);
+    mu_assert("test_waiter_reuse: Waiter has fewer than the inline links", waiter->link_capacity >= WAITER_INLINE_LINKS);
+    mu_assert("test_waiter_reuse: Waiter isn't cached", waiter_get(WAITER_INLINE_LINKS) == waiter);
+    mu_assert("test_waiter_reuse: Waiter didn't grow", waiter_get(WAITER_INLINE_LINKS * 3)->link_capacity >= WAITER_INLINE_LINKS * 3);
+    waiter_link_t* links = waiter->links;
+    mu_assert("test_waiter_reuse: Grown links weren't kept", waiter_get(WAITER_INLINE_LINKS + 1)->links == links);
+    waiter_trim();
+    mu_assert("test_waiter_reuse: Trimmed waiter didn't return to its inline links", waiter->links == waiter->inline_links && waiter->link_capacity == WAITER_INLINE_LINKS);
+
+    // a blocked receive must be released through the same waiter record
+    pthread_t pid;
+    receive_args args;
+    channel_t* channel = channel_create(1);
+    init_object_for_receive_api(&args, channel, NULL);
+    pthread_create(&pid, NULL, (void *)helper_receive, &args);
+    wait_for_waiters(channel, &channel->recv_waiters, 1);
+    mu_assert("test_waiter_reuse: Could not send", channel_send(channel, "Message") == SUCCESS);
+    pthread_join(pid, NULL);
+    mu_assert("test_waiter_reuse: Receive didn't succeed", args.out == SUCCESS && string_equal(args.data, "Message"));
+    pthread_mutex_lock(&channel->lock);
+    bool drained = ilist_empty(&channel->recv_waiters);
+    pthread_mutex_unlock(&channel->lock);
+    mu_assert("test_waiter_reuse: Waiter queue isn't empty", drained);
+    channel_close(channel);
+    channel_destroy(channel);
+    return NULL;
+}
+
+char* test_fifo_ordering() {
+    print_test_details(__func__, "Testing that FIFO channels serve blocked senders and receivers in arrival order");
+
+    size_t THREADS = 8;
+    pthread_t pid[THREADS];
+    send_args sargs[THREADS];
+    receive_args rargs[THREADS];
+    char messages[THREADS][8];
+    channel_t* channel = channel_create_ex(1, CHANNEL_FIFO);
+    mu_assert("test_fifo_ordering: Could not create channel", channel != NULL && channel->fifo);
+    mu_assert("test_fifo_ordering: Could not fill channel", channel_send(channel, "First") == SUCCESS);
+
+    // queue senders one at a time so their arrival order is known
+    for (size_t i = 0; i < THREADS; i++) {
+        snprintf(messages[i], sizeof(messages[i]), "%zu", i);
+        init_object_for_send_api(&sargs[i], channel, messages[i], NULL);
+        pthread_create(&pid[i], NULL, (void *)helper_send, &sargs[i]);
+        wait_for_waiters(channel, &channel->send_waiters, i + 1);
+    }
+    void* data;
+    mu_assert("test_fifo_ordering: Could not receive", channel_receive(channel, &data) == SUCCESS);
+    mu_assert("test_fifo_ordering: Buffered message should come first", string_equal(data, "First"));
+    for (size_t i = 0; i < THREADS; i++) {
+        mu_assert("test_fifo_ordering: Could not receive", channel_receive(channel, &data) == SUCCESS);
+        mu_assert("test_fifo_ordering: Senders weren't served in arrival order", string_equal(data, messages[i]));
+    }
+    for (size_t i = 0; i < THREADS; i++) {
+        pthread_join(pid[i], NULL);
+        mu_assert("test_fifo_ordering: Send didn't succeed", sargs[i].out == SUCCESS);
+    }
+
+    // queue receivers and hand them messages directly
+    for (size_t i = 0; i < THREADS; i++) {
+        init_object_for_receive_api(&rargs[i], channel, NULL);
+        pthread_create(&pid[i], NULL, (void *)helper_receive, &rargs[i]);
+        wait_for_waiters(channel, &channel->recv_waiters, i + 1);
+    }
+    for (size_t i = 0; i < THREADS; i++) {
+        mu_assert("test_fifo_ordering: Could not send", channel_send(channel, messages[i]) == SUCCESS);
+        mu_assert("test_fifo_ordering: Message should be handed off, not buffered", buffer_current_size(channel->buffer) == 0);
+    }
+    for (size_t i = 0; i < THREADS; i++) {
+        pthread_join(pid[i], NULL);
+        mu_assert("test_fifo_ordering: Receive didn't succeed", rargs[i].out == SUCCESS);
+        mu_assert("test_fifo_ordering: Receivers weren't served in arrival order", string_equal(rargs[i].data, messages[i]));
+    }
+    channel_close(channel);
+    channel_destroy(channel);
+
+    // a size 0 FIFO channel is a rendezvous channel
+    channel = channel_create_ex(0, CHANNEL_FIFO);
+    mu_assert("test_fifo_ordering: Unbuffered send shouldn't succeed without a receiver", channel_non_blocking_send(channel, "Message") == CHANNEL_FULL);
+    init_object_for_send_api(&sargs[0], channel, "Message", NULL);
+    pthread_create(&pid[0], NULL, (void *)helper_send, &sargs[0]);
+    wait_for_waiters(channel, &channel->send_waiters, 1);
+    mu_assert("test_fifo_ordering: Could not receive from queued sender", channel_receive(channel, &data) == SUCCESS);
+    mu_assert("test_fifo_ordering: Wrong message from queued sender", string_equal(data, "Message"));
+    pthread_join(pid[0], NULL);
+    mu_assert("test_fifo_ordering: Unbuffered send didn't succeed", sargs[0].out == SUCCESS);
+
+    // close releases queued waiters with CLOSED_ERROR
+    init_object_for_receive_api(&rargs[0], channel, NULL);
+    pthread_create(&pid[0], NULL, (void *)helper_receive, &rargs[0]);
+    wait_for_waiters(channel, &channel->recv_waiters, 1);
+    channel_close(channel);
+    pthread_join(pid[0], NULL);
+    mu_assert("test_fifo_ordering: Close didn't release receiver", rargs[0].out == CLOSED_ERROR);
+    channel_destroy(channel);
+    return NULL;
+}
+
+bool stage_increment(void* input, void** output, void* arg) {
+    *output = (void*)((size_t)input + 1);
+    return true;
+}
+
+bool stage_drop_odd(void* input, void** output, void* arg) {
+    *output = input;
+    return ((size_t)input % 2) == 0;
+}
+
+bool stage_double(void* input, void** output, void* arg) {
+    *output = (void*)((size_t)input * 2);
+    return true;
+}
+
+typedef struct {
+    pipeline_t* pipeline;
+    size_t count;
+} pipeline_push_args;
+
+void* helper_pipeline_push(pipeline_push_args* myargs) {
+    for (size_t i = 0; i < myargs->count; i++) {
+        pipeline_push(myargs->pipeline, (void*)i);
+    }
+    pipeline_close(myargs->pipeline);
+    return NULL;
+}
+
+typedef struct {
+    channel_group_t* group;
+    void* data;
+    size_t index;
+    enum channel_status out;
+} group_wait_args;
+
+void* helper_group_wait(group_wait_args* myargs) {
+    myargs->out = channel_group_wait(myargs->group, &myargs->data, &myargs->index);
+    return NULL;
+}
+
+void wait_for_group_sleeper(channel_group_t* group) {
+    while (atomic_load(&group->sleepers) == 0) {
+        usleep(1000);
+    }
+}
+
+char* test_channel_group() {
+    print_test_details(__func__, "Testing channel groups and their readiness mask");
+
+    size_t MEMBERS = 130; // spans three mask words
+    channel_t* channels[MEMBERS];
+    for (size_t i = 0; i < MEMBERS; i++) {
+        channels[i] = channel_create_ex(2, (i % 2) ? CHANNEL_FIFO : 0);
+        mu_assert("test_channel_group: Could not create channel", channels[i] != NULL);
+    }
+    channel_t* rendezvous = channel_create(0);
+    channel_t* invalid[] = {channels[0], rendezvous};
+    mu_assert("test_channel_group: Group with a rendezvous channel was created", channel_group_create(invalid, 2) == NULL);
+    channel_close(rendezvous);
+    channel_destroy(rendezvous);
+
+    // messages sent before the group exists are already ready
+    mu_assert("test_channel_group: Send failed", channel_send(channels[5], "Five") == SUCCESS);
+    channel_group_t* group = channel_group_create(channels, MEMBERS);
+    mu_assert("test_channel_group: Could not create group", group != NULL);
+    mu_assert("test_channel_group: Channel joined two groups", channel_group_create(channels, 1) == NULL);
+    mu_assert("test_channel_group: Send failed", channel_send(channels[70], "Seventy") == SUCCESS);
+    mu_assert("test_channel_group: Send failed", channel_send(channels[129], "Last") == SUCCESS);
+    mu_assert("test_channel_group: Send failed", channel_send(channels[129], "Last") == SUCCESS);
+
+    size_t ready[MEMBERS];
+    mu_assert("test_channel_group: Wrong ready count", channel_group_ready(group, ready, MEMBERS) == 3);
+    mu_assert("test_channel_group: Wrong ready members", ready[0] == 5 && ready[1] == 70 && ready[2] == 129);
+
+    char* expected[] = {"Five", "Seventy", "Last", "Last"};
+    size_t indices[] = {5, 70, 129, 129};
+    for (size_t i = 0; i < 4; i++) {
+        void* data = NULL;
+        size_t index = 0;
+        mu_assert("test_channel_group: Group receive failed", channel_group_receive(group, &data, &index) == SUCCESS);
+        mu_assert("test_channel_group: Received from the wrong member", index == indices[i] && string_equal(data, expected[i]));
+    }
+    void* data = NULL;
+    size_t index = 0;
+    mu_assert("test_channel_group: Drained group isn't empty", channel_group_receive(group, &data, &index) == CHANNEL_EMPTY);
+    mu_assert("test_channel_group: Drained members still ready", channel_group_ready(group, ready, MEMBERS) == 0);
+
+    // a blocked consumer wakes when any member becomes ready, or is closed
+    group_wait_args args = {group, NULL, 0, GENERIC_ERROR};
+    pthread_t pid;
+    pthread_create(&pid, NULL, (void *)helper_group_wait, &args);
+    wait_for_group_sleeper(group);
+    mu_assert("test_channel_group: Send failed", channel_send(channels[100], "Hundred") == SUCCESS);
+    pthread_join(pid, NULL);
+    mu_assert("test_channel_group: Wait didn't receive", args.out == SUCCESS && args.index == 100 && string_equal(args.data, "Hundred"));
+
+    pthread_create(&pid, NULL, (void *)helper_group_wait, &args);
+    wait_for_group_sleeper(group);
+    channel_close(channels[3]);
+    pthread_join(pid, NULL);
+    mu_assert("test_channel_group: Wait didn't see the close", args.out == CLOSED_ERROR && args.index == 3);
+
+    channel_group_destroy(group);
+    for (size_t i = 0; i < MEMBERS; i++) {
+        channel_close(channels[i]);
+        mu_assert("test_channel_group: Destroy failed", channel_destroy(channels[i]) == SUCCESS);
+    }
+    return NULL;
+}
+
+void* helper_report_cpu(int* cpu) {
+    *cpu = sched_getcpu();
+    return NULL;
+}
+
+char* test_affinity() {
+    print_test_details(__func__, "Testing CPU affinity policies for harness threads");
+
+    mu_assert("test_affinity: Malformed policy accepted", !affinity_configure("sideways"));
+    mu_assert("test_affinity: Malformed list accepted", !affinity_configure("list:0,x"));
+    mu_assert("test_affinity: List without usable CPUs accepted", !affinity_configure("list:100000"));
+    int first = sched_getcpu();
+    char spec[32];
+    snprintf(spec, sizeof(spec), "list:%d", first);
+    const char* specs[] = {"compact", "scatter", spec};
+    enum affinity_policy policies[] = {AFFINITY_COMPACT, AFFINITY_SCATTER, AFFINITY_LIST};
+    for (size_t p = 0; p < 3; p++) {
+        mu_assert("test_affinity: Policy rejected", affinity_configure(specs[p]));
+        mu_assert("test_affinity: Wrong policy", affinity_policy() == policies[p]);
+        // every index maps to a CPU the thread then actually runs on
+        for (size_t i = 0; i < 4; i++) {
+            int cpu = -1;
+            pthread_t pid;
+            mu_assert("test_affinity: Pinned thread not created",
+                      affinity_thread_create(&pid, (void*)helper_report_cpu, &cpu, i) == 0);
+            pthread_join(pid, NULL);
+            mu_assert("test_affinity: Thread ran on the wrong CPU", cpu == affinity_cpu_for(i));
+        }
+    }
+    mu_assert("test_affinity: Unpinning failed", affinity_configure("none"));
+    mu_assert("test_affinity: Unpinned index has a CPU", affinity_cpu_for(0) == -1);
+    mu_assert("test_affinity: Configured policy not restored", affinity_configure(affinity_spec));
+    return NULL;
+}
+
+char* test_huge_page_ring() {
+    print_test_details(__func__, "Testing huge-page backed channel rings");
+
+    // rings below one huge page stay on the heap
+    channel_t* small = channel_create_ex(16, CHANNEL_HUGE_PAGES);
+    mu_assert("test_huge_page_ring: Could not create channel", small != NULL);
+    mu_assert("test_huge_page_ring: Small ring was mapped", buffer_backing(small->buffer) == BUFFER_HEAP);
+    channel_close(small);
+    channel_destroy(small);
+
+    size_t capacity = BUFFER_HUGE_PAGE_SIZE / sizeof(void*) + 7; // not a whole number of huge pages
+    unsigned int flags[] = {CHANNEL_HUGE_PAGES, CHANNEL_HUGE_PAGES | CHANNEL_FIFO};
+    for (size_t f = 0; f < 2; f++) {
+        channel_t* channel = channel_create_ex(capacity, flags[f]);
+        mu_assert("test_huge_page_ring: Could not create channel", channel != NULL);
+        mu_assert("test_huge_page_ring: Large ring wasn't mapped", buffer_backing(channel->buffer) != BUFFER_HEAP);
+        mu_assert("test_huge_page_ring: Mapping too small", channel->buffer->mapped >= capacity * sizeof(void*));
+        // fill the whole ring, wrapping it once, and check order
+        for (size_t round = 0; round < 2; round++) {
+            for (size_t i = 0; i < capacity; i++) {
+                mu_assert("test_huge_page_ring: Send failed", channel_non_blocking_send(channel, (void*)(i + 1)) == SUCCESS);
+            }
+            mu_assert("test_huge_page_ring: Full ring accepted a message", channel_non_blocking_send(channel, (void*)1) == CHANNEL_FULL);
+            for (size_t i = 0; i < capacity / 2 + round; i++) {
+                void* data = NULL;
+                mu_assert("test_huge_page_ring: Receive failed", channel_non_blocking_receive(channel, &data) == SUCCESS);
+                mu_assert("test_huge_page_ring: Wrong message", (size_t)data == i + 1);
+            }
+            while (channel_length(channel) > 0) {
+                void* data = NULL;
+                channel_non_blocking_receive(channel, &data);
+            }
+        }
+        channel_close(channel);
+        mu_assert("test_huge_page_ring: Destroy failed", channel_destroy(channel) == SUCCESS);
+    }
+    return NULL;
+}
+
+typedef struct {
+    rpc_t* rpc;
+    size_t base;
+    size_t count;
+    uint64_t* ids;     // correlation id of every call
+    char* out;
+} rpc_client_args;
+
+void* helper_rpc_client(rpc_client_args* myargs) {
+    myargs->out = NULL;
+    // alternate between synchronous calls and two overlapping calls in flight
+    for (size_t i = 0; i + 1 < myargs->count; i += 2) {
+        size_t first = myargs->base + i;
+        rpc_call_t* a = rpc_send(myargs->rpc, (void*)first);
+        rpc_call_t* b = rpc_send(myargs->rpc, (void*)(first + 1));
+        if (!a || !b || a->id == b->id) {
+            myargs->out = "Send failed";
+            return NULL;
+        }
+        myargs->ids[i] = a->id;
+        myargs->ids[i + 1] = b->id;
+        void* reply = NULL;
+        // wait out of order
+        if (rpc_wait(b, &reply) != SUCCESS || (size_t)reply != 2 * (first + 1) ||
+            rpc_wait(a, &reply) != SUCCESS || (size_t)reply != 2 * first) {
+            myargs->out = "Wrong reply";
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+void* helper_rpc_server(rpc_t* rpc) {
+    rpc_call_t* calls[8];
+    void* replies[8];
+    size_t count;
+    while ((count = rpc_serve_batch(rpc, calls, 8)) > 0) {
+        for (size_t i = 0; i < count; i++) {
+            replies[i] = (void*)(2 * (size_t)rpc_call_request(calls[i]));
+        }
+        rpc_complete_batch(calls, replies, count);
+    }
+    return NULL;
+}
+
+int compare_ids(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+char* test_rpc() {
+    print_test_details(__func__, "Testing request/reply with pooled reply slots");
+
+    size_t CLIENTS = 4;
+    size_t CALLS = 1000;
+    mu_assert("test_rpc: Rpc without slots was created", rpc_create(4, 0) == NULL);
+    // fewer slots than calls in flight, so clients also block on the pool
+    rpc_t* rpc = rpc_create(4, 5);
+    mu_assert("test_rpc: Could not create rpc", rpc != NULL);
+    pthread_t server;
+    pthread_create(&server, NULL, (void *)helper_rpc_server, rpc);
+    pthread_t pid[CLIENTS];
+    rpc_client_args args[CLIENTS];
+    uint64_t* ids = malloc(CLIENTS * CALLS * sizeof(uint64_t));
+    for (size_t i = 0; i < CLIENTS; i++) {
+        args[i] = (rpc_client_args){rpc, i * CALLS, CALLS, &ids[i * CALLS], NULL};
+        pthread_create(&pid[i], NULL, (void *)helper_rpc_client, &args[i]);
+    }
+    for (size_t i = 0; i < CLIENTS; i++) {
+        pthread_join(pid[i], NULL);
+        mu_assert("test_rpc: Client failed", args[i].out == NULL);
+    }
+    qsort(ids, CLIENTS * CALLS, sizeof(uint64_t), compare_ids);
+    for (size_t i = 1; i < CLIENTS * CALLS; i++) {
+        mu_assert("test_rpc: Correlation id reused", ids[i] != ids[i - 1]);
+    }
+    free(ids);
+
+    void* reply = NULL;
+    mu_assert("test_rpc: Call failed", rpc_call(rpc, (void*)21, &reply) == SUCCESS && (size_t)reply == 42);
+    mu_assert("test_rpc: Close failed", rpc_close(rpc) == SUCCESS);
+    mu_assert("test_rpc: Call after close", rpc_call(rpc, (void*)1, &reply) == CLOSED_ERROR);
+    pthread_join(server, NULL);
+    mu_assert("test_rpc: Destroy failed", rpc_destroy(rpc) == SUCCESS);
+
+    // a batch larger than one chunk of wake-ups, and an empty one
+    size_t BATCH = 100;
+    rpc = rpc_create(BATCH, BATCH);
+    mu_assert("test_rpc: Could not create rpc", rpc != NULL);
+    rpc_call_t* sent[BATCH];
+    rpc_call_t* calls[BATCH];
+    void* replies[BATCH];
+    for (size_t i = 0; i < BATCH; i++) {
+        sent[i] = rpc_send(rpc, (void*)i);
+        mu_assert("test_rpc: Send failed", sent[i] != NULL);
+    }
+    mu_assert("test_rpc: Batch not served whole", rpc_serve_batch(rpc, calls, BATCH) == BATCH);
+    for (size_t i = 0; i < BATCH; i++) {
+        replies[i] = (void*)(2 * (size_t)rpc_call_request(calls[i]));
+    }
+    rpc_complete_batch(calls, replies, 0);
+    rpc_complete_batch(calls, replies, BATCH);
+    for (size_t i = 0; i < BATCH; i++) {
+        mu_assert("test_rpc: Wrong batch reply", rpc_wait(sent[i], &reply) == SUCCESS && (size_t)reply == 2 * i);
+    }
+    mu_assert("test_rpc: Close failed", rpc_close(rpc) == SUCCESS);
+    mu_assert("test_rpc: Destroy failed", rpc_destroy(rpc) == SUCCESS);
+    return NULL;
+}
+
+char* test_priority_lanes() {
+    print_test_details(__func__, "Testing priority lanes sharing one capacity");
+
+    mu_assert("test_priority_lanes: Channel without lanes was created", channel_create_lanes(4, 0, 0) == NULL);
+    unsigned int flags[] = {0, CHANNEL_FIFO};
+    for (size_t f = 0; f < 2; f++) {
+        size_t capacity = 4;
+        channel_t* channel = channel_create_lanes(capacity, 3, flags[f]);
+        mu_assert("test_priority_lanes: Could not create channel", channel != NULL);
+        mu_assert("test_priority_lanes: Lane out of range accepted", channel_send_priority(channel, "Message", 3) == GENERIC_ERROR);
+
+        // bulk messages go to the last lane; the lanes share one capacity
+        mu_assert("test_priority_lanes: Send failed", channel_send(channel, "Bulk1") == SUCCESS);
+        mu_assert("test_priority_lanes: Send failed", channel_send(channel, "Bulk2") == SUCCESS);
+        mu_assert("test_priority_lanes: Send failed", channel_send_priority(channel, "Middle", 1) == SUCCESS);
+        mu_assert("test_priority_lanes: Send failed", channel_non_blocking_send_priority(channel, "Control1", 0) == SUCCESS);
+        mu_assert("test_priority_lanes: Lanes don't share the capacity", channel_non_blocking_send_priority(channel, "Control2", 0) == CHANNEL_FULL);
+        mu_assert("test_priority_lanes: Length doesn't count every lane", channel_length(channel) == capacity);
+
+        // a blocked high-priority sender gets the next free slot and is received ahead of bulk data
+        send_args data_send;
+        init_object_for_send_api(&data_send, channel, "Control2", NULL);
+        pthread_t pid;
+        pthread_create(&pid, NULL, (void *)helper_send_control, &data_send);
+        wait_for_waiters(channel, &channel->send_waiters, 1);
+
+        char* expected[] = {"Control1", "Control2", "Middle", "Bulk1", "Bulk2"};
+        for (size_t i = 0; i < 5; i++) {
+            void* data = NULL;
+            mu_assert("test_priority_lanes: Receive failed", channel_receive(channel, &data) == SUCCESS);
+            mu_assert("test_priority_lanes: Lanes drained in the wrong order", string_equal(data, expected[i]));
+            if (i == 0) {
+                pthread_join(pid, NULL);
+                mu_assert("test_priority_lanes: Blocked send failed", data_send.out == SUCCESS);
+            }
+        }
+
+        channel_lane_stats_t stats;
+        mu_assert("test_priority_lanes: Stats failed", channel_lane_stats(channel, 0, &stats) == SUCCESS);
+        mu_assert("test_priority_lanes: Control lane counters don't match", stats.sent == 2 && stats.received == 2 && stats.length == 0);
+        mu_assert("test_priority_lanes: Stats failed", channel_lane_stats(channel, 2, &stats) == SUCCESS);
+        mu_assert("test_priority_lanes: Bulk lane counters don't match", stats.sent == 2 && stats.received == 2 && stats.length == 0);
+        mu_assert("test_priority_lanes: Stats for missing lane", channel_lane_stats(channel, 3, &stats) == GENERIC_ERROR);
+        channel_close(channel);
+        mu_assert("test_priority_lanes: Destroy failed", channel_destroy(channel) == SUCCESS);
+    }
+    return NULL;
+}
+
+char* test_pipeline() {
+    print_test_details(__func__, "Testing ordered and unordered multi-stage pipelines");
+
+    size_t ITEMS = 2000;
+    enum pipeline_mode modes[] = {PIPELINE_ORDERED, PIPELINE_UNORDERED};
+    bool seen[ITEMS / 2 + 1];
+    for (size_t m = 0; m < 2; m++) {
+        pipeline_t* pipeline = pipeline_create(modes[m]);
+        mu_assert("test_pipeline: Could not create pipeline", pipeline != NULL);
+        mu_assert("test_pipeline: Could not add stage", pipeline_add_stage(pipeline, "increment", stage_increment, NULL, 4, 8) == 0);
+        mu_assert("test_pipeline: Could not add stage", pipeline_add_stage(pipeline, "drop_odd", stage_drop_odd, NULL, 2, 0) == 1);
+        mu_assert("test_pipeline: Could not add stage", pipeline_add_stage(pipeline, "double", stage_double, NULL, 3, 4) == 2);
+        mu_assert("test_pipeline: Could not start pipeline", pipeline_start(pipeline, 4) == SUCCESS);
+        mu_assert("test_pipeline: Stage added after start", pipeline_add_stage(pipeline, "late", stage_double, NULL, 1, 1) == -1);
+
+        // push from a helper thread while this thread pops, so backpressure can't deadlock the test
+        memset(seen, 0, sizeof(seen));
+        pthread_t pid;
+        pipeline_push_args args = {pipeline, ITEMS};
+        pthread_create(&pid, NULL, (void *)helper_pipeline_push, &args);
+        size_t popped = 0;
+        void* item;
+        while (pipeline_pop(pipeline, &item) == SUCCESS) {
+            // item i survives as 2 * (i + 1) when i is odd, so outputs are the multiples of 4
+            size_t value = (size_t)item;
+            mu_assert("test_pipeline: Unexpected value", value % 4 == 0 && value / 4 >= 1 && value / 4 <= ITEMS / 2);
+            mu_assert("test_pipeline: Duplicate value", !seen[value / 4]);
+            seen[value / 4] = true;
+            popped++;
+            if (modes[m] == PIPELINE_ORDERED) {
+                mu_assert("test_pipeline: Ordered pipeline reordered items", value == popped * 4);
+            }
+        }
+        pthread_join(pid, NULL);
+        mu_assert("test_pipeline: Lost items", popped == ITEMS / 2);
+
+        stage_stats_t stats;
+        pipeline_stats(pipeline, 0, &stats);
+        mu_assert("test_pipeline: First stage item count doesn't match", stats.items == ITEMS && stats.dropped == 0 && stats.workers == 4);
+        pipeline_stats(pipeline, 1, &stats);
+        mu_assert("test_pipeline: Filter stage drop count doesn't match", stats.items == ITEMS && stats.dropped == ITEMS / 2);
+        pipeline_stats(pipeline, 2, &stats);
+        mu_assert("test_pipeline: Last stage item count doesn't match", stats.items == (modes[m] == PIPELINE_ORDERED ? ITEMS : ITEMS / 2));
+        mu_assert("test_pipeline: Push after close should fail", pipeline_push(pipeline, (void*)1) == CLOSED_ERROR);
+        mu_assert("test_pipeline: Could not destroy pipeline", pipeline_destroy(pipeline) == SUCCESS);
+    }
+    return NULL;
+}
+
+typedef struct {
+    mpsc_queue_t* queue;
+    list_item* items;
+    size_t count;
+} mpsc_args;
+
+void* helper_mpsc_push(mpsc_args* myargs) {
+    for (size_t i = 0; i < myargs->count; i++) {
+        mpsc_push(myargs->queue, &myargs->items[i].mpsc);
+    }
+    return NULL;
+}
+
+char* test_mpsc_queue() {
+    print_test_details(__func__, "Testing the lock-free multi-producer single-consumer queue");
+
+    size_t THREADS = 4;
+    size_t ITEMS = 10000;
+    pthread_t pid[THREADS];
+    mpsc_args args[THREADS];
+    list_item* items = malloc(sizeof(list_item) * THREADS * ITEMS);
+    size_t* last = malloc(sizeof(size_t) * THREADS);
+    mpsc_queue_t queue;
+    mpsc_init(&queue);
+    mu_assert("test_mpsc_queue: New queue isn't empty", mpsc_empty(&queue) && mpsc_pop(&queue) == NULL);
+
+    for (size_t i = 0; i < THREADS * ITEMS; i++) {
+        items[i].value = i;
+    }
+    for (size_t i = 0; i < THREADS; i++) {
+        args[i].queue = &queue;
+        args[i].items = &items[i * ITEMS];
+        args[i].count = ITEMS;
+        last[i] = 0;
+        pthread_create(&pid[i], NULL, (void *)helper_mpsc_push, &args[i]);
+    }
+    // every item must come out exactly once and in push order per producer
+    size_t popped = 0;
+    while (popped < THREADS * ITEMS) {
+        mpsc_node_t* node = mpsc_pop(&queue);
+        if (node == NULL) continue;
+        size_t value = ilist_entry(node, list_item, mpsc)->value;
+        size_t producer = value / ITEMS;
+        mu_assert("test_mpsc_queue: Items of one producer are out of order", value % ITEMS + 1 > last[producer]);
+        last[producer] = value % ITEMS + 1;
+        popped++;
+    }
+    for (size_t i = 0; i < THREADS; i++) {
+        pthread_join(pid[i], NULL);
+        mu_assert("test_mpsc_queue: Missing items", last[i] == ITEMS);
+    }
+    mu_assert("test_mpsc_queue: Queue isn't empty", mpsc_empty(&queue) && mpsc_pop(&queue) == NULL);
+    free(items);
+    free(last);
+    return NULL;
+}
+
 char* test_stress() {
     print_test_details(__func__, "Stress Testing for all functions including select (can take some time)");
     run_stress(1, 1, "topology.txt");
@@ -1149,6 +1910,110 @@ char* test_stress() {
     return NULL;
 }
 
+// Writes size bytes of data to filename and returns whether it loads as a topology
+bool corrupt_topology_loads(const char* filename, const char* data, size_t size) {
+    FILE* file = fopen(filename, "wb");
+    if (file == NULL || fwrite(data, 1, size, file) != size) {
+        if (file != NULL) fclose(file);
+        return true;
+    }
+    fclose(file);
+    topology_t topology;
+    if (!topology_load(&topology, filename)) {
+        return false;
+    }
+    topology_destroy(&topology);
+    return true;
+}
+
+char* test_binary_topology() {
+    print_test_details(__func__, "Testing binary topology conversion and stress over a mapped topology");
+    const char* text_files[] = {"topology.txt", "random_topology_1.txt", "big_graph.txt"};
+    const char* binary_file = "test_binary_topology.bin";
+    for (size_t f = 0; f < sizeof(text_files) / sizeof(text_files[0]); f++) {
+        topology_t text, binary;
+        mu_assert("test_binary_topology: Can't load text topology", topology_load(&text, text_files[f]));
+        mu_assert("test_binary_topology: Can't write binary topology", topology_write_binary(&text, binary_file));
+        mu_assert("test_binary_topology: Can't load binary topology", topology_load(&binary, binary_file));
+        mu_assert("test_binary_topology: Binary topology wasn't mapped", binary.map != NULL);
+        mu_assert("test_binary_topology: Node count doesn't match", text.num_nodes == binary.num_nodes);
+        mu_assert("test_binary_topology: Edge count doesn't match", text.num_edges == binary.num_edges);
+        for (size_t src = 0; src < text.num_nodes; src++) {
+            for (size_t dst = 0; dst < text.num_nodes; dst++) {
+                mu_assert("test_binary_topology: Link distance doesn't match",
+                          topology_distance(&text, src, dst) == topology_distance(&binary, src, dst));
+            }
+        }
+        topology_destroy(&text);
+        topology_destroy(&binary);
+    }
+    // big_graph.txt was converted last
+    run_stress(1, 1, binary_file);
+
+    // corrupt copies of a valid file must be rejected rather than handed to the routers
+    topology_t text, binary;
+    mu_assert("test_binary_topology: Can't load text topology", topology_load(&text, "topology.txt"));
+    mu_assert("test_binary_topology: Can't write binary topology", topology_write_binary(&text, binary_file));
+    topology_destroy(&text);
+    mu_assert("test_binary_topology: Can't load binary topology", topology_load(&binary, binary_file));
+    size_t size = binary.map_size;
+    size_t cols_offset = (size_t)((const char*)binary.cols - (const char*)binary.map);
+    size_t last_row = (size_t)((const char*)&binary.row_offsets[binary.num_nodes] - (const char*)binary.map);
+    size_t num_nodes = binary.num_nodes;
+    uint64_t first_row_edges = binary.row_offsets[1];
+    char* data = malloc(size);
+    mu_assert("test_binary_topology: Can't copy binary topology", data != NULL);
+    memcpy(data, binary.map, size);
+    topology_destroy(&binary);
+    uint32_t* cols = (uint32_t*)(data + cols_offset);
+    topology_header_t* header = (topology_header_t*)data;
+    mu_assert("test_binary_topology: First row has too few edges", first_row_edges >= 2);
+
+    mu_assert("test_binary_topology: Truncated file loaded", !corrupt_topology_loads(binary_file, data, size - 1));
+    uint32_t col = cols[0];
+    cols[0] = (uint32_t)num_nodes;
+    mu_assert("test_binary_topology: Column past the last node loaded", !corrupt_topology_loads(binary_file, data, size));
+    cols[0] = cols[1];
+    cols[1] = col;
+    mu_assert("test_binary_topology: Unsorted row loaded", !corrupt_topology_loads(binary_file, data, size));
+    cols[1] = cols[0];
+    cols[0] = col;
+    mu_assert("test_binary_topology: Restored file didn't load", corrupt_topology_loads(binary_file, data, size));
+    // an edge count whose arrays wrap the file size around to a small one
+    uint64_t num_edges = (uint64_t)1 << 61;
+    header->num_edges = num_edges;
+    memcpy(data + last_row, &num_edges, sizeof(num_edges));
+    mu_assert("test_binary_topology: Overflowing edge count loaded", !corrupt_topology_loads(binary_file, data, size));
+    free(data);
+    unlink(binary_file);
+    return NULL;
+}
+
+char* test_linearizability() {
+    print_test_details(__func__, "Checking recorded channel histories for linearizability (takes a few seconds)");
+
+    // the checker itself: send(1) and send(2) finish in that order, so a receive can't see 2 first
+    lin_history_t history = {.capacity = 2, .count = 3};
+    history.ops[0] = (lin_op_t){LIN_SEND, 0, 1, SUCCESS, 0, 1};
+    history.ops[1] = (lin_op_t){LIN_SEND, 1, 2, SUCCESS, 2, 3};
+    history.ops[2] = (lin_op_t){LIN_RECV, 2, 2, SUCCESS, 4, 5};
+    mu_assert("test_linearizability: Checker accepted a reordered history", !lin_check(&history));
+    // once the sends overlap either order is allowed
+    history.ops[0].response = 3;
+    history.ops[1].invoke = 1;
+    history.ops[1].response = 2;
+    mu_assert("test_linearizability: Checker rejected a valid history", lin_check(&history));
+    // a non-blocking receive may only report an empty channel if the message could still be in flight
+    history.ops[2] = (lin_op_t){LIN_NB_RECV, 2, 0, CHANNEL_EMPTY, 4, 5};
+    mu_assert("test_linearizability: Checker accepted an impossible empty receive", !lin_check(&history));
+
+    mu_assert("test_linearizability: Default channel is not linearizable", run_stress_linearizability(1, 0, 4, 12, 300, 1));
+    mu_assert("test_linearizability: Default channel is not linearizable", run_stress_linearizability(3, 0, 4, 12, 300, 2));
+    mu_assert("test_linearizability: FIFO channel is not linearizable", run_stress_linearizability(1, CHANNEL_FIFO, 4, 12, 300, 3));
+    mu_assert("test_linearizability: FIFO channel is not linearizable", run_stress_linearizability(3, CHANNEL_FIFO, 4, 12, 300, 4));
+    return NULL;
+}
+
 char* test_stress_send_recv() {
     print_test_details(__func__, "Stress Testing for send/recv without select (takes around 10 seconds)");
     run_stress_send_recv(1, 4, 0.25, 1000000);
@@ -1160,6 +2025,30 @@ char* test_stress_send_recv() {
     return NULL;
 }
 
+char* test_stress_open_loop() {
+    print_test_details(__func__, "Open-loop load generation with corrected latency percentiles");
+
+    stress_open_loop_config_t config = {4, 2, 2, 20000, STRESS_ARRIVAL_CONSTANT, 64, 300000, 1};
+    stress_open_loop_report_t report;
+    config.message_size = sizeof(uint64_t);
+    mu_assert("test_stress_open_loop: Message without room for a timestamp accepted", !run_stress_open_loop(&config, &report));
+    config.message_size = 64;
+    enum stress_arrival arrivals[] = {STRESS_ARRIVAL_CONSTANT, STRESS_ARRIVAL_POISSON};
+    for (size_t a = 0; a < 2; a++) {
+        config.arrival = arrivals[a];
+        mu_assert("test_stress_open_loop: Run failed", run_stress_open_loop(&config, &report));
+        stress_print_open_loop(&config, &report, stdout);
+        // the schedule asks for 6000 messages; allow a loaded machine to fall well behind
+        mu_assert("test_stress_open_loop: Producers sent too little", report.sent > 3000);
+        mu_assert("test_stress_open_loop: Messages lost", report.received == report.sent);
+        mu_assert("test_stress_open_loop: Percentiles out of order",
+                  report.p50 <= report.p90 && report.p90 <= report.p99 && report.p99 <= report.p999 && report.p999 <= report.max);
+        // each message's scheduled time precedes its send, so the corrected numbers can never be lower
+        mu_assert("test_stress_open_loop: Correction lowered latency", report.p50 >= report.raw_p50 && report.p99 >= report.raw_p99);
+    }
+    return NULL;
+}
+
 char* test_cpu_utilization_overall() {
     print_test_details(__func__, "Testing overall CPU utilization (takes around 20 seconds)");
 
@@ -1633,6 +2522,56 @@ char* test_select_with_duplicate_channel_size1() {
     return test_select_with_duplicate_channel(1);
 }
 
+typedef struct {
+    channel_t* a;
+    channel_t* b;
+    _Atomic size_t* seen;  // receive count per message value
+} select_commit_args;
+
+void* helper_select_commit(select_commit_args* myargs) {
+    // a appears twice so the select also exercises duplicate registrations
+    select_t list[3] = {{myargs->a, RECV, NULL}, {myargs->b, RECV, NULL}, {myargs->a, RECV, NULL}};
+    size_t index;
+    while (channel_select(list, 3, &index) == SUCCESS) {
+        atomic_fetch_add(&myargs->seen[(size_t)list[index].data], 1);
+    }
+    return NULL;
+}
+
+char* test_select_atomic_commit() {
+    print_test_details(__func__, "Testing that blocked selects commit each message exactly once");
+
+    size_t SELECTORS = 4;
+    size_t MESSAGES = 5000;
+    channel_t* a = channel_create(1);
+    channel_t* b = channel_create(2);
+    _Atomic size_t* seen = calloc(MESSAGES, sizeof(size_t));
+    select_commit_args args = {a, b, seen};
+    pthread_t pid[SELECTORS];
+    for (size_t i = 0; i < SELECTORS; i++) {
+        pthread_create(&pid[i], NULL, (void *)helper_select_commit, &args);
+    }
+    for (size_t i = 0; i < MESSAGES; i++) {
+        mu_assert("test_select_atomic_commit: Send failed", channel_send((i % 3 == 0) ? b : a, (void*)i) == SUCCESS);
+    }
+    // selectors return CLOSED_ERROR once a channel they wait on is closed and drained
+    while (channel_length(a) > 0 || channel_length(b) > 0) {
+        sched_yield();
+    }
+    channel_close(a);
+    channel_close(b);
+    for (size_t i = 0; i < SELECTORS; i++) {
+        pthread_join(pid[i], NULL);
+    }
+    for (size_t i = 0; i < MESSAGES; i++) {
+        mu_assert("test_select_atomic_commit: Message lost or received twice", atomic_load(&seen[i]) == 1);
+    }
+    free(seen);
+    channel_destroy(a);
+    channel_destroy(b);
+    return NULL;
+}
+
 
 typedef char* (*test_fn_t)();
 typedef struct {
@@ -1642,6 +2581,17 @@ typedef struct {
 
 test_t tests[] = {{"test_initialization", test_initialization},
                   {"test_free", test_free},
+                  {"test_linked_list", test_linked_list},
+                  {"test_mpsc_queue", test_mpsc_queue},
+                  {"test_waiter_reuse", test_waiter_reuse},
+                  {"test_trace", test_trace},
+                  {"test_fifo_ordering", test_fifo_ordering},
+                  {"test_priority_lanes", test_priority_lanes},
+                  {"test_channel_group", test_channel_group},
+                  {"test_affinity", test_affinity},
+                  {"test_huge_page_ring", test_huge_page_ring},
+                  {"test_rpc", test_rpc},
+                  {"test_pipeline", test_pipeline},
                   {"test_send_correctness", test_send_correctness},
                   {"test_receive_correctness", test_receive_correctness},
                   {"test_non_blocking_send", test_non_blocking_send},
@@ -1649,11 +2599,14 @@ test_t tests[] = {{"test_initialization", test_initialization},
                   {"test_multiple_channels", test_multiple_channels},
                   {"test_overall_send_receive", test_overall_send_receive},
                   {"test_stress_send_recv", test_stress_send_recv},
+                  {"test_stress_open_loop", test_stress_open_loop},
+                  {"test_linearizability", test_linearizability},
                   {"test_response_time", test_response_time},
                   {"test_cpu_utilization_send", test_cpu_utilization_send},
                   {"test_cpu_utilization_receive", test_cpu_utilization_receive},
                   {"test_channel_close_with_send", test_channel_close_with_send},
                   {"test_channel_close_with_receive", test_channel_close_with_receive},
+                  {"test_channel_close_send", test_channel_close_send},
                   {"test_select", test_select},
                   {"test_select_close", test_select_close},
                   {"test_select_and_non_blocking_send_size1", test_select_and_non_blocking_send_size1},
@@ -1662,7 +2615,9 @@ test_t tests[] = {{"test_initialization", test_initialization},
                   {"test_select_with_same_channel_size1", test_select_with_same_channel_size1},
                   {"test_select_with_send_receive_on_same_channel_size1", test_select_with_send_receive_on_same_channel_size1},
                   {"test_select_with_duplicate_channel_size1", test_select_with_duplicate_channel_size1},
+                  {"test_select_atomic_commit", test_select_atomic_commit},
                   {"test_stress", test_stress},
+                  {"test_binary_topology", test_binary_topology},
                   {"test_select_response_time", test_select_response_time},
                   {"test_cpu_utilization_select", test_cpu_utilization_select},
                   {"test_cpu_utilization_overall", test_cpu_utilization_overall},
@@ -1691,6 +2646,17 @@ char* all_tests(size_t iters) {
 int main(int argc, char** argv) {
     char* result = NULL;
     size_t iters = 1;
+    // leading --affinity=<policy> options pin the harness threads (see affinity.h)
+    while (argc > 1 && strncmp(argv[1], "--affinity=", 11) == 0) {
+        if (!affinity_configure(argv[1] + 11)) {
+            printf("Invalid affinity %s\n", argv[1] + 11);
+            return 1;
+        }
+        affinity_spec = argv[1] + 11;
+        affinity_describe(stdout);
+        argc--;
+        argv++;
+    }
     if (argc == 1) {
         result = all_tests(iters);
         if (result != NULL) {
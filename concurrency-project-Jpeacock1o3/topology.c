@@ -0,0 +1,269 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "topology.h"
+
+// Rounds offset up to the next multiple of 8
+static size_t align8(size_t offset)
+{
+    return (offset + 7) & ~(size_t)7;
+}
+
+// Computes the file offsets of the three CSR arrays and the total file size
+// Returns false if the file would be larger than a size_t can describe
+static bool binary_layout(size_t num_nodes, size_t num_edges, size_t* cols_offset, size_t* weights_offset, size_t* total_size)
+{
+    size_t rows_offset = align8(sizeof(topology_header_t));
+    if (num_nodes > (SIZE_MAX - rows_offset - 8) / sizeof(uint64_t) - 1) {
+        return false;
+    }
+    *cols_offset = align8(rows_offset + sizeof(uint64_t) * (num_nodes + 1));
+    // each edge takes a column and a weight, plus at most 7 bytes of padding between the arrays
+    if (num_edges > (SIZE_MAX - *cols_offset - 8) / (sizeof(uint32_t) + sizeof(distance_t))) {
+        return false;
+    }
+    *weights_offset = align8(*cols_offset + sizeof(uint32_t) * num_edges);
+    *total_size = *weights_offset + sizeof(distance_t) * num_edges;
+    return true;
+}
+
+// Parses the next integer from the text, advancing pos past it
+// Returns false if no integer is left
+static bool next_int(char** pos, long* value)
+{
+    char* end;
+    *value = strtol(*pos, &end, 10);
+    if (end == *pos) {
+        return false;
+    }
+    *pos = end;
+    return true;
+}
+
+bool topology_load_text(topology_t* topology, const char* filename)
+{
+    FILE* file = fopen(filename, "r");
+    if (file == NULL) {
+        return false;
+    }
+    // slurp the whole file so parsing does not go through stdio once per cell
+    struct stat st;
+    if (fstat(fileno(file), &st) != 0) {
+        fclose(file);
+        return false;
+    }
+    size_t length = (size_t)st.st_size;
+    char* text = malloc(length + 1);
+    if (text == NULL) {
+        fclose(file);
+        return false;
+    }
+    size_t num_read = fread(text, 1, length, file);
+    fclose(file);
+    text[num_read] = '\0';
+
+    char* pos = text;
+    long value;
+    if (!next_int(&pos, &value) || value <= 0) {
+        free(text);
+        return false;
+    }
+    size_t num_nodes = (size_t)value;
+    size_t edge_capacity = num_nodes * 4;
+    uint64_t* row_offsets = malloc(sizeof(uint64_t) * (num_nodes + 1));
+    uint32_t* cols = malloc(sizeof(uint32_t) * edge_capacity);
+    distance_t* weights = malloc(sizeof(distance_t) * edge_capacity);
+    bool valid = (row_offsets != NULL) && (cols != NULL) && (weights != NULL);
+    size_t num_edges = 0;
+    for (size_t src = 0; valid && src < num_nodes; src++) {
+        row_offsets[src] = num_edges;
+        for (size_t dst = 0; dst < num_nodes; dst++) {
+            if (!next_int(&pos, &value)) {
+                valid = false;
+                break;
+            }
+            // negative values mean there is no link
+            if (value < 0) {
+                continue;
+            }
+            if (num_edges == edge_capacity) {
+                edge_capacity *= 2;
+                uint32_t* new_cols = realloc(cols, sizeof(uint32_t) * edge_capacity);
+                if (new_cols != NULL) {
+                    cols = new_cols;
+                }
+                distance_t* new_weights = realloc(weights, sizeof(distance_t) * edge_capacity);
+                if (new_weights != NULL) {
+                    weights = new_weights;
+                }
+                if (new_cols == NULL || new_weights == NULL) {
+                    valid = false;
+                    break;
+                }
+            }
+            cols[num_edges] = (uint32_t)dst;
+            weights[num_edges] = (value > inf_distance) ? inf_distance : (distance_t)value;
+            num_edges++;
+        }
+    }
+    free(text);
+    if (!valid) {
+        free(row_offsets);
+        free(cols);
+        free(weights);
+        return false;
+    }
+    row_offsets[num_nodes] = num_edges;
+
+    topology->num_nodes = num_nodes;
+    topology->num_edges = num_edges;
+    topology->row_offsets = row_offsets;
+    topology->cols = cols;
+    topology->weights = weights;
+    topology->map = NULL;
+    topology->map_size = 0;
+    return true;
+}
+
+bool topology_load_binary(topology_t* topology, const char* filename)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(topology_header_t)) {
+        close(fd);
+        return false;
+    }
+    size_t map_size = (size_t)st.st_size;
+    void* map = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    // validation below and then the routers walk every row, so start paging the arrays in now
+    madvise(map, map_size, MADV_WILLNEED);
+
+    // validate the header, the row offsets and the columns, since routers index nodes by them and
+    // topology_distance binary-searches each row; the arrays are then used in place
+    const topology_header_t* header = map;
+    size_t cols_offset, weights_offset, total_size;
+    bool valid = (memcmp(header->magic, TOPOLOGY_MAGIC, sizeof(header->magic)) == 0) &&
+                 (header->version == TOPOLOGY_VERSION) &&
+                 (header->num_nodes > 0) && (header->num_nodes <= UINT32_MAX);
+    if (valid) {
+        valid = binary_layout(header->num_nodes, header->num_edges, &cols_offset, &weights_offset, &total_size) &&
+                (total_size <= map_size);
+    }
+    if (valid) {
+        const uint64_t* row_offsets = (const uint64_t*)((const char*)map + align8(sizeof(topology_header_t)));
+        valid = (row_offsets[0] == 0) && (row_offsets[header->num_nodes] == header->num_edges);
+        for (size_t i = 0; valid && i < header->num_nodes; i++) {
+            valid = (row_offsets[i] <= row_offsets[i + 1]);
+        }
+        const uint32_t* cols = (const uint32_t*)((const char*)map + cols_offset);
+        for (size_t i = 0; valid && i < header->num_nodes; i++) {
+            for (uint64_t edge = row_offsets[i]; valid && edge < row_offsets[i + 1]; edge++) {
+                valid = (cols[edge] < header->num_nodes) && (edge == row_offsets[i] || cols[edge - 1] < cols[edge]);
+            }
+        }
+    }
+    if (!valid) {
+        munmap(map, map_size);
+        return false;
+    }
+
+    topology->num_nodes = header->num_nodes;
+    topology->num_edges = header->num_edges;
+    topology->row_offsets = (const uint64_t*)((const char*)map + align8(sizeof(topology_header_t)));
+    topology->cols = (const uint32_t*)((const char*)map + cols_offset);
+    topology->weights = (const distance_t*)((const char*)map + weights_offset);
+    topology->map = map;
+    topology->map_size = map_size;
+    return true;
+}
+
+bool topology_load(topology_t* topology, const char* filename)
+{
+    FILE* file = fopen(filename, "r");
+    if (file == NULL) {
+        return false;
+    }
+    char magic[sizeof(((topology_header_t*)0)->magic)];
+    size_t num_read = fread(magic, 1, sizeof(magic), file);
+    fclose(file);
+    if (num_read == sizeof(magic) && memcmp(magic, TOPOLOGY_MAGIC, sizeof(magic)) == 0) {
+        return topology_load_binary(topology, filename);
+    }
+    return topology_load_text(topology, filename);
+}
+
+bool topology_write_binary(const topology_t* topology, const char* filename)
+{
+    size_t cols_offset, weights_offset, total_size;
+    if (!binary_layout(topology->num_nodes, topology->num_edges, &cols_offset, &weights_offset, &total_size)) {
+        return false;
+    }
+    FILE* file = fopen(filename, "wb");
+    if (file == NULL) {
+        return false;
+    }
+    topology_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TOPOLOGY_MAGIC, sizeof(header.magic));
+    header.version = TOPOLOGY_VERSION;
+    header.num_nodes = topology->num_nodes;
+    header.num_edges = topology->num_edges;
+
+    size_t rows_offset = align8(sizeof(topology_header_t));
+    static const char padding[8];
+    bool valid = fwrite(&header, sizeof(header), 1, file) == 1;
+    valid = valid && fwrite(padding, 1, rows_offset - sizeof(header), file) == rows_offset - sizeof(header);
+    valid = valid && fwrite(topology->row_offsets, sizeof(uint64_t), topology->num_nodes + 1, file) == topology->num_nodes + 1;
+    size_t pos = rows_offset + sizeof(uint64_t) * (topology->num_nodes + 1);
+    valid = valid && fwrite(padding, 1, cols_offset - pos, file) == cols_offset - pos;
+    valid = valid && fwrite(topology->cols, sizeof(uint32_t), topology->num_edges, file) == topology->num_edges;
+    pos = cols_offset + sizeof(uint32_t) * topology->num_edges;
+    valid = valid && fwrite(padding, 1, weights_offset - pos, file) == weights_offset - pos;
+    valid = valid && fwrite(topology->weights, sizeof(distance_t), topology->num_edges, file) == topology->num_edges;
+    if (fclose(file) != 0) {
+        valid = false;
+    }
+    return valid;
+}
+
+distance_t topology_distance(const topology_t* topology, size_t src, size_t dst)
+{
+    // binary search the sorted destinations of src
+    size_t low = (size_t)topology->row_offsets[src];
+    size_t high = (size_t)topology->row_offsets[src + 1];
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (topology->cols[mid] < dst) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (low < (size_t)topology->row_offsets[src + 1] && topology->cols[low] == dst) {
+        return topology->weights[low];
+    }
+    return inf_distance;
+}
+
+void topology_destroy(topology_t* topology)
+{
+    if (topology->map != NULL) {
+        munmap(topology->map, topology->map_size);
+    } else {
+        free((void*)topology->row_offsets);
+        free((void*)topology->cols);
+        free((void*)topology->weights);
+    }
+    memset(topology, 0, sizeof(*topology));
+}
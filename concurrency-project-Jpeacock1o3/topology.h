@@ -0,0 +1,62 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef unsigned int distance_t;
+
+// Binary topology files start with this magic followed by a format version
+#define TOPOLOGY_MAGIC "CHTOPO\0\0"
+#define TOPOLOGY_VERSION 1
+
+// On-disk header of a binary topology file
+// The header is followed by the CSR arrays, each starting at an 8-byte aligned offset:
+//   uint64_t   row_offsets[num_nodes + 1]  (edges of node i are [row_offsets[i], row_offsets[i + 1]))
+//   uint32_t   cols[num_edges]             (destination node, sorted ascending within a row)
+//   distance_t weights[num_edges]          (link distance of the matching entry in cols)
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t num_nodes;
+    uint64_t num_edges;
+} topology_header_t;
+
+// Defines a graph topology stored in compressed sparse row (CSR) form
+// The arrays either point into a read-only mapping of a binary file or into heap storage built from a text file
+typedef struct {
+    size_t num_nodes;
+    size_t num_edges;
+    const uint64_t* row_offsets;
+    const uint32_t* cols;
+    const distance_t* weights;
+    void* map;       // mapping of a binary file (NULL when the arrays are heap allocated)
+    size_t map_size; // length of map
+} topology_t;
+
+static const distance_t inf_distance = 0x7fffffff;
+
+// Loads a topology from either a text (N followed by an NxN matrix) or a binary file
+// The format is detected from the file contents; binary files are mmapped and not copied
+// Returns true on success and false if the file could not be opened or is malformed
+bool topology_load(topology_t* topology, const char* filename);
+
+// Loads a topology from a text file containing N followed by an NxN matrix (negative entries mean no link)
+bool topology_load_text(topology_t* topology, const char* filename);
+
+// Maps a binary topology file into memory
+bool topology_load_binary(topology_t* topology, const char* filename);
+
+// Writes the topology in the binary format
+// Returns true on success
+bool topology_write_binary(const topology_t* topology, const char* filename);
+
+// Returns the distance of the direct link from src to dst, or inf_distance if there is none
+distance_t topology_distance(const topology_t* topology, size_t src, size_t dst);
+
+// Releases the mapping or storage owned by the topology
+void topology_destroy(topology_t* topology);
+
+#endif // TOPOLOGY_H
@@ -0,0 +1,25 @@
+#include <stdio.h>
+#include "topology.h"
+
+// Converts a topology file (text or binary) into the binary topology format
+// Usage: ./topology_convert <input> <output>
+int main(int argc, char** argv)
+{
+    if (argc != 3) {
+        printf("Usage: %s <input topology> <output binary topology>\n", argv[0]);
+        return 1;
+    }
+    topology_t topology;
+    if (!topology_load(&topology, argv[1])) {
+        printf("Could not load topology file: %s\n", argv[1]);
+        return 1;
+    }
+    bool written = topology_write_binary(&topology, argv[2]);
+    if (!written) {
+        printf("Could not write binary topology file: %s\n", argv[2]);
+    } else {
+        printf("Wrote %zu nodes and %zu edges to %s\n", topology.num_nodes, topology.num_edges, argv[2]);
+    }
+    topology_destroy(&topology);
+    return written ? 0 : 1;
+}
@@ -0,0 +1,98 @@
+#include <stdlib.h>
+#include "trace.h"
+
+__thread trace_ring_t* trace_thread_ring;
+static _Atomic(trace_ring_t*) trace_rings;  // lock-free registry, rings live until trace_shutdown
+static atomic_uint trace_next_thread;
+
+static const char* trace_block_names[] = {"send", "recv", "select"};
+
+// Allocates and registers the calling thread's ring
+trace_ring_t* trace_ring_create(void)
+{
+    trace_ring_t* ring = calloc(1, sizeof(trace_ring_t));
+    if (!ring) return NULL;
+    ring->thread = atomic_fetch_add(&trace_next_thread, 1) + 1;
+    ring->next = atomic_load_explicit(&trace_rings, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(&trace_rings, &ring->next, ring, memory_order_release,
+                                                  memory_order_relaxed)) {
+    }
+    trace_thread_ring = ring;
+    return ring;
+}
+
+bool trace_enabled(void)
+{
+#ifdef CHANNEL_TRACE
+    return true;
+#else
+    return false;
+#endif
+}
+
+static void trace_write_event(FILE* out, const trace_ring_t* ring, const trace_record_t* record, bool* first)
+{
+    const char* name;
+    const char* phase;
+    switch (record->event) {
+    case TRACE_BLOCK_BEGIN:
+    case TRACE_BLOCK_END:
+        name = trace_block_names[record->arg < 3 ? record->arg : 0];
+        phase = (record->event == TRACE_BLOCK_BEGIN) ? "B" : "E";
+        break;
+    case TRACE_WAKE:
+        name = "wake";
+        phase = "i";
+        break;
+    case TRACE_HANDOFF:
+        name = "handoff";
+        phase = "i";
+        break;
+    case TRACE_CLOSE:
+        name = "close";
+        phase = "i";
+        break;
+    default:
+        return;
+    }
+    fprintf(out, "%s\n{\"name\":\"%s\",\"cat\":\"channel\",\"ph\":\"%s\",\"ts\":%.3f,\"pid\":1,\"tid\":%u,"
+            "\"args\":{\"channel\":\"%p\",\"arg\":%u}%s}", *first ? "" : ",", name, phase,
+            (double)record->timestamp / 1000.0, ring->thread, record->object, record->arg,
+            (phase[0] == 'i') ? ",\"s\":\"t\"" : "");
+    *first = false;
+}
+
+// Writes every thread's records as Chrome trace JSON
+void trace_dump_chrome(FILE* out)
+{
+    bool first = true;
+    fprintf(out, "{\"traceEvents\":[");
+    for (trace_ring_t* ring = atomic_load_explicit(&trace_rings, memory_order_acquire); ring; ring = ring->next) {
+        uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        uint64_t start = (head > TRACE_RING_SIZE) ? head - TRACE_RING_SIZE : 0;
+        for (uint64_t i = start; i < head; i++) {
+            trace_write_event(out, ring, &ring->records[i & (TRACE_RING_SIZE - 1)], &first);
+        }
+    }
+    fprintf(out, "\n],\"displayTimeUnit\":\"ns\"}\n");
+}
+
+// Discards all records
+void trace_reset(void)
+{
+    for (trace_ring_t* ring = atomic_load_explicit(&trace_rings, memory_order_acquire); ring; ring = ring->next) {
+        atomic_store_explicit(&ring->head, 0, memory_order_relaxed);
+    }
+}
+
+// Frees every ring
+void trace_shutdown(void)
+{
+    trace_ring_t* ring = atomic_exchange_explicit(&trace_rings, NULL, memory_order_acquire);
+    while (ring) {
+        trace_ring_t* next = ring->next;
+        free(ring);
+        ring = next;
+    }
+    trace_thread_ring = NULL;
+}
@@ -0,0 +1,93 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <time.h>
+
+// Channel tracepoints
+// Every thread appends fixed-size records to its own ring, so recording takes no locks and never blocks;
+// once a ring is full the oldest records are overwritten. trace_dump_chrome writes all rings as a
+// Chrome trace (load it in chrome://tracing or https://ui.perfetto.dev) showing which thread blocked on
+// which channel and for how long.
+//
+// channel.c only records when built with CHANNEL_TRACE defined (make TRACE=1 after a make clean);
+// otherwise the TRACE macro expands to nothing and costs nothing.
+
+#define TRACE_RING_SIZE 4096 // records kept per thread, must be a power of two
+
+enum trace_event {
+    TRACE_BLOCK_BEGIN, // thread parks on a channel; arg is a trace_block_kind
+    TRACE_BLOCK_END,   // parked thread resumes; arg is a trace_block_kind
+    TRACE_WAKE,        // thread woke a waiter that will retry its operation
+    TRACE_HANDOFF,     // thread completed a queued waiter's operation for it
+    TRACE_CLOSE        // thread closed a channel; arg is the number of waiters it woke
+};
+
+enum trace_block_kind {
+    TRACE_BLOCK_SEND,
+    TRACE_BLOCK_RECV,
+    TRACE_BLOCK_SELECT
+};
+
+typedef struct {
+    uint64_t timestamp; // CLOCK_MONOTONIC nanoseconds
+    const void* object; // channel the event happened on
+    uint32_t event;     // enum trace_event
+    uint32_t arg;
+} trace_record_t;
+
+typedef struct trace_ring {
+    struct trace_ring* next;  // registry of every thread's ring, newest first
+    uint32_t thread;          // sequential id shown as the trace's tid
+    _Atomic uint64_t head;    // records ever written; only the owning thread stores to it
+    trace_record_t records[TRACE_RING_SIZE];
+} trace_ring_t;
+
+extern __thread trace_ring_t* trace_thread_ring;
+
+// Allocates and registers the calling thread's ring; returns NULL if out of memory
+trace_ring_t* trace_ring_create(void);
+
+// Appends a record to the calling thread's ring
+static inline void trace_record(enum trace_event event, const void* object, uint32_t arg)
+{
+    trace_ring_t* ring = trace_thread_ring;
+    if (!ring && !(ring = trace_ring_create())) return;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    trace_record_t* record = &ring->records[head & (TRACE_RING_SIZE - 1)];
+    record->timestamp = (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+    record->object = object;
+    record->event = event;
+    record->arg = arg;
+    // publishes the record to trace_dump_chrome
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+#ifdef CHANNEL_TRACE
+#define TRACE(event, object, arg) trace_record((event), (object), (uint32_t)(arg))
+#else
+// arguments are only referenced inside sizeof, so nothing is evaluated and no variable goes unused
+#define TRACE(event, object, arg) ((void)sizeof(event), (void)sizeof(object), (void)sizeof(arg))
+#endif
+
+// Returns true if channel.c was built with its tracepoints enabled
+bool trace_enabled(void);
+
+// Writes every thread's records as Chrome trace JSON
+// Records a thread overwrites while the dump reads them may come out garbled, so dump once the threads
+// of interest are blocked or done (which is the case when diagnosing a stall)
+void trace_dump_chrome(FILE* out);
+
+// Discards all records; no thread may be recording concurrently
+void trace_reset(void);
+
+// Frees every thread's ring and its records; a later record allocates a new ring for its thread
+// Only the calling thread's ring pointer is cleared, so every other thread that recorded must have exited
+void trace_shutdown(void);
+
+#endif // TRACE_H
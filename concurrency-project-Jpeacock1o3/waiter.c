@@ -0,0 +1,123 @@
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include "waiter.h"
+
+static __thread waiter_t thread_waiter;
+static pthread_key_t waiter_key;
+static pthread_once_t waiter_key_once = PTHREAD_ONCE_INIT;
+
+// Frees grown registrations when a thread that needed them exits
+static void waiter_release_links(void* links)
+{
+    free(links);
+}
+
+static void waiter_create_key()
+{
+    pthread_key_create(&waiter_key, waiter_release_links);
+}
+
+// Blocks while *word == expected (or until a spurious wake-up)
+void futex_wait(_Atomic uint32_t* word, uint32_t expected)
+{
+    syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+}
+
+static void futex_wake(_Atomic uint32_t* word)
+{
+    syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+// Wakes every thread blocked in futex_wait on word
+void futex_wake_all(_Atomic uint32_t* word)
+{
+    syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, INT32_MAX, NULL, NULL, 0);
+}
+
+// Returns the calling thread's waiter with room for at least num_links registrations
+waiter_t* waiter_get(size_t num_links)
+{
+    waiter_t* waiter = &thread_waiter;
+    if (waiter->links == NULL) {
+        waiter->links = waiter->inline_links;
+        waiter->link_capacity = WAITER_INLINE_LINKS;
+    }
+    if (num_links > waiter->link_capacity) {
+        // grow geometrically so a thread reallocates at most a handful of times over its life
+        size_t capacity = waiter->link_capacity;
+        while (capacity < num_links) capacity *= 2;
+        waiter_link_t* old_links = (waiter->links == waiter->inline_links) ? NULL : waiter->links;
+        waiter_link_t* links = realloc(old_links, sizeof(waiter_link_t) * capacity);
+        if (!links) return NULL;
+        pthread_once(&waiter_key_once, waiter_create_key);
+        pthread_setspecific(waiter_key, links);
+        waiter->links = links;
+        waiter->link_capacity = capacity;
+    }
+    for (size_t i = 0; i < num_links; i++) {
+        waiter->links[i].waiter = waiter;
+        waiter->links[i].handoff = false;
+        ilist_node_init(&waiter->links[i].node);
+    }
+    return waiter;
+}
+
+// Frees the calling thread's grown registrations and goes back to the inline ones
+void waiter_trim(void)
+{
+    waiter_t* waiter = &thread_waiter;
+    if (waiter->links == NULL || waiter->links == waiter->inline_links) return;
+    free(waiter->links);
+    pthread_setspecific(waiter_key, NULL);
+    waiter->links = waiter->inline_links;
+    waiter->link_capacity = WAITER_INLINE_LINKS;
+}
+
+// Arms the waiter before it is published on any queue
+void waiter_prepare(waiter_t* waiter)
+{
+    waiter->fired = NULL;
+    atomic_store_explicit(&waiter->state, WAITER_PARKED, memory_order_relaxed);
+}
+
+// Blocks the calling thread until a waker releases the waiter
+void waiter_park(waiter_t* waiter)
+{
+    uint32_t state;
+    while ((state = atomic_load_explicit(&waiter->state, memory_order_acquire)) != WAITER_WOKEN) {
+        futex_wait(&waiter->state, state);
+    }
+    atomic_store_explicit(&waiter->state, WAITER_IDLE, memory_order_relaxed);
+}
+
+// Claims the waiter behind link so the caller may fill in its result and fired registration
+bool waiter_claim(waiter_link_t* link)
+{
+    waiter_t* waiter = link->waiter;
+    uint32_t expected = WAITER_PARKED;
+    if (!atomic_compare_exchange_strong_explicit(&waiter->state, &expected, WAITER_WAKING,
+                                                 memory_order_acquire, memory_order_relaxed)) {
+        return false;
+    }
+    waiter->fired = link;
+    return true;
+}
+
+// Releases a claimed waiter
+void waiter_release(waiter_t* waiter)
+{
+    atomic_store_explicit(&waiter->state, WAITER_WOKEN, memory_order_release);
+    // a spurious wake of a recycled waiter is harmless; waiter_park rechecks the state
+    futex_wake(&waiter->state);
+}
+
+// Claims and releases the waiter behind link
+bool waiter_wake(waiter_link_t* link)
+{
+    if (!waiter_claim(link)) return false;
+    waiter_release(link->waiter);
+    return true;
+}
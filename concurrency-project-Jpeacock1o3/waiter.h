@@ -0,0 +1,78 @@
+#ifndef WAITER_H
+#define WAITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "linked_list.h"
+
+// Number of registrations every thread's waiter holds without touching the heap
+#define WAITER_INLINE_LINKS 8
+
+// States of a waiter's futex word
+enum waiter_state {
+    WAITER_IDLE = 0,    // not blocked
+    WAITER_PARKED = 1,  // registered and about to block (or blocked)
+    WAITER_WAKING = 2,  // claimed by a waker that is still filling in the result
+    WAITER_WOKEN = 3    // released; the blocked call may continue
+};
+
+typedef struct waiter waiter_t;
+
+// Registration of a waiter on one channel's send or receive queue
+// The channel's lock protects node and every field the waker fills in
+typedef struct {
+    ilist_node_t node; // link in the channel's waiter queue
+    waiter_t* waiter;  // owner of this registration
+    size_t index;      // position in the select list (0 for plain send/receive)
+    void* owner;       // channel whose queue holds this registration; select orders its locks by it
+    bool handoff;      // waker completes the operation itself instead of letting the waiter retry
+    void* data;        // message to send, or slot for the received message when handoff is set
+    size_t lane;       // priority lane a hand-off send puts its message on
+} waiter_link_t;
+
+// A thread's blocking record, reused by every blocking call the thread makes
+struct waiter {
+    _Atomic uint32_t state;              // futex word, see enum waiter_state
+    waiter_link_t* fired;                // registration the waker claimed the waiter through
+    int result;                          // channel status set by a hand-off waker
+    waiter_link_t* links;                // registrations, inline_links unless a larger select grew it
+    size_t link_capacity;
+    waiter_link_t inline_links[WAITER_INLINE_LINKS];
+};
+
+// Returns the calling thread's waiter with room for at least num_links registrations
+// Only allocates the first time a thread selects over more than WAITER_INLINE_LINKS channels
+// Returns NULL if growing the registrations failed
+waiter_t* waiter_get(size_t num_links);
+
+// Frees the calling thread's grown registrations, which otherwise last until the thread exits
+// (never, for the main thread); the thread must not be blocked in or registered by any call
+void waiter_trim(void);
+
+// Arms the waiter before it is published on any queue
+void waiter_prepare(waiter_t* waiter);
+
+// Blocks the calling thread until a waker releases the waiter
+void waiter_park(waiter_t* waiter);
+
+// Claims the waiter behind link so the caller may fill in its result and fired registration
+// Returns false if another waker already claimed it, in which case the caller should wake someone else
+bool waiter_claim(waiter_link_t* link);
+
+// Releases a claimed waiter, publishing everything written to it and its links since the claim
+void waiter_release(waiter_t* waiter);
+
+// Claims and releases the waiter behind link
+// Returns false if another waker already claimed it
+bool waiter_wake(waiter_link_t* link);
+
+// Futex primitives, shared with other blocking objects built on a single state word
+// Blocks while *word == expected (or until a spurious wake-up)
+void futex_wait(_Atomic uint32_t* word, uint32_t expected);
+
+// Wakes every thread blocked in futex_wait on word
+void futex_wake_all(_Atomic uint32_t* word);
+
+#endif // WAITER_H